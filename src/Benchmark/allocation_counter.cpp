@@ -0,0 +1,73 @@
+#include "benchmark.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+//the benchmarks replace the global operator new, so they can show which parts of the engines still allocate per step
+
+namespace {
+	std::atomic<uint64_t> allocations(0);
+
+	void* counted_allocation(size_t size){
+		allocations.fetch_add(1, std::memory_order_relaxed);
+
+		void* p = std::malloc(size > 0 ? size : 1);
+		if(!p) {
+			throw std::bad_alloc();
+		}
+		return p;
+	}
+}
+
+uint64_t heap_allocations(){
+	return allocations.load(std::memory_order_relaxed);
+}
+
+void* operator new(size_t size){
+	return counted_allocation(size);
+}
+
+void* operator new[](size_t size){
+	return counted_allocation(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept{
+	try {
+		return counted_allocation(size);
+	} catch(const std::bad_alloc&) {
+		return nullptr;
+	}
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept{
+	try {
+		return counted_allocation(size);
+	} catch(const std::bad_alloc&) {
+		return nullptr;
+	}
+}
+
+void operator delete(void* p) noexcept{
+	std::free(p);
+}
+
+void operator delete[](void* p) noexcept{
+	std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept{
+	std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept{
+	std::free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept{
+	std::free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept{
+	std::free(p);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//command line of a benchmark, made up of "--name value" options and "--name" switches
+class benchmark_arguments {
+public:
+	benchmark_arguments(int argc, char** argv);
+
+	bool has(const char* name) const;
+	std::string get(const char* name, const std::string& fallback) const;
+
+	//accepts the suffixes K and M, so "--max 16M" is 16 * 1024 * 1024
+	uint64_t get_count(const char* name, uint64_t fallback) const;
+
+private:
+	std::vector<std::string> args;
+};
+
+inline double seconds_since(std::chrono::steady_clock::time_point start){
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+//median of the given samples, the vector gets reordered
+double median(std::vector<double>& samples);
+
+//calls of the global operator new since the start of the program, see allocation_counter.cpp
+uint64_t heap_allocations();
+
+//times the passes of the CPU SPH engine, see sph_benchmark.cpp for the options
+int run_sph_benchmark(const benchmark_arguments& args);
+
+//times the marching cubes surface extraction, see surface_benchmark.cpp for the options
+int run_surface_benchmark(const benchmark_arguments& args);
+
+//times the headless rendering of Simulation2 frames, see sprite_benchmark.cpp for the options
+int run_sprite_benchmark(const benchmark_arguments& args);
+
+//times the headless rendering of Simulation1 frames, see splat_benchmark.cpp for the options
+int run_splat_benchmark(const benchmark_arguments& args);
+
+//times how long the CPU solver spends handing its state to concurrent consumers, see handoff_benchmark.cpp for the options
+int run_handoff_benchmark(const benchmark_arguments& args);
+
+//times the wake up latency of timeline waiters, see timeline_benchmark.cpp for the options
+int run_timeline_benchmark(const benchmark_arguments& args);
+
+//times the scans, compaction, histogram, counting sort and segmented reduction of parallel_primitives, see primitives_benchmark.cpp for the options
+int run_primitives_benchmark(const benchmark_arguments& args);
+
+//times the deterministic render point emission of Simulation1 against an atomic append, see emission_benchmark.cpp for the options
+int run_emission_benchmark(const benchmark_arguments& args);
+
+//times the collide and stream passes of the CPU lattice engine of Simulation1, see lattice_benchmark.cpp for the options
+int run_lattice_benchmark(const benchmark_arguments& args);
+
+//times the generic and the fixed width direction codecs of the lattice engine, see codec_benchmark.cpp for the options
+int run_codec_benchmark(const benchmark_arguments& args);
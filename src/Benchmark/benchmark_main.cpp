@@ -0,0 +1,107 @@
+#include "benchmark.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+benchmark_arguments::benchmark_arguments(int argc, char** argv) :
+	args(argv, argv + argc)
+{}
+
+bool benchmark_arguments::has(const char* name) const{
+	return std::find(args.begin(), args.end(), std::string("--") + name) != args.end();
+}
+
+std::string benchmark_arguments::get(const char* name, const std::string& fallback) const{
+	auto it = std::find(args.begin(), args.end(), std::string("--") + name);
+
+	if(it == args.end() || it + 1 == args.end()) {
+		return fallback;
+	}
+	return *(it + 1);
+}
+
+uint64_t benchmark_arguments::get_count(const char* name, uint64_t fallback) const{
+	std::string value = get(name, "");
+
+	if(value.empty()) {
+		return fallback;
+	}
+
+	char* end;
+	uint64_t count = strtoull(value.c_str(), &end, 10);
+
+	if(*end == 'K' || *end == 'k') {
+		count *= 1024;
+		end++;
+	} else if(*end == 'M' || *end == 'm') {
+		count *= 1024 * 1024;
+		end++;
+	}
+
+	if(end == value.c_str() || *end != '\0') {
+		throw std::runtime_error("invalid value '" + value + "' for --" + name);
+	}
+	return count;
+}
+
+double median(std::vector<double>& samples){
+	if(samples.empty()) {
+		return 0.0;
+	}
+
+	std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+	return samples[samples.size() / 2];
+}
+
+namespace {
+	struct benchmark {
+		const char* name;
+		int (*run)(const benchmark_arguments&);
+		const char* description;
+	};
+
+	const benchmark BENCHMARKS[] = {
+		{"sph", run_sph_benchmark, "per pass timings of the CPU SPH engine"},
+		{"surface", run_surface_benchmark, "marching cubes surface extraction from the CPU SPH engine"},
+		{"sprites", run_sprite_benchmark, "headless sphere sprite rendering of Simulation2 frames"},
+		{"splats", run_splat_benchmark, "headless three pass splatting of Simulation1 frames"},
+		{"handoff", run_handoff_benchmark, "state handoff from the CPU solver to render, analytics and writer threads"},
+		{"timeline", run_timeline_benchmark, "signal to wake up round trips of timeline waiters"},
+		{"primitives", run_primitives_benchmark, "throughput of the parallel scan, compaction, histogram, counting sort and segmented reduction"},
+		{"emission", run_emission_benchmark, "order stable render point emission of Simulation1 against an atomic append"},
+		{"lattice", run_lattice_benchmark, "MLUPS of the CPU lattice engine of Simulation1"},
+		{"codec", run_codec_benchmark, "packing and unpacking of the lattice directions of Simulation1 per bit width"},
+	};
+
+	void print_usage(){
+		printf("usage: liquids_bench <benchmark> [options]\n\nbenchmarks:\n");
+
+		for(const benchmark& b : BENCHMARKS) {
+			printf("  %-12s %s\n", b.name, b.description);
+		}
+	}
+}
+
+int main(int argc, char** argv){
+	if(argc < 2) {
+		print_usage();
+		return 1;
+	}
+
+	for(const benchmark& b : BENCHMARKS) {
+		if(strcmp(argv[1], b.name) == 0) {
+			try {
+				return b.run(benchmark_arguments(argc - 2, argv + 2));
+			} catch(const std::exception& e) {
+				fprintf(stderr, "%s\n", e.what());
+				return 1;
+			}
+		}
+	}
+
+	print_usage();
+	return 1;
+}
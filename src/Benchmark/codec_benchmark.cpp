@@ -0,0 +1,137 @@
+#include "benchmark.h"
+#include "src/Simulation1/cpu/direction_codec.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <stdexcept>
+
+//options:
+//	--points <n>					lattice points packed and unpacked per repetition (default 243000, the lattice of Simulation1)
+//	--bits <n>						bits per direction, 0 runs 8, 10, 12 and 16 (default 0)
+//	--reps <n>						timed repetitions per codec, the median is reported (default 20)
+//
+//packs random directions of every lattice point into a lattice buffer and unpacks them again, on one thread.
+//generic is the runtime loop over the fields, fixed scalar the one with the constexpr tables of the width,
+//fixed what the lattice engine runs, with SSE2 for the widths that have it: pack and unpack for 8 bits, only unpack for 16 bits.
+//the lattice buffers of all codecs have to match bitwise and unpack has to give back the directions packed.
+//the buffers of the lattice of Simulation1 don't fit into the cache, with a few thousand points only the codecs are timed.
+
+namespace {
+	struct codec_times {
+		double pack;
+		double unpack;
+	};
+
+	template<class F>
+	double time_median(uint64_t reps, F&& fn){
+		std::vector<double> samples;
+		samples.reserve(reps);
+
+		for(uint64_t r = 0; r < reps; r++) {
+			auto start = std::chrono::steady_clock::now();
+			fn();
+			samples.push_back(seconds_since(start));
+		}
+		return median(samples);
+	}
+
+	//pack and unpack are the calls of one codec, the lattice buffer and the unpacked values are checked after timing
+	template<class Pack, class Unpack>
+	codec_times run_codec(const std::vector<uint32_t>& values, const std::vector<uint32_t>& reference, uint32_t words, uint64_t reps, Pack pack,
+		Unpack unpack, const char* name){
+		const size_t points = values.size() / direction_codec::DIRECTIONS;
+
+		std::vector<uint32_t> lattice(points * words);
+		std::vector<uint32_t> unpacked(values.size());
+
+		codec_times times;
+		times.pack = time_median(reps, [&]() {
+			for(size_t i = 0; i < points; i++) {
+				pack(values.data() + i * direction_codec::DIRECTIONS, lattice.data() + i * words);
+			}
+		});
+		times.unpack = time_median(reps, [&]() {
+			for(size_t i = 0; i < points; i++) {
+				unpack(lattice.data() + i * words, unpacked.data() + i * direction_codec::DIRECTIONS);
+			}
+		});
+
+		if(!reference.empty() && lattice != reference) {
+			throw std::runtime_error(std::string("the lattice packed by ") + name + " differs from the one of generic");
+		}
+		if(unpacked != values) {
+			throw std::runtime_error(std::string(name) + " doesn't unpack the directions it packed");
+		}
+		return times;
+	}
+
+	template<uint32_t BITS>
+	void run_width(size_t points, uint64_t reps){
+		const direction_codec::generic generic(BITS);
+		direction_codec::fixed<BITS> fixed;
+		const uint32_t words = fixed.words();
+
+		std::vector<uint32_t> values(points * direction_codec::DIRECTIONS);
+		std::mt19937 rng(42);
+		std::uniform_int_distribution<uint32_t> value(0, direction_codec::fixed<BITS>::MASK);
+		std::generate(values.begin(), values.end(), [&]() { return value(rng); });
+
+		//the buffer of generic is the reference of the others
+		std::vector<uint32_t> reference(points * words);
+		for(size_t i = 0; i < points; i++) {
+			generic.pack(values.data() + i * direction_codec::DIRECTIONS, reference.data() + i * words);
+		}
+
+		codec_times generic_times = run_codec(values, std::vector<uint32_t>(), words, reps,
+			[&](const uint32_t* in, uint32_t* out) { generic.pack(in, out); },
+			[&](const uint32_t* in, uint32_t* out) { generic.unpack(in, out); }, "generic");
+		codec_times scalar_times = run_codec(values, reference, words, reps,
+			[&](const uint32_t* in, uint32_t* out) { fixed.pack_scalar(in, out); },
+			[&](const uint32_t* in, uint32_t* out) { fixed.unpack_scalar(in, out); }, "fixed scalar");
+		codec_times fixed_times = run_codec(values, reference, words, reps,
+			[&](const uint32_t* in, uint32_t* out) { fixed.pack(in, out); },
+			[&](const uint32_t* in, uint32_t* out) { fixed.unpack(in, out); }, "fixed");
+
+		auto print_row = [&](const char* name, const codec_times& times) {
+			printf("  %-14s %12.2f %10.2f %12.2f %10.2f\n", name, times.pack * 1e9 / points, generic_times.pack / times.pack,
+				times.unpack * 1e9 / points, generic_times.unpack / times.unpack);
+		};
+
+		const char* simd = direction_codec::fixed<BITS>::SIMD_PACK ? ", fixed with SSE2" : direction_codec::fixed<BITS>::SIMD ? ", fixed unpacks with SSE2" : "";
+		printf("%u bits per direction, %u words per lattice point%s\n", BITS, words, simd);
+		printf("  %-14s %12s %10s %12s %10s\n", "codec", "pack ns", "speedup", "unpack ns", "speedup");
+		print_row("generic", generic_times);
+		print_row("fixed scalar", scalar_times);
+		print_row("fixed", fixed_times);
+	}
+}
+
+int run_codec_benchmark(const benchmark_arguments& args){
+	uint64_t points = args.get_count("points", 243000);
+	uint64_t bits = args.get_count("bits", 0);
+	uint64_t reps = std::max<uint64_t>(1, args.get_count("reps", 20));
+
+	if(points == 0) {
+		throw std::runtime_error("there has to be at least one lattice point");
+	}
+	if(bits != 0 && bits != 8 && bits != 10 && bits != 12 && bits != 16) {
+		throw std::runtime_error("only 8, 10, 12 and 16 bits per direction have a fixed codec");
+	}
+
+	if(bits == 0 || bits == 8) {
+		run_width<8>(points, reps);
+	}
+	if(bits == 0 || bits == 10) {
+		run_width<10>(points, reps);
+	}
+	if(bits == 0 || bits == 12) {
+		run_width<12>(points, reps);
+	}
+	if(bits == 0 || bits == 16) {
+		run_width<16>(points, reps);
+	}
+	printf("the lattices of all codecs match\n");
+
+	return 0;
+}
@@ -0,0 +1,158 @@
+#include "benchmark.h"
+#include "src/Simulation1/cpu/point_emitter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+
+//options:
+//	--resolution <n>				lattice points per unit, the lattice is 3 x 1 x 3 units as in Simulation1 (default 30)
+//	--points <n>					points per lattice point, 1 or 8 (default 8 as in Simulation1)
+//	--threads <n>					0 uses every hardware thread (default)
+//	--reps <n>						timed emissions per variant, the median is reported (default 20)
+//
+//the particle counts are a wavy pool of liquid filling about half of the lattice, above it they stay below the threshold.
+//point_emitter is timed next to a serial loop and next to an emission like the one of the shader,
+//where every lattice point above the threshold takes its slots from one atomic counter.
+//the compaction has to match the serial loop bitwise, the atomic emission only as a set of points.
+//reported is also how many atomic emissions came out in another order than the one before, which the compaction never does.
+
+namespace {
+	const uint32_t PARTICLE_THRESHOLD = 1500;
+	const uint32_t COLOR_UPPER_BOUND = 1900;
+
+	std::vector<uint32_t> make_sums(uint32_t resolution){
+		const uint32_t dim_x = 3 * resolution;
+		const uint32_t dim_y = resolution;
+		const uint32_t dim_z = 3 * resolution;
+		const float unit = 1.f / resolution;
+		const float pi = 3.14159265f;
+
+		std::vector<uint32_t> sums(static_cast<size_t>(dim_x) * dim_y * dim_z);
+		std::mt19937 rng(42);
+		std::uniform_int_distribution<uint32_t> air(0, PARTICLE_THRESHOLD);
+
+		for(uint32_t z = 0; z < dim_z; z++) {
+			for(uint32_t y = 0; y < dim_y; y++) {
+				for(uint32_t x = 0; x < dim_x; x++) {
+					float surface = 0.5f + 0.2f * std::sin(2.f * pi * x * unit / 3.f) * std::cos(2.f * pi * z * unit / 3.f);
+					size_t i = (static_cast<size_t>(z) * dim_y + y) * dim_x + x;
+
+					if(y * unit < surface) {
+						sums[i] = PARTICLE_THRESHOLD + 1 + static_cast<uint32_t>((COLOR_UPPER_BOUND - PARTICLE_THRESHOLD) * (surface - y * unit) / surface);
+					} else {
+						sums[i] = air(rng);
+					}
+				}
+			}
+		}
+		return sums;
+	}
+
+	template<class F>
+	double time_median(uint64_t reps, F&& fn){
+		std::vector<double> samples;
+		samples.reserve(reps);
+
+		for(uint64_t r = 0; r < reps; r++) {
+			auto start = std::chrono::steady_clock::now();
+			fn();
+			samples.push_back(seconds_since(start));
+		}
+		return median(samples);
+	}
+
+	bool same_points(const float4* a, const float4* b, size_t count){
+		return std::memcmp(a, b, count * sizeof(float4)) == 0;
+	}
+
+	//the points in an order that doesn't depend on the one they were emitted in
+	std::vector<float4> sorted(const float4* points, size_t count){
+		std::vector<float4> result(points, points + count);
+		std::sort(result.begin(), result.end(), [](const float4& a, const float4& b) { return std::memcmp(&a, &b, sizeof(float4)) < 0; });
+		return result;
+	}
+}
+
+int run_emission_benchmark(const benchmark_arguments& args){
+	uint64_t resolution = args.get_count("resolution", 30);
+	uint64_t points_per_lattice = args.get_count("points", 8);
+	uint64_t reps = std::max<uint64_t>(1, args.get_count("reps", 20));
+
+	if(resolution == 0 || resolution > 512) {
+		throw std::runtime_error("the resolution has to be in [1, 512]");
+	}
+
+	thread_pool pool(static_cast<unsigned>(args.get_count("threads", 0)));
+
+	const uint32_t dim = static_cast<uint32_t>(resolution);
+	const point_emitter emitter(3 * dim, dim, 3 * dim, 1.f / dim, static_cast<uint32_t>(points_per_lattice), PARTICLE_THRESHOLD);
+	const std::vector<uint32_t> sums = make_sums(dim);
+	const uint32_t lattice_count = emitter.lattice_count();
+	const uint32_t per_lattice = emitter.points_per_lattice();
+
+	std::vector<float4> reference(emitter.max_points());
+	std::vector<float4> compacted(emitter.max_points());
+	std::vector<float4> appended(emitter.max_points());
+	std::vector<float4> previous(emitter.max_points());
+
+	size_t emitted = 0;
+	double serial = time_median(reps, [&]() {
+		emitted = 0;
+		for(uint32_t i = 0; i < lattice_count; i++) {
+			if(sums[i] > PARTICLE_THRESHOLD) {
+				emitter.lattice_points(i, sums[i], reference.data() + emitted);
+				emitted += per_lattice;
+			}
+		}
+	});
+
+	size_t compacted_count = 0;
+	double compaction = time_median(reps, [&]() { compacted_count = emitter.emit(pool, sums.data(), compacted.data()); });
+
+	if(compacted_count != emitted || !same_points(compacted.data(), reference.data(), emitted)) {
+		throw std::runtime_error("the compaction differs from the serial emission");
+	}
+
+	//as point_buffer.Append: every lattice point above the threshold reserves its points with an increment of the shared counter
+	std::atomic<size_t> counter(0);
+	uint64_t reordered = 0;
+	bool first = true;
+
+	double atomic = time_median(reps, [&]() {
+		counter.store(0, std::memory_order_relaxed);
+
+		pool.parallel_for(lattice_count, 1024, [&](size_t begin, size_t end, unsigned) {
+			for(size_t i = begin; i < end; i++) {
+				if(sums[i] > PARTICLE_THRESHOLD) {
+					size_t slot = counter.fetch_add(per_lattice, std::memory_order_relaxed);
+					emitter.lattice_points(static_cast<uint32_t>(i), sums[i], appended.data() + slot);
+				}
+			}
+		});
+
+		if(!first && !same_points(appended.data(), previous.data(), emitted)) {
+			reordered++;
+		}
+		std::copy_n(appended.data(), emitted, previous.data());
+		first = false;
+	});
+
+	if(counter.load() != emitted || !same_points(sorted(appended.data(), emitted).data(), sorted(reference.data(), emitted).data(), emitted)) {
+		throw std::runtime_error("the atomic emission differs from the serial emission");
+	}
+
+	printf("%u x %u x %u lattice points, %u points each, %zu points emitted, %u threads\n", 3 * dim, dim, 3 * dim, per_lattice, emitted, pool.size());
+	printf("  %-12s %10s %14s %10s\n", "emission", "ms", "M points/s", "speedup");
+	printf("  %-12s %10.3f %14.1f %10.2f\n", "serial", serial * 1e3, emitted / serial * 1e-6, 1.0);
+	printf("  %-12s %10.3f %14.1f %10.2f\n", "compaction", compaction * 1e3, emitted / compaction * 1e-6, serial / compaction);
+	printf("  %-12s %10.3f %14.1f %10.2f\n", "atomic", atomic * 1e3, emitted / atomic * 1e-6, serial / atomic);
+	printf("the atomic emission changed its order in %llu of %llu repetitions\n", static_cast<unsigned long long>(reordered),
+		static_cast<unsigned long long>(reps - 1));
+
+	return 0;
+}
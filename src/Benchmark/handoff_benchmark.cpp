@@ -0,0 +1,240 @@
+#include "benchmark.h"
+#include "src/Simulation2/cpu/cpu_engine.h"
+#include "src/Simulation2/cpu/sprite_rasterizer.h"
+#include "src/Simulation2/frame_constants.h"
+#include "src/Simulation2/trajectory_writer.h"
+#include "src/Utility/snapshot_ring.h"
+#include "src/Utility/timeline.h"
+#include "src/Utility/tracer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+//options:
+//	--count <n>						particles, in the initial cube of the engine (default 16K)
+//	--steps <n>						solver steps (default 50)
+//	--threads <n>					threads of the solver, 0 uses every hardware thread (default)
+//	--width <w>, --height <h>		frames of the render consumer (default 1280 x 720)
+//	--mutex							hands the state over under one mutex the consumers hold while they use it, like Simulation2 does
+//	--trajectory <path>				adds a consumer that records the snapshots with trajectory_writer
+//	--trace <path>					writes a Chrome trace of all threads to path
+//
+//the solver steps a cpu_engine and publishes the positions after every step, the consumers run on threads of their own:
+//	render:		draws the newest snapshot with sprite_rasterizer, single threaded
+//	analytics:	mean height and bounds of the newest snapshot
+//	writer:		hands the newest snapshot to trajectory_writer
+//the consumers sleep on a timeline of the published steps until there is something new.
+//reported are the time the solver spends handing over the state, and how many snapshots each consumer took and skipped.
+
+namespace {
+	struct snapshot {
+		uint64_t step;
+		std::vector<float3> positions;
+	};
+
+	//the handoff of Simulation2 on the CPU: a single snapshot that the solver and the consumers take turns on
+	struct locked_snapshot {
+		std::mutex mutex;
+		snapshot state;
+		uint64_t sequence;
+	};
+
+	struct consumer_statistics {
+		const char* name;
+		uint64_t taken;
+		uint64_t skipped;
+		double busy_seconds;
+	};
+}
+
+int run_handoff_benchmark(const benchmark_arguments& args){
+	uint64_t count = args.get_count("count", 16 * 1024);
+	uint64_t steps = std::max<uint64_t>(1, args.get_count("steps", 50));
+	uint64_t width = args.get_count("width", 1280);
+	uint64_t height = args.get_count("height", 720);
+
+	if(count == 0 || count > 0xFFFFFFFF) {
+		throw std::runtime_error("particle counts have to be in [1, 2^32)");
+	}
+	if(width == 0 || height == 0 || width > 16384 || height > 16384) {
+		throw std::runtime_error("the frame has to be between 1 and 16384 pixels wide and high");
+	}
+
+	const bool locked = args.has("mutex");
+	const std::string trajectory_path = args.get("trajectory", "");
+
+	simulation_parameters params = simulation_parameters::from_frame_constants();
+
+	float scale = std::max(1.f, std::cbrt(static_cast<float>(count) / frame_constants::PARTICLE_COUNT));
+
+	params.particle_count = static_cast<uint32_t>(count);
+	for(int i = 0; i < 3; i++) {
+		params.boundary[i] *= scale;
+	}
+
+	thread_pool solver_pool(static_cast<unsigned>(args.get_count("threads", 0)));
+	thread_pool render_pool(1);
+
+	cpu_engine engine(params, solver_pool);
+	engine.load_initial_cube();
+
+	sprite_rasterizer rasterizer(static_cast<uint32_t>(width), static_cast<uint32_t>(height), render_pool);
+	rasterizer.set_mvp(sprite_rasterizer::simulation2_mvp(params.boundary, static_cast<float>(width) / height));
+
+	std::unique_ptr<trajectory_writer> trajectory;
+	if(!trajectory_path.empty()) {
+		const float domain_min[3] = {0.f, 0.f, 0.f};
+		trajectory = std::make_unique<trajectory_writer>(trajectory_path, params.particle_count, domain_min, params.boundary);
+	}
+
+	float analytics_result[3] = {0.f, 0.f, 0.f};
+
+	//what the consumers do with a snapshot
+	std::vector<consumer_statistics> consumers;
+	std::vector<std::function<void(const snapshot&)>> work;
+
+	consumers.push_back({"render", 0, 0, 0.0});
+	work.push_back([&](const snapshot& s) {
+		rasterizer.render(s.positions.data(), s.positions.size());
+	});
+
+	consumers.push_back({"analytics", 0, 0, 0.0});
+	work.push_back([&](const snapshot& s) {
+		double height_sum = 0.0;
+		float low = s.positions[0].y;
+		float high = s.positions[0].y;
+
+		for(const float3& p : s.positions) {
+			height_sum += p.y;
+			low = std::min(low, p.y);
+			high = std::max(high, p.y);
+		}
+		analytics_result[0] = static_cast<float>(height_sum / s.positions.size());
+		analytics_result[1] = low;
+		analytics_result[2] = high;
+	});
+
+	if(trajectory) {
+		consumers.push_back({"writer", 0, 0, 0.0});
+		work.push_back([&](const snapshot& s) {
+			trajectory->submit(s.step, &s.positions[0].x);
+		});
+	}
+
+	snapshot initial = {0, std::vector<float3>(count)};
+	snapshot_ring<snapshot> ring(static_cast<uint32_t>(consumers.size()), initial);
+
+	locked_snapshot shared;
+	shared.state = initial;
+	shared.sequence = 0;
+
+	std::string trace_path = args.get("trace", "");
+	if(!trace_path.empty()) {
+		tracer::instance().start(1 << 20);
+		tracer::instance().set_thread_name("solver");
+	}
+
+	timeline published;
+	std::vector<std::thread> threads;
+
+	for(size_t c = 0; c < consumers.size(); c++) {
+		threads.emplace_back([&, c]() {
+			tracer::instance().set_thread_name(consumers[c].name);
+
+			consumer_statistics& stats = consumers[c];
+			uint64_t last = 0;
+
+			auto take = [&](const snapshot& s, uint64_t sequence) {
+				TRACE_SCOPE("consume");
+				auto start = std::chrono::steady_clock::now();
+
+				work[c](s);
+
+				stats.busy_seconds += seconds_since(start);
+				stats.skipped += sequence - last - 1;
+				stats.taken++;
+				last = sequence;
+			};
+
+			//every consumer ends on the last step, so they all see the same final state
+			while(last < steps) {
+				published.wait(last + 1);
+
+				if(locked) {
+					std::lock_guard<std::mutex> lock(shared.mutex);
+					take(shared.state, shared.sequence);
+				} else {
+					snapshot_ring<snapshot>::view newest = ring.acquire();
+					take(*newest, newest.sequence());
+				}
+			}
+		});
+	}
+
+	std::vector<double> handoff_samples;
+	auto solver_start = std::chrono::steady_clock::now();
+
+	for(uint64_t step = 1; step <= steps; step++) {
+		engine.step();
+
+		TRACE_SCOPE("publish");
+		auto start = std::chrono::steady_clock::now();
+
+		if(locked) {
+			std::lock_guard<std::mutex> lock(shared.mutex);
+			shared.state.step = step;
+			std::copy(engine.positions().begin(), engine.positions().end(), shared.state.positions.begin());
+			shared.sequence++;
+		} else {
+			snapshot& s = ring.write_slot();
+			s.step = step;
+			std::copy(engine.positions().begin(), engine.positions().end(), s.positions.begin());
+			ring.publish();
+		}
+		handoff_samples.push_back(seconds_since(start));
+
+		//outside of the measurement: with fewer cores than threads, a woken consumer can take over the core right here
+		published.advance();
+	}
+
+	double solver_seconds = seconds_since(solver_start);
+
+	for(std::thread& t : threads) {
+		t.join();
+	}
+
+	if(trajectory) {
+		trajectory->flush();
+	}
+
+	if(!trace_path.empty()) {
+		tracer::instance().stop();
+		tracer::instance().write_chrome_trace(trace_path);
+	}
+
+	double handoff_total = 0.0;
+	double handoff_max = 0.0;
+	for(double sample : handoff_samples) {
+		handoff_total += sample;
+		handoff_max = std::max(handoff_max, sample);
+	}
+
+	printf("%u particles, %u solver threads, %llu steps, %s\n", params.particle_count, solver_pool.size(), static_cast<unsigned long long>(steps),
+		locked ? "mutex handoff" : "snapshot ring");
+	printf("  solver: %.3f ms per step, handoff %.3f ms median, %.3f ms max, %.1f%% of the solver time\n", solver_seconds * 1e3 / steps,
+		median(handoff_samples) * 1e3, handoff_max * 1e3, handoff_total * 100.0 / solver_seconds);
+
+	for(const consumer_statistics& stats : consumers) {
+		printf("  %-10s %llu snapshots taken, %llu skipped, %.3f ms each\n", stats.name, static_cast<unsigned long long>(stats.taken),
+			static_cast<unsigned long long>(stats.skipped), stats.taken > 0 ? stats.busy_seconds * 1e3 / stats.taken : 0.0);
+	}
+	printf("  final mean height %.4f in [%.4f, %.4f]\n", analytics_result[0], analytics_result[1], analytics_result[2]);
+
+	return 0;
+}
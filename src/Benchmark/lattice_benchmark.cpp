@@ -0,0 +1,214 @@
+#include "benchmark.h"
+#include "src/Simulation1/cpu/lattice_engine.h"
+#include "src/Utility/tracer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+
+//options:
+//	--resolution <n>				lattice points per unit, the lattice is 3 x 1 x 3 units as in Simulation1 (default 30)
+//	--steps <n>, --warmup <n>		measured and unmeasured steps (default 20 and 2)
+//	--threads <n>					0 uses every hardware thread (default)
+//	--bits <n>						bits per direction (default 16 as in Simulation1)
+//	--update two_pass|fused|both	lattice_update of the engine (default both)
+//	--verify						runs the same steps again on one thread and compares the lattices,
+//									with both updates it also compares their particle counts after every step
+//	--trace <path>					writes a Chrome trace of the measured steps to path
+//
+//the lattice starts with the cube of Simulation1 and runs with its constants, scaled to the resolution.
+//MLUPS are the million lattice point updates per second of a pass, for a whole step it is the one of the whole update.
+//GB/s is computed from the lattice buffers a pass reads and writes once: two_pass reads and writes the lattice in both of its passes,
+//fused once per step. both also write the particle counts of the lattice points, emit reads them and writes the points.
+
+namespace {
+	struct run_result {
+		double collide;
+		double stream;
+		double step;
+		double emit;
+		size_t emitted;
+		//particles after the last stream
+		uint64_t particles;
+		uint64_t hash;
+		size_t lattice_bytes;
+	};
+
+	lattice_parameters scaled_parameters(uint32_t resolution, uint32_t bits){
+		lattice_parameters params = lattice_parameters::from_simulation1();
+
+		params.dim[0] = 3 * resolution;
+		params.dim[1] = resolution;
+		params.dim[2] = 3 * resolution;
+		params.unit_length = 1.f / resolution;
+
+		//the 19 directions rounded up to whole words, 40 bytes for 16 bits as in Simulation1
+		params.bits_per_direction = bits;
+		params.bytes_per_lattice_point = (lattice_engine::DIRECTIONS * bits + 31) / 32 * 4;
+
+		return params;
+	}
+
+	template<class F>
+	void time_pass(std::vector<double>& samples, F&& fn){
+		auto start = std::chrono::steady_clock::now();
+		fn();
+		samples.push_back(seconds_since(start));
+	}
+
+	//the particle counts after every step go to sums if it isn't null
+	run_result run(const lattice_parameters& params, thread_pool& pool, lattice_update update, uint64_t warmup, uint64_t steps,
+		std::vector<std::vector<uint32_t>>* sums){
+		lattice_engine engine(params, pool, update);
+		engine.load_initial_cube();
+
+		std::vector<float4> points(engine.max_points());
+
+		for(uint64_t s = 0; s < warmup; s++) {
+			engine.step();
+			if(sums) {
+				sums->push_back(engine.sums());
+			}
+		}
+
+		std::vector<double> collide;
+		std::vector<double> stream;
+		std::vector<double> step;
+		std::vector<double> emit;
+		run_result result = {};
+
+		for(uint64_t s = 0; s < steps; s++) {
+			TRACE_SCOPE(update == lattice_update::fused ? "fused" : "two_pass");
+
+			if(update == lattice_update::fused) {
+				time_pass(step, [&]() { engine.step(); });
+			} else {
+				time_pass(collide, [&]() { engine.collide(); });
+				time_pass(stream, [&]() { engine.stream(); });
+				step.push_back(collide.back() + stream.back());
+			}
+			time_pass(emit, [&]() { result.emitted = engine.emit_points(points.data()); });
+
+			if(sums) {
+				sums->push_back(engine.sums());
+			}
+		}
+
+		result.collide = collide.empty() ? 0.0 : median(collide);
+		result.stream = stream.empty() ? 0.0 : median(stream);
+		result.step = median(step);
+		result.emit = median(emit);
+		//the stored particles of fused are the collided ones, which clamping can change, so both report the ones after the last stream
+		for(uint32_t sum : engine.sums()) {
+			result.particles += sum;
+		}
+		result.hash = engine.state_hash();
+		result.lattice_bytes = static_cast<size_t>(engine.lattice_count()) * params.bytes_per_lattice_point * (update == lattice_update::fused ? 1 : 2);
+
+		return result;
+	}
+
+	const char* update_name(lattice_update update){
+		return update == lattice_update::fused ? "fused" : "two_pass";
+	}
+}
+
+int run_lattice_benchmark(const benchmark_arguments& args){
+	uint64_t resolution = args.get_count("resolution", 30);
+	uint64_t steps = std::max<uint64_t>(1, args.get_count("steps", 20));
+	uint64_t warmup = args.get_count("warmup", 2);
+	uint64_t bits = args.get_count("bits", 16);
+	std::string update_arg = args.get("update", "both");
+	std::string trace_path = args.get("trace", "");
+	bool verify = args.has("verify");
+
+	if(resolution < 3 || resolution > 512) {
+		throw std::runtime_error("the resolution has to be in [3, 512]");
+	}
+	if(bits == 0 || bits > lattice_engine::MAX_BITS_PER_DIRECTION) {
+		throw std::runtime_error("a direction has to have between 1 and 16 bits");
+	}
+
+	std::vector<lattice_update> updates;
+	if(update_arg == "two_pass" || update_arg == "both") {
+		updates.push_back(lattice_update::two_pass);
+	}
+	if(update_arg == "fused" || update_arg == "both") {
+		updates.push_back(lattice_update::fused);
+	}
+	if(updates.empty()) {
+		throw std::runtime_error("unknown update " + update_arg);
+	}
+
+	thread_pool pool(static_cast<unsigned>(args.get_count("threads", 0)));
+	const lattice_parameters params = scaled_parameters(static_cast<uint32_t>(resolution), static_cast<uint32_t>(bits));
+	const double lattice_count = static_cast<double>(params.dim[0]) * params.dim[1] * params.dim[2];
+	const double lattice_bytes = lattice_count * params.bytes_per_lattice_point;
+
+	if(!trace_path.empty()) {
+		tracer::instance().start(1 << 20);
+	}
+
+	std::vector<run_result> results;
+	std::vector<std::vector<std::vector<uint32_t>>> sums(updates.size());
+
+	for(size_t u = 0; u < updates.size(); u++) {
+		results.push_back(run(params, pool, updates[u], warmup, steps, verify && updates.size() > 1 ? &sums[u] : nullptr));
+	}
+
+	if(!trace_path.empty()) {
+		tracer::instance().stop();
+		tracer::instance().write_chrome_trace(trace_path);
+	}
+
+	printf("%u x %u x %u lattice points, %llu bits per direction, %u bytes per lattice point, %u threads\n", params.dim[0], params.dim[1], params.dim[2],
+		static_cast<unsigned long long>(bits), params.bytes_per_lattice_point, pool.size());
+	printf("  %-18s %10s %10s %10s\n", "pass", "ms", "MLUPS", "GB/s");
+
+	auto print_row = [&](const char* name, double seconds, double bytes) {
+		printf("  %-18s %10.3f %10.1f %10.2f\n", name, seconds * 1e3, lattice_count / seconds * 1e-6, bytes / seconds * 1e-9);
+	};
+
+	for(size_t u = 0; u < updates.size(); u++) {
+		const run_result& r = results[u];
+
+		if(updates[u] == lattice_update::two_pass) {
+			print_row("two_pass collide", r.collide, 2 * lattice_bytes);
+			print_row("two_pass stream", r.stream, 2 * lattice_bytes + lattice_count * 4);
+			print_row("two_pass step", r.step, 4 * lattice_bytes + lattice_count * 4);
+		} else {
+			print_row("fused step", r.step, 2 * lattice_bytes + lattice_count * 4);
+		}
+	}
+	printf("  %-18s %10.3f %10s %10.2f\n", "emit", results[0].emit * 1e3, "", (lattice_count * 4 + results[0].emitted * sizeof(float4)) / results[0].emit * 1e-9);
+
+	for(size_t u = 0; u < updates.size(); u++) {
+		const run_result& r = results[u];
+
+		printf("%-8s %.1f MB of lattice buffers, %zu points emitted, %llu particles, state hash %016llx\n", update_name(updates[u]), r.lattice_bytes / 1048576.0,
+			r.emitted, static_cast<unsigned long long>(r.particles), static_cast<unsigned long long>(r.hash));
+	}
+	if(updates.size() > 1) {
+		printf("fused steps are %.2fx as fast as two_pass steps\n", results[0].step / results[1].step);
+	}
+
+	if(verify) {
+		thread_pool single(1);
+
+		for(size_t u = 0; u < updates.size(); u++) {
+			if(run(params, single, updates[u], warmup, steps, nullptr).hash != results[u].hash) {
+				throw std::runtime_error(std::string("the ") + update_name(updates[u]) + " lattice differs from the one computed on one thread");
+			}
+		}
+		printf("the lattices match the ones computed on one thread\n");
+
+		if(updates.size() > 1) {
+			if(sums[0] != sums[1]) {
+				throw std::runtime_error("the particle counts of fused differ from the ones of two_pass");
+			}
+			printf("fused and two_pass have the same particle counts after every step\n");
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,274 @@
+#include "benchmark.h"
+#include "src/Utility/parallel_primitives.h"
+#include "src/Utility/step_arena.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+//options:
+//	--count <n>						elements per primitive (default 16M)
+//	--threads <n>					0 uses every hardware thread (default)
+//	--reps <n>						timed runs per primitive, the median is reported (default 10)
+//	--keep <percent>				elements compact keeps (default 50)
+//	--bins <n>						bins of the histogram and the counting sort (default 256)
+//	--segment <n>					mean segment length of segmented_reduce (default 64)
+//
+//every primitive runs on random input next to a plain serial loop that computes the same thing.
+//the results are compared with the serial ones, bitwise except for the double scan, whose blocks add up in another order.
+//GB/s is computed from the bytes a primitive has to stream at least once: its input, its output and the segment offsets.
+
+namespace {
+	struct row {
+		const char* name;
+		double seconds;
+		double serial_seconds;
+		double bytes;
+	};
+
+	template<class F>
+	double time_median(uint64_t reps, F&& fn){
+		std::vector<double> samples;
+		samples.reserve(reps);
+
+		for(uint64_t r = 0; r < reps; r++) {
+			auto start = std::chrono::steady_clock::now();
+			fn();
+			samples.push_back(seconds_since(start));
+		}
+		return median(samples);
+	}
+
+	template<typename T>
+	void expect_equal(const std::vector<T>& result, const std::vector<T>& reference, const char* name){
+		if(result != reference) {
+			throw std::runtime_error(std::string(name) + " differs from the serial loop");
+		}
+	}
+}
+
+int run_primitives_benchmark(const benchmark_arguments& args){
+	uint64_t count = args.get_count("count", 16 * 1024 * 1024);
+	uint64_t reps = std::max<uint64_t>(1, args.get_count("reps", 10));
+	uint64_t keep_percent = args.get_count("keep", 50);
+	uint64_t bin_count = args.get_count("bins", 256);
+	uint64_t mean_segment = args.get_count("segment", 64);
+
+	if(count == 0 || count > 0xFFFFFFFF) {
+		throw std::runtime_error("the element count has to be in [1, 2^32)");
+	}
+	if(keep_percent > 100 || bin_count == 0 || mean_segment == 0) {
+		throw std::runtime_error("--keep has to be at most 100, --bins and --segment at least 1");
+	}
+
+	thread_pool pool(static_cast<unsigned>(args.get_count("threads", 0)));
+	step_arena scratch;
+
+	std::mt19937 rng(42);
+	std::uniform_int_distribution<uint32_t> small(0, 15);
+	std::uniform_int_distribution<uint32_t> percent(0, 99);
+	std::uniform_int_distribution<uint32_t> bin(0, static_cast<uint32_t>(bin_count - 1));
+	std::uniform_int_distribution<uint32_t> segment_length(0, static_cast<uint32_t>(2 * mean_segment));
+	std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+	std::vector<uint32_t> values(count);
+	std::vector<uint32_t> keys(count);
+	std::vector<double> reals(count);
+	for(size_t i = 0; i < count; i++) {
+		values[i] = small(rng);
+		keys[i] = bin(rng);
+		reals[i] = unit(rng);
+	}
+
+	//the value stands in for the test of compact, so the pass rate follows --keep
+	const uint32_t threshold = static_cast<uint32_t>(keep_percent);
+	std::vector<uint32_t> scores(count);
+	for(size_t i = 0; i < count; i++) {
+		scores[i] = percent(rng);
+	}
+	auto keep = [threshold](uint32_t score) { return score < threshold; };
+
+	std::vector<uint32_t> offsets(1, 0);
+	while(offsets.back() < count) {
+		offsets.push_back(static_cast<uint32_t>(std::min<uint64_t>(count, offsets.back() + segment_length(rng))));
+	}
+	size_t segments = offsets.size() - 1;
+
+	std::vector<row> rows;
+	std::vector<uint32_t> result(count);
+	std::vector<uint32_t> reference(count);
+
+	{
+		double serial = time_median(reps, [&]() {
+			uint32_t sum = 0;
+			for(size_t i = 0; i < count; i++) {
+				sum += values[i];
+				reference[i] = sum;
+			}
+		});
+		double parallel = time_median(reps, [&]() { parallel_primitives::inclusive_scan(pool, values.data(), result.data(), count); });
+
+		expect_equal(result, reference, "inclusive_scan");
+		rows.push_back({"inclusive_scan u32", parallel, serial, count * 8.0});
+	}
+
+	{
+		double serial = time_median(reps, [&]() {
+			uint32_t sum = 0;
+			for(size_t i = 0; i < count; i++) {
+				reference[i] = sum;
+				sum += values[i];
+			}
+		});
+		double parallel = time_median(reps, [&]() { parallel_primitives::exclusive_scan(pool, values.data(), result.data(), count); });
+
+		expect_equal(result, reference, "exclusive_scan");
+		rows.push_back({"exclusive_scan u32", parallel, serial, count * 8.0});
+	}
+
+	{
+		std::vector<double> real_result(count);
+		std::vector<double> real_reference(count);
+
+		double serial = time_median(reps, [&]() {
+			double sum = 0.0;
+			for(size_t i = 0; i < count; i++) {
+				real_reference[i] = sum;
+				sum += reals[i];
+			}
+		});
+		double parallel = time_median(reps, [&]() { parallel_primitives::exclusive_scan(pool, reals.data(), real_result.data(), count); });
+
+		for(size_t i = 0; i < count; i++) {
+			if(std::abs(real_result[i] - real_reference[i]) > 1e-9 * std::max(1.0, real_reference[i])) {
+				throw std::runtime_error("exclusive_scan of doubles differs from the serial loop");
+			}
+		}
+		rows.push_back({"exclusive_scan f64", parallel, serial, count * 16.0});
+	}
+
+	{
+		size_t kept = 0;
+		size_t serial_kept = 0;
+
+		double serial = time_median(reps, [&]() {
+			serial_kept = 0;
+			for(size_t i = 0; i < count; i++) {
+				if(keep(scores[i])) {
+					reference[serial_kept++] = scores[i];
+				}
+			}
+		});
+		double parallel = time_median(reps, [&]() { kept = parallel_primitives::compact(pool, scores.data(), count, keep, result.data()); });
+
+		if(kept != serial_kept || !std::equal(result.begin(), result.begin() + kept, reference.begin())) {
+			throw std::runtime_error("compact differs from the serial loop");
+		}
+		rows.push_back({"compact u32", parallel, serial, count * 4.0 + kept * 4.0});
+	}
+
+	{
+		std::vector<uint32_t> indices;
+		std::vector<uint32_t> serial_indices;
+		indices.reserve(count);
+		serial_indices.reserve(count);
+
+		double serial = time_median(reps, [&]() {
+			serial_indices.clear();
+			for(size_t i = 0; i < count; i++) {
+				if(keep(scores[i])) {
+					serial_indices.push_back(static_cast<uint32_t>(i));
+				}
+			}
+		});
+		double parallel = time_median(reps, [&]() {
+			parallel_primitives::compact_indices(pool, count, [&](size_t i) { return keep(scores[i]); }, indices);
+		});
+
+		expect_equal(indices, serial_indices, "compact_indices");
+		rows.push_back({"compact_indices", parallel, serial, count * 4.0 + indices.size() * 4.0});
+	}
+
+	{
+		std::vector<uint32_t> bins(bin_count);
+		std::vector<uint32_t> serial_bins(bin_count);
+
+		double serial = time_median(reps, [&]() {
+			std::fill(serial_bins.begin(), serial_bins.end(), 0);
+			for(size_t i = 0; i < count; i++) {
+				serial_bins[keys[i]]++;
+			}
+		});
+		double parallel = time_median(reps, [&]() {
+			parallel_primitives::histogram(pool, count, [&](size_t i) { return keys[i]; }, bins.data(), bin_count, scratch);
+		});
+
+		expect_equal(bins, serial_bins, "histogram");
+		rows.push_back({"histogram", parallel, serial, count * 4.0 + bin_count * 4.0});
+	}
+
+	{
+		std::vector<uint32_t> bin_offsets(bin_count + 1);
+		std::vector<uint32_t> serial_offsets(bin_count + 1);
+
+		double serial = time_median(reps, [&]() {
+			std::fill(serial_offsets.begin(), serial_offsets.end(), 0);
+			for(size_t i = 0; i < count; i++) {
+				serial_offsets[keys[i] + 1]++;
+			}
+			for(size_t b = 0; b < bin_count; b++) {
+				serial_offsets[b + 1] += serial_offsets[b];
+			}
+			for(size_t i = 0; i < count; i++) {
+				reference[serial_offsets[keys[i]]++] = static_cast<uint32_t>(i);
+			}
+		});
+		double parallel = time_median(reps, [&]() {
+			parallel_primitives::counting_sort(pool, count, bin_count,
+				[&](size_t i, auto&& add) { add(keys[i]); },
+				[&](size_t b, uint32_t start, uint32_t, unsigned) { bin_offsets[b] = start; },
+				[&](size_t total) { bin_offsets[bin_count] = static_cast<uint32_t>(total); },
+				[&](size_t i, uint32_t position) { result[position] = static_cast<uint32_t>(i); },
+				scratch);
+		});
+
+		expect_equal(result, reference, "counting_sort");
+		rows.push_back({"counting_sort", parallel, serial, count * 8.0 + bin_count * 4.0});
+	}
+
+	{
+		std::vector<double> sums(segments);
+		std::vector<double> serial_sums(segments);
+
+		double serial = time_median(reps, [&]() {
+			for(size_t s = 0; s < segments; s++) {
+				double sum = 0.0;
+				for(uint32_t i = offsets[s]; i < offsets[s + 1]; i++) {
+					sum += reals[i];
+				}
+				serial_sums[s] = sum;
+			}
+		});
+		double parallel = time_median(reps, [&]() {
+			parallel_primitives::segmented_reduce(pool, reals.data(), offsets.data(), segments, sums.data());
+		});
+
+		expect_equal(sums, serial_sums, "segmented_reduce");
+		rows.push_back({"segmented_reduce", parallel, serial, count * 8.0 + segments * 12.0});
+	}
+
+	printf("%llu elements, %u threads, %llu%% kept, %llu bins, %zu segments\n", static_cast<unsigned long long>(count), pool.size(),
+		static_cast<unsigned long long>(keep_percent), static_cast<unsigned long long>(bin_count), segments);
+	printf("  %-20s %10s %10s %10s %10s %8s\n", "primitive", "ms", "serial ms", "G elem/s", "GB/s", "speedup");
+
+	for(const row& r : rows) {
+		printf("  %-20s %10.3f %10.3f %10.3f %10.2f %8.2f\n", r.name, r.seconds * 1e3, r.serial_seconds * 1e3, count / r.seconds * 1e-9,
+			r.bytes / r.seconds * 1e-9, r.serial_seconds / r.seconds);
+	}
+
+	return 0;
+}
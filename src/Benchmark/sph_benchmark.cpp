@@ -0,0 +1,384 @@
+#include "benchmark.h"
+#include "src/Simulation2/cpu/cpu_engine.h"
+#include "src/Simulation2/cpu/emulated_computation.h"
+#include "src/Simulation2/frame_constants.h"
+#include "src/Utility/tracer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <stdexcept>
+
+//options:
+//	--scene uniform|dam_break|settled_pool|all	(default all)
+//	--min <count>, --max <count>				particle counts, stepping by a factor of 4 (default 4K to 16M)
+//	--steps <n>, --warmup <n>					measured and unmeasured steps per run (default 10 and 2)
+//	--threads <n>								0 uses every hardware thread (default)
+//	--deterministic							runs the engine in execution_mode::deterministic
+//	--kernels analytic|tabulated				kernel_evaluation of the engine (default analytic)
+//	--forces full|half							force_evaluation of the engine, full_stencil or half_stencil (default full)
+//	--loops particle|cluster4|cluster8			neighbor_loop of the engine, per_particle or cluster_pairs_4/8 (default particle)
+//	--sort comparison|counting					cell_sort of the engine (default comparison)
+//	--periodic <axes>							wraps the named axes of the cpu engine, e.g. xz (default none)
+//	--engine cpu|emulated						cpu_engine (default) or the shader ports in emulated_computation,
+//												which loop over all particles, so keep --max small
+//	--trace <path>								writes a Chrome trace of all runs to path
+//
+//the box grows with the particle count, so every scene keeps the particle density of the default 4K setup
+//and the neighbor counts stay comparable between the rows.
+//
+//the engine keeps its buffers from step to step and they only grow when a step needs more room than any before,
+//so the heap allocations per step are 0 once the scene has settled, in every build. the exception are the cluster loops on dam_break:
+//the pair lists of the clusters grow while the column collapses and its clusters gain neighbors.
+//
+//GB/s is computed from the bytes a pass has to stream at least once: the particle data it reads and writes
+//and the cell table. neighbor reads are not counted, they mostly hit the cache.
+//a low value for density and force therefore means the pass is compute bound, not that memory is slow.
+
+namespace {
+	enum class scene {
+		uniform,
+		dam_break,
+		settled_pool,
+	};
+
+	const char* SCENE_NAMES[] = {"uniform", "dam_break", "settled_pool"};
+
+	enum pass {
+		CREATE_GRID,
+		SORT,
+		CREATE_TABLE,
+		DENSITY,
+		FORCE,
+		PASS_COUNT,
+	};
+
+	const char* PASS_NAMES[PASS_COUNT] = {"create_grid", "sort", "create_table", "density", "force"};
+
+	neighbor_loop neighbor_loop_from(const std::string& name){
+		if(name == "particle") {
+			return neighbor_loop::per_particle;
+		}
+		if(name == "cluster4") {
+			return neighbor_loop::cluster_pairs_4;
+		}
+		if(name == "cluster8") {
+			return neighbor_loop::cluster_pairs_8;
+		}
+		throw std::runtime_error("unknown neighbor loop '" + name + "'");
+	}
+
+	cell_sort cell_sort_from(const std::string& name){
+		if(name == "comparison") {
+			return cell_sort::comparison;
+		}
+		if(name == "counting") {
+			return cell_sort::counting;
+		}
+		throw std::runtime_error("unknown cell sort '" + name + "'");
+	}
+
+	//"xz" makes x and z periodic
+	void set_periodic(simulation_parameters& params, const std::string& axes){
+		for(char axis : axes) {
+			if(axis < 'x' || axis > 'z') {
+				throw std::runtime_error("unknown periodic axis '" + std::string(1, axis) + "'");
+			}
+			params.periodic[axis - 'x'] = true;
+		}
+	}
+
+	simulation_parameters parameters_for(uint32_t particle_count){
+		simulation_parameters params = simulation_parameters::from_frame_constants();
+
+		float scale = std::max(1.f, std::cbrt(static_cast<float>(particle_count) / frame_constants::PARTICLE_COUNT));
+
+		params.particle_count = particle_count;
+		for(int i = 0; i < 3; i++) {
+			params.boundary[i] *= scale;
+		}
+
+		return params;
+	}
+
+	//random positions in the whole box
+	template<class Engine>
+	void place_uniform(Engine& engine){
+		const simulation_parameters& params = engine.parameters();
+
+		std::mt19937 rng(42);
+		std::uniform_real_distribution<float> x(0.f, params.boundary[0]);
+		std::uniform_real_distribution<float> y(0.f, params.boundary[1]);
+		std::uniform_real_distribution<float> z(0.f, params.boundary[2]);
+
+		std::vector<float3> pos(params.particle_count);
+		std::vector<float3> vel(params.particle_count, make_float3(0.f, 0.f, 0.f));
+
+		for(float3& p : pos) {
+			p = make_float3(x(rng), y(rng), z(rng));
+		}
+
+		engine.set_state(pos.data(), vel.data());
+	}
+
+	//a column of water twice as high as wide in one corner of the box
+	template<class Engine>
+	void place_dam_break(Engine& engine){
+		const simulation_parameters& params = engine.parameters();
+		float diff = params.initial_displacement;
+
+		uint32_t side = static_cast<uint32_t>(std::ceil(std::cbrt(params.particle_count * 0.5f)));
+
+		std::vector<float3> pos(params.particle_count);
+		std::vector<float3> vel(params.particle_count, make_float3(0.f, 0.f, 0.f));
+
+		uint32_t i = 0;
+		for(uint32_t y = 0; y < 2 * side && i < params.particle_count; y++) {
+			for(uint32_t z = 0; z < side && i < params.particle_count; z++) {
+				for(uint32_t x = 0; x < side && i < params.particle_count; x++) {
+					pos[i++] = make_float3((x + 0.5f) * diff, (y + 0.5f) * diff, (z + 0.5f) * diff);
+				}
+			}
+		}
+
+		engine.set_state(pos.data(), vel.data());
+	}
+
+	template<class Engine>
+	void place(Engine& engine, scene s){
+		switch(s) {
+		case scene::uniform:
+			place_uniform(engine);
+			break;
+		case scene::dam_break:
+			place_dam_break(engine);
+			break;
+		case scene::settled_pool:
+			engine.load_initial_cube();
+			break;
+		}
+	}
+
+	//bytes each pass streams at least once, see the comment at the top
+	void bytes_per_pass(const cpu_engine& engine, unsigned threads, double bytes[PASS_COUNT]){
+		double n = engine.parameters().particle_count;
+		double merge_levels = std::ceil(std::log2(static_cast<double>(threads)));
+
+		//particle id and position read, cell id written
+		bytes[CREATE_GRID] = n * (4 + 12 + 4);
+		if(engine.get_cell_sort() == cell_sort::counting) {
+			double chunks = std::max(1.0, std::min<double>(threads, std::floor(n / 1024)));
+
+			//pairs read by the count and the scatter and written once, the counts of every chunk cleared, scanned and bumped,
+			//at most one table entry written per pair, then position and velocity gathered
+			bytes[SORT] = n * (8 + 16 + 12 + 4 + 24 + 24) + engine.grid_size_flat() * chunks * 4.0 * 4;
+			bytes[CREATE_TABLE] = 0.0;
+		} else {
+			//pairs read and written by the chunk sort and every merge level, then position and velocity gathered
+			bytes[SORT] = n * (16 * (1 + merge_levels) + 4 + 24 + 24);
+			//pairs read, at most one table entry written per pair
+			bytes[CREATE_TABLE] = n * (8 + 12);
+		}
+		//pair and sorted position read, density written in sorted and id order
+		bytes[DENSITY] = n * (8 + 12 + 4 + 4);
+		//sorted state read and new state written, then scattered back to id order
+		bytes[FORCE] = n * (8 + 12 + 12 + 4 + 12 + 12) + n * (4 + 24 + 24);
+	}
+
+	//runs steps steps pass by pass and adds the time of every pass to samples, returns the heap allocations the passes made
+	//after_pass(pass, step) is called outside of the measured time
+	template<class Engine, class F>
+	uint64_t time_passes(Engine& engine, uint64_t steps, std::vector<double> samples[PASS_COUNT], F&& after_pass){
+		void (Engine::*passes[PASS_COUNT])() = {
+			&Engine::create_grid,
+			&Engine::sort,
+			&Engine::create_table,
+			&Engine::evaluate_density,
+			&Engine::apply_forces,
+		};
+
+		for(int p = 0; p < PASS_COUNT; p++) {
+			samples[p].reserve(steps);
+		}
+
+		uint64_t allocations = 0;
+
+		for(uint64_t i = 0; i < steps; i++) {
+			for(int p = 0; p < PASS_COUNT; p++) {
+				uint64_t allocations_before = heap_allocations();
+				auto start = std::chrono::steady_clock::now();
+				(engine.*passes[p])();
+				samples[p].push_back(seconds_since(start));
+				allocations += heap_allocations() - allocations_before;
+
+				after_pass(p, i);
+			}
+		}
+		return allocations;
+	}
+
+	//bytes may be null, if there is no model for the engine
+	void print_passes(std::vector<double> samples[PASS_COUNT], uint32_t particle_count, const double* bytes){
+		printf("  %-14s %12s %14s %10s\n", "pass", "ms", "ns/particle", bytes ? "GB/s" : "");
+
+		double total = 0.0;
+		for(int p = 0; p < PASS_COUNT; p++) {
+			double seconds = median(samples[p]);
+			total += seconds;
+
+			printf("  %-14s %12.3f %14.2f", PASS_NAMES[p], seconds * 1e3, seconds * 1e9 / particle_count);
+			if(bytes) {
+				printf(" %10.2f", bytes[p] / seconds * 1e-9);
+			}
+			printf("\n");
+		}
+		printf("  %-14s %12.3f %14.2f\n", "step", total * 1e3, total * 1e9 / particle_count);
+	}
+
+	void run_cpu_engine(scene s, uint32_t particle_count, thread_pool& pool, const benchmark_arguments& args){
+		uint64_t steps = std::max<uint64_t>(1, args.get_count("steps", 10));
+		uint64_t warmup = args.get_count("warmup", 2);
+
+		simulation_parameters params = parameters_for(particle_count);
+		set_periodic(params, args.get("periodic", ""));
+
+		cpu_engine engine(params, pool);
+		engine.set_execution_mode(args.has("deterministic") ? execution_mode::deterministic : execution_mode::fast);
+		engine.set_kernel_evaluation(args.get("kernels", "analytic") == "tabulated" ? kernel_evaluation::tabulated : kernel_evaluation::analytic);
+		engine.set_force_evaluation(args.get("forces", "full") == "half" ? force_evaluation::half_stencil : force_evaluation::full_stencil);
+		engine.set_neighbor_loop(neighbor_loop_from(args.get("loops", "particle")));
+		engine.set_cell_sort(cell_sort_from(args.get("sort", "comparison")));
+		place(engine, s);
+
+		for(uint64_t i = 0; i < warmup; i++) {
+			engine.step();
+		}
+
+		std::vector<double> samples[PASS_COUNT];
+		uint64_t neighbor_pairs = 0;
+
+		uint64_t allocations = time_passes(engine, steps, samples, [&](int pass, uint64_t step) {
+			//the table is only valid until apply_forces moves the particles
+			if(pass == CREATE_TABLE && step + 1 == steps) {
+				neighbor_pairs = engine.count_neighbor_pairs();
+			}
+
+			if(pass == FORCE) {
+				PASS_COUNTER(engine.record_statistics());
+			}
+		});
+
+		double bytes[PASS_COUNT];
+		bytes_per_pass(engine, pool.size(), bytes);
+
+		printf("%s, %u particles, %u threads, %.1f neighbors/particle, %s kernels, %s stencil, %s loops, %s sort%s%s\n",
+			SCENE_NAMES[static_cast<int>(s)], particle_count, pool.size(), static_cast<double>(neighbor_pairs) / particle_count,
+			engine.get_kernel_evaluation() == kernel_evaluation::tabulated ? "tabulated" : "analytic",
+			engine.get_force_evaluation() == force_evaluation::half_stencil ? "half" : "full",
+			args.get("loops", "particle").c_str(), engine.get_cell_sort() == cell_sort::counting ? "counting" : "comparison", args.has("periodic") ? ", periodic " : "", args.get("periodic", "").c_str());
+		print_passes(samples, particle_count, bytes);
+		printf("  %.1f heap allocations per step%s\n", static_cast<double>(allocations) / steps,
+			allocations > 0 ? ", buffers growing past their largest step so far, see the top of sph_benchmark.cpp" : "");
+
+#ifdef ENABLE_PASS_STATISTICS
+		const step_statistics& stats = engine.last_statistics();
+
+		printf("  last step: %u occupied cells, %.1f mean / %u max neighbors, %llu collisions, %llu boundary clamps, %llu sort swaps\n",
+			stats.occupied_cells, stats.mean_neighbors, stats.max_neighbors, static_cast<unsigned long long>(stats.collisions_resolved),
+			static_cast<unsigned long long>(stats.boundary_clamps), static_cast<unsigned long long>(stats.sort_swaps));
+#endif
+		printf("\n");
+
+		fflush(stdout);
+	}
+
+	void run_emulated(scene s, uint32_t particle_count, thread_pool& pool, const benchmark_arguments& args){
+		uint64_t steps = std::max<uint64_t>(1, args.get_count("steps", 10));
+		uint64_t warmup = args.get_count("warmup", 2);
+
+		emulated_computation engine(parameters_for(particle_count), pool);
+		place(engine, s);
+
+		for(uint64_t i = 0; i < warmup; i++) {
+			engine.step();
+		}
+
+		std::vector<double> samples[PASS_COUNT];
+		time_passes(engine, steps, samples, [](int, uint64_t) {});
+
+		printf("%s, %u particles, %u threads, emulated shaders\n", SCENE_NAMES[static_cast<int>(s)], particle_count, pool.size());
+		print_passes(samples, particle_count, nullptr);
+		printf("\n");
+
+		fflush(stdout);
+	}
+}
+
+int run_sph_benchmark(const benchmark_arguments& args){
+	uint64_t min_count = args.get_count("min", 4 * 1024);
+	uint64_t max_count = args.get_count("max", 16 * 1024 * 1024);
+	std::string scene_name = args.get("scene", "all");
+	std::string engine_name = args.get("engine", "cpu");
+
+	if(engine_name != "cpu" && engine_name != "emulated") {
+		throw std::runtime_error("unknown engine '" + engine_name + "'");
+	}
+
+	std::string kernels_name = args.get("kernels", "analytic");
+	if(kernels_name != "analytic" && kernels_name != "tabulated") {
+		throw std::runtime_error("unknown kernel evaluation '" + kernels_name + "'");
+	}
+
+	neighbor_loop_from(args.get("loops", "particle"));
+
+	simulation_parameters periodic_check = simulation_parameters::from_frame_constants();
+	set_periodic(periodic_check, args.get("periodic", ""));
+	if(engine_name == "emulated" && args.has("periodic")) {
+		throw std::runtime_error("the emulated shaders only know walls, --periodic needs --engine cpu");
+	}
+
+	std::string forces_name = args.get("forces", "full");
+	if(forces_name != "full" && forces_name != "half") {
+		throw std::runtime_error("unknown force evaluation '" + forces_name + "'");
+	}
+
+	if(min_count == 0 || max_count > 0xFFFFFFFF) {
+		throw std::runtime_error("particle counts have to be in [1, 2^32)");
+	}
+
+	std::vector<scene> scenes;
+	for(int i = 0; i < 3; i++) {
+		if(scene_name == "all" || scene_name == SCENE_NAMES[i]) {
+			scenes.push_back(static_cast<scene>(i));
+		}
+	}
+
+	if(scenes.empty()) {
+		throw std::runtime_error("unknown scene '" + scene_name + "'");
+	}
+
+	std::string trace_path = args.get("trace", "");
+	if(!trace_path.empty()) {
+		tracer::instance().start(1 << 20);
+	}
+
+	thread_pool pool(static_cast<unsigned>(args.get_count("threads", 0)));
+
+	for(scene s : scenes) {
+		for(uint64_t count = min_count; count <= max_count; count *= 4) {
+			if(engine_name == "cpu") {
+				run_cpu_engine(s, static_cast<uint32_t>(count), pool, args);
+			} else {
+				run_emulated(s, static_cast<uint32_t>(count), pool, args);
+			}
+		}
+	}
+
+	if(!trace_path.empty()) {
+		tracer::instance().stop();
+		tracer::instance().write_chrome_trace(trace_path);
+	}
+
+	return 0;
+}
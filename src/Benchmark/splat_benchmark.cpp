@@ -0,0 +1,148 @@
+#include "benchmark.h"
+#include "src/Simulation1/cpu/splat_renderer.h"
+#include "src/Utility/image_writer.h"
+#include "src/Utility/particle_lod.h"
+#include "src/Utility/tracer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+
+//options:
+//	--resolution <n>				lattice points per unit, the lattice is 3 x 1 x 3 units as in Simulation1 (default 30)
+//	--width <w>, --height <h>		size of the frame (default 1920 x 1080)
+//	--repeat <n>					measured frames (default 10)
+//	--threads <n>					0 uses every hardware thread (default)
+//	--gradient						colors the liquid by particle count instead of uniformly
+//	--no-ground						leaves out the chessboard ground
+//	--lod <pixels>					merges the points of cells that project to at most this many pixels, see particle_lod
+//	--lod-cell <n>					lattice points along each edge of those cells (default 4)
+//	--image <path>					writes the last frame as PPM
+//	--trace <path>					writes a Chrome trace of the frames to path
+//
+//the points are a wavy pool of liquid filling about half of the lattice, with 8 points per lattice point as the compute shader appends them.
+//the particle count of a point grows with its depth below the surface, from the threshold up to the upper bound of the gradient.
+
+namespace {
+	const uint32_t PARTICLE_THRESHOLD = 1500;
+	const uint32_t COLOR_UPPER_BOUND = 1900;
+
+	std::vector<float4> make_pool(uint32_t resolution){
+		std::vector<float4> points;
+
+		const float unit = 1.f / resolution;
+		const float offset = unit * 0.25f;
+		const float pi = 3.14159265f;
+
+		for(uint32_t z = 0; z < 3 * resolution; z++) {
+			for(uint32_t x = 0; x < 3 * resolution; x++) {
+				float surface = 0.5f + 0.2f * std::sin(2.f * pi * x * unit / 3.f) * std::cos(2.f * pi * z * unit / 3.f);
+
+				for(uint32_t y = 0; y < resolution && y * unit < surface; y++) {
+					float particles = PARTICLE_THRESHOLD + (COLOR_UPPER_BOUND - PARTICLE_THRESHOLD) * std::min(1.f, (surface - y * unit) / surface);
+
+					for(int i = 0; i < 8; i++) {
+						points.push_back(make_float4(
+							x * unit + (i & 1 ? offset : -offset),
+							y * unit + (i & 2 ? offset : -offset),
+							z * unit + (i & 4 ? offset : -offset),
+							particles));
+					}
+				}
+			}
+		}
+		return points;
+	}
+}
+
+int run_splat_benchmark(const benchmark_arguments& args){
+	uint64_t resolution = args.get_count("resolution", 30);
+	uint64_t width = args.get_count("width", 1920);
+	uint64_t height = args.get_count("height", 1080);
+	uint64_t repeat = std::max<uint64_t>(1, args.get_count("repeat", 10));
+
+	if(resolution == 0 || resolution > 1024) {
+		throw std::runtime_error("the resolution has to be in [1, 1024]");
+	}
+	if(width == 0 || height == 0 || width > 16384 || height > 16384) {
+		throw std::runtime_error("the frame has to be between 1 and 16384 pixels wide and high");
+	}
+
+	uint64_t lod_cell = args.get_count("lod-cell", 4);
+	if(lod_cell == 0 || lod_cell > resolution) {
+		throw std::runtime_error("the lod cells have to be between 1 and resolution lattice points long");
+	}
+
+	splat_parameters params = splat_parameters::from_simulation1(static_cast<float>(width) / height);
+	params.radius = 1.f / resolution;
+	params.ground = !args.has("no-ground");
+	if(args.has("gradient")) {
+		params.particle_threshold = PARTICLE_THRESHOLD;
+		params.color_upper_bound = COLOR_UPPER_BOUND;
+	}
+
+	std::vector<float4> points = make_pool(static_cast<uint32_t>(resolution));
+
+	thread_pool pool(static_cast<unsigned>(args.get_count("threads", 0)));
+	splat_renderer renderer(static_cast<uint32_t>(width), static_cast<uint32_t>(height), params, pool);
+
+	//the lattice is 3 x 1 x 3 units, the points around its outermost lattice points count to the edge cells
+	uint32_t cells_per_unit = static_cast<uint32_t>((resolution + lod_cell - 1) / lod_cell);
+	uint32_t lod_grid[3] = {3 * cells_per_unit, cells_per_unit, 3 * cells_per_unit};
+	float lod_cell_size[3] = {1.f * lod_cell / resolution, 1.f * lod_cell / resolution, 1.f * lod_cell / resolution};
+
+	bool lod = args.has("lod");
+	particle_lod merger(lod_grid, lod_cell_size, pool);
+
+	lod_settings settings;
+	settings.mvp = params.world_liquid * (params.view * params.projection);
+	settings.width = renderer.width();
+	settings.height = renderer.height();
+	settings.radius = params.radius;
+	settings.max_cell_pixels = static_cast<float>(args.get_count("lod", 0));
+
+	auto render = [&]() {
+		if(lod) {
+			merger.build(points.data(), points.size(), settings);
+			renderer.render(merger.points().data(), merger.radii().data(), merger.points().size());
+		} else {
+			renderer.render(points.data(), points.size());
+		}
+	};
+
+	std::string trace_path = args.get("trace", "");
+	if(!trace_path.empty()) {
+		tracer::instance().start(1 << 20);
+	}
+
+	//the first frame allocates the buffers
+	render();
+
+	std::vector<double> samples;
+	for(uint64_t i = 0; i < repeat; i++) {
+		auto start = std::chrono::steady_clock::now();
+		render();
+		samples.push_back(seconds_since(start));
+	}
+
+	if(!trace_path.empty()) {
+		tracer::instance().stop();
+		tracer::instance().write_chrome_trace(trace_path);
+	}
+
+	printf("%zu points, %u threads, %llu x %llu\n", points.size(), pool.size(), static_cast<unsigned long long>(width),
+		static_cast<unsigned long long>(height));
+	if(lod) {
+		printf("  %u cells, %u merged, %zu points merged into them\n", merger.cell_count(), merger.merged_cells(), merger.merged_particles());
+	}
+	printf("  %zu visible points, %llu blended fragments\n", renderer.visible_count(), static_cast<unsigned long long>(renderer.fragment_count()));
+	printf("  %.3f ms per frame, %.2f ns/point\n", median(samples) * 1e3, median(samples) * 1e9 / points.size());
+
+	std::string image_path = args.get("image", "");
+	if(!image_path.empty()) {
+		write_ppm(image_path, renderer.width(), renderer.height(), renderer.color().data());
+	}
+
+	return 0;
+}
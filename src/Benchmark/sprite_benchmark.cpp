@@ -0,0 +1,128 @@
+#include "benchmark.h"
+#include "src/Simulation2/cpu/cpu_engine.h"
+#include "src/Simulation2/cpu/particle_culler.h"
+#include "src/Simulation2/cpu/sprite_rasterizer.h"
+#include "src/Simulation2/frame_constants.h"
+#include "src/Utility/image_writer.h"
+#include "src/Utility/particle_lod.h"
+#include "src/Utility/tracer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+
+//options:
+//	--count <n>						particles, in the initial cube of the engine (default 1M)
+//	--width <w>, --height <h>		size of the frame (default 1920 x 1080)
+//	--steps <n>						engine steps before rendering (default 0)
+//	--repeat <n>					measured frames (default 10)
+//	--threads <n>					0 uses every hardware thread (default)
+//	--cull							leaves out grid cells outside the frustum or hidden behind the fluid, see particle_culler
+//	--lod <pixels>					merges the particles of grid cells that project to at most this many pixels, see particle_lod
+//	--image <path>					writes the last frame as PPM
+//	--trace <path>					writes a Chrome trace of the frames to path
+//
+//the box and the camera grow with the particle count, as in the sph benchmark, so the whole cube stays in view.
+
+int run_sprite_benchmark(const benchmark_arguments& args){
+	uint64_t count = args.get_count("count", 1024 * 1024);
+	uint64_t width = args.get_count("width", 1920);
+	uint64_t height = args.get_count("height", 1080);
+	uint64_t steps = args.get_count("steps", 0);
+	uint64_t repeat = std::max<uint64_t>(1, args.get_count("repeat", 10));
+
+	if(count == 0 || count > 0xFFFFFFFF) {
+		throw std::runtime_error("particle counts have to be in [1, 2^32)");
+	}
+	if(width == 0 || height == 0 || width > 16384 || height > 16384) {
+		throw std::runtime_error("the frame has to be between 1 and 16384 pixels wide and high");
+	}
+
+	simulation_parameters params = simulation_parameters::from_frame_constants();
+
+	float scale = std::max(1.f, std::cbrt(static_cast<float>(count) / frame_constants::PARTICLE_COUNT));
+
+	params.particle_count = static_cast<uint32_t>(count);
+	for(int i = 0; i < 3; i++) {
+		params.boundary[i] *= scale;
+	}
+
+	thread_pool pool(static_cast<unsigned>(args.get_count("threads", 0)));
+
+	cpu_engine engine(params, pool);
+	engine.load_initial_cube();
+	for(uint64_t i = 0; i < steps; i++) {
+		engine.step();
+	}
+
+	sprite_rasterizer rasterizer(static_cast<uint32_t>(width), static_cast<uint32_t>(height), pool);
+	rasterizer.set_mvp(sprite_rasterizer::simulation2_mvp(params.boundary, static_cast<float>(width) / height));
+
+	bool cull = args.has("cull");
+	particle_culler culler(engine.grid_size(), engine.cell_extent(), pool);
+
+	bool lod = args.has("lod");
+	particle_lod merger(engine.grid_size(), engine.cell_extent(), pool);
+
+	lod_settings settings;
+	settings.mvp = rasterizer.get_mvp();
+	settings.width = rasterizer.width();
+	settings.height = rasterizer.height();
+	settings.radius = sprite_rasterizer::SPRITE_RADIUS;
+	settings.max_cell_pixels = static_cast<float>(args.get_count("lod", 0));
+
+	if(cull && lod) {
+		throw std::runtime_error("--cull and --lod can't be combined");
+	}
+
+	auto render = [&]() {
+		if(lod) {
+			merger.build(engine.positions().data(), count, settings);
+			rasterizer.render(merger.points().data(), merger.radii().data(), merger.points().size());
+		} else if(cull) {
+			culler.render(engine.positions().data(), count, rasterizer);
+		} else {
+			rasterizer.render(engine.positions().data(), count);
+		}
+	};
+
+	std::string trace_path = args.get("trace", "");
+	if(!trace_path.empty()) {
+		tracer::instance().start(1 << 20);
+	}
+
+	//the first frame allocates the buffers, and gives the culler the visible cells
+	render();
+
+	std::vector<double> samples;
+	for(uint64_t i = 0; i < repeat; i++) {
+		auto start = std::chrono::steady_clock::now();
+		render();
+		samples.push_back(seconds_since(start));
+	}
+
+	if(!trace_path.empty()) {
+		tracer::instance().stop();
+		tracer::instance().write_chrome_trace(trace_path);
+	}
+
+	printf("%u particles, %u threads, %llu x %llu\n", params.particle_count, pool.size(), static_cast<unsigned long long>(width),
+		static_cast<unsigned long long>(height));
+	if(cull) {
+		printf("  %u cells, %u in the frustum, %u of them occluded\n", culler.cell_count(), culler.frustum_cells(), culler.occluded_cells());
+		printf("  %zu particles drawn in the first phase, %zu in the second\n", culler.first_phase_count(), culler.second_phase_count());
+	}
+	if(lod) {
+		printf("  %u cells, %u merged, %zu particles merged into them\n", merger.cell_count(), merger.merged_cells(), merger.merged_particles());
+	}
+	printf("  %zu visible sprites, %llu fragments\n", rasterizer.visible_count(), static_cast<unsigned long long>(rasterizer.fragment_count()));
+	printf("  %.3f ms per frame, %.2f ns/particle\n", median(samples) * 1e3, median(samples) * 1e9 / count);
+
+	std::string image_path = args.get("image", "");
+	if(!image_path.empty()) {
+		write_ppm(image_path, rasterizer.width(), rasterizer.height(), rasterizer.color().data());
+	}
+
+	return 0;
+}
@@ -0,0 +1,138 @@
+#include "benchmark.h"
+#include "src/Simulation2/cpu/cpu_engine.h"
+#include "src/Simulation2/cpu/surface_reconstruction.h"
+#include "src/Simulation2/frame_constants.h"
+#include "src/Utility/tracer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+
+//options:
+//	--count <n>						particles, in the initial cube of the engine (default 64K)
+//	--steps <n>						engine steps before the surface is extracted, so it isn't the flat lattice (default 20)
+//	--repeat <n>					measured extractions (default 10)
+//	--threads <n>					0 uses every hardware thread (default)
+//	--radius <r>					kernel support of the splatting (default 2.5 particle spacings)
+//	--voxel <size>					edge length of a voxel (default radius / 2)
+//	--iso <fraction>				the surface is at this fraction of the number density of the initial lattice (default 0.5)
+//	--obj <path>					writes the last mesh as Wavefront OBJ
+//	--trace <path>					writes a Chrome trace of the extractions to path
+//
+//the splatted kernel integrates to 1, so deep inside the fluid the density is the number of particles per volume.
+
+namespace {
+	float get_float(const benchmark_arguments& args, const char* name, float fallback){
+		std::string value = args.get(name, "");
+
+		if(value.empty()) {
+			return fallback;
+		}
+
+		char* end;
+		float result = strtof(value.c_str(), &end);
+
+		if(end == value.c_str() || *end != '\0' || !(result > 0.f)) {
+			throw std::runtime_error("invalid value '" + value + "' for --" + name);
+		}
+		return result;
+	}
+
+	void write_obj(const surface_mesh& mesh, const std::string& path){
+		FILE* file = fopen(path.c_str(), "w");
+
+		if(!file) {
+			throw std::runtime_error("can't open " + path);
+		}
+
+		for(const float3& p : mesh.positions) {
+			fprintf(file, "v %f %f %f\n", p.x, p.y, p.z);
+		}
+		for(const float3& n : mesh.normals) {
+			fprintf(file, "vn %f %f %f\n", n.x, n.y, n.z);
+		}
+		for(size_t i = 0; i < mesh.indices.size(); i += 3) {
+			uint32_t a = mesh.indices[i] + 1;
+			uint32_t b = mesh.indices[i + 1] + 1;
+			uint32_t c = mesh.indices[i + 2] + 1;
+
+			fprintf(file, "f %u//%u %u//%u %u//%u\n", a, a, b, b, c, c);
+		}
+
+		fclose(file);
+	}
+}
+
+int run_surface_benchmark(const benchmark_arguments& args){
+	uint64_t count = args.get_count("count", 64 * 1024);
+	uint64_t steps = args.get_count("steps", 20);
+	uint64_t repeat = std::max<uint64_t>(1, args.get_count("repeat", 10));
+
+	if(count == 0 || count > 0xFFFFFFFF) {
+		throw std::runtime_error("particle counts have to be in [1, 2^32)");
+	}
+
+	simulation_parameters params = simulation_parameters::from_frame_constants();
+
+	//the box grows with the particle count, as in the sph benchmark
+	float scale = std::max(1.f, std::cbrt(static_cast<float>(count) / frame_constants::PARTICLE_COUNT));
+
+	params.particle_count = static_cast<uint32_t>(count);
+	for(int i = 0; i < 3; i++) {
+		params.boundary[i] *= scale;
+	}
+
+	float spacing = params.initial_displacement;
+
+	surface_parameters surface;
+	surface.radius = get_float(args, "radius", 2.5f * spacing);
+	surface.voxel_size = get_float(args, "voxel", surface.radius * 0.5f);
+	surface.iso_density = get_float(args, "iso", 0.5f) / (spacing * spacing * spacing);
+
+	thread_pool pool(static_cast<unsigned>(args.get_count("threads", 0)));
+
+	cpu_engine engine(params, pool);
+	engine.load_initial_cube();
+	for(uint64_t i = 0; i < steps; i++) {
+		engine.step();
+	}
+
+	std::string trace_path = args.get("trace", "");
+	if(!trace_path.empty()) {
+		tracer::instance().start(1 << 20);
+	}
+
+	surface_reconstruction reconstruction(surface, pool);
+
+	//the first extraction allocates the buffers
+	reconstruction.extract(engine.positions().data(), count);
+
+	std::vector<double> samples;
+	for(uint64_t i = 0; i < repeat; i++) {
+		auto start = std::chrono::steady_clock::now();
+		reconstruction.extract(engine.positions().data(), count);
+		samples.push_back(seconds_since(start));
+	}
+
+	if(!trace_path.empty()) {
+		tracer::instance().stop();
+		tracer::instance().write_chrome_trace(trace_path);
+	}
+
+	const surface_mesh& mesh = reconstruction.mesh();
+
+	printf("%u particles, %u threads, radius %.3f, voxel %.3f, iso %.1f\n", params.particle_count, pool.size(), surface.radius, surface.voxel_size,
+		surface.iso_density);
+	printf("  %zu bricks, %zu at the surface, %zu vertices, %zu triangles\n", reconstruction.brick_count(), reconstruction.surface_brick_count(),
+		mesh.positions.size(), mesh.indices.size() / 3);
+	printf("  %.3f ms per extraction, %.2f ns/particle\n", median(samples) * 1e3, median(samples) * 1e9 / count);
+
+	std::string obj_path = args.get("obj", "");
+	if(!obj_path.empty()) {
+		write_obj(mesh, obj_path);
+	}
+
+	return 0;
+}
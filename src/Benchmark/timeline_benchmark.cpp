@@ -0,0 +1,73 @@
+#include "benchmark.h"
+#include "src/Utility/timeline.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+#include <thread>
+
+//options:
+//	--rounds <n>					signals sent (default 10K)
+//	--waiters <n>					threads woken by every signal (default 1)
+//	--spin <n>						reads before a waiter parks (default timeline::DEFAULT_SPIN_COUNT, 0 parks right away)
+//	--work <n>						iterations of busy work the signaling thread does between two rounds (default 0)
+//
+//ping pong between the main thread and the waiters: the main thread signals round r on one timeline,
+//every waiter wakes up and advances a second timeline, which the main thread waits for before the next round.
+//reported is the round trip from the signal until the last waiter answered.
+
+int run_timeline_benchmark(const benchmark_arguments& args){
+	uint64_t rounds = std::max<uint64_t>(1, args.get_count("rounds", 10 * 1024));
+	uint64_t waiters = args.get_count("waiters", 1);
+	uint64_t spin_count = args.get_count("spin", timeline::DEFAULT_SPIN_COUNT);
+	uint64_t work = args.get_count("work", 0);
+
+	if(waiters == 0 || waiters > 256) {
+		throw std::runtime_error("the number of waiters has to be in [1, 256]");
+	}
+
+	timeline ping(0, static_cast<uint32_t>(spin_count));
+	timeline pong(0, static_cast<uint32_t>(spin_count));
+
+	std::vector<std::thread> threads;
+	for(uint64_t w = 0; w < waiters; w++) {
+		threads.emplace_back([&]() {
+			for(uint64_t r = 1; r <= rounds; r++) {
+				ping.wait(r);
+				pong.advance();
+			}
+		});
+	}
+
+	std::vector<double> samples;
+	samples.reserve(rounds);
+
+	volatile uint64_t sink = 0;
+
+	for(uint64_t r = 1; r <= rounds; r++) {
+		for(uint64_t i = 0; i < work; i++) {
+			sink = sink + i;
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		ping.signal(r);
+		pong.wait(r * waiters);
+		samples.push_back(seconds_since(start));
+	}
+
+	for(std::thread& t : threads) {
+		t.join();
+	}
+
+	double total = 0.0;
+	for(double sample : samples) {
+		total += sample;
+	}
+
+	printf("%llu rounds, %llu waiters, spin count %llu, %u hardware threads\n", static_cast<unsigned long long>(rounds),
+		static_cast<unsigned long long>(waiters), static_cast<unsigned long long>(spin_count), std::thread::hardware_concurrency());
+	printf("  round trip %.3f us median, %.3f us mean\n", median(samples) * 1e6, total * 1e6 / rounds);
+	printf("  %.1f%% of the waits parked\n", 100.0 * (ping.parked_waits() + pong.parked_waits()) / (rounds * (waiters + 1)));
+
+	return 0;
+}
@@ -0,0 +1,329 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DIRECTION_CODEC_SSE2
+#endif
+
+//the bit fields the 19 directions of a Simulation1 lattice point are stored in, readWriteDirection of compute_shader.hlsl on the CPU
+//
+//every field is bits wide, they are packed from the most significant bit of the first 32 bit word on and a field can continue in the next word.
+//
+//	generic:		takes the width at runtime and works out the word and shift of a field on every access, as the shader does
+//	fixed<BITS>:	has the word and shift of every field in constexpr tables, pack and unpack expand into one constant shift and mask per field.
+//					for the widths that divide 32 every word holds its fields at the same shifts, there unpack converts four words at a time with SSE2.
+//					pack does too for 8 bits, for 16 bits the constant shifts of the scalar pack are faster than the shuffles
+//
+//all codecs read and write the same layout. pack writes all words the fields take up and leaves the bits after the last field 0,
+//the values written have to fit into a field. dispatch picks the fixed codec of the widths Simulation1 can be built with.
+namespace direction_codec {
+	constexpr uint32_t DIRECTIONS = 19;
+	constexpr uint32_t MAX_BITS = 16;
+
+	//words the fields of a lattice point take up
+	constexpr uint32_t packed_words(uint32_t bits){
+		return (DIRECTIONS * bits + 31) / 32;
+	}
+
+	struct field_table {
+		//the word the field starts in
+		uint32_t word[DIRECTIONS];
+		//the right shift that moves the field to the low bits of its word, if it doesn't continue in the next one
+		uint32_t shift[DIRECTIONS];
+		//the low bits of the field that are in the next word, 0 if it ends in its own
+		uint32_t split[DIRECTIONS];
+	};
+
+	constexpr field_table make_field_table(uint32_t bits){
+		field_table table = {};
+
+		for(uint32_t dir = 0; dir < DIRECTIONS; dir++) {
+			uint32_t end = dir * bits % 32 + bits;
+
+			table.word[dir] = dir * bits / 32;
+			table.shift[dir] = end <= 32 ? 32 - end : 0;
+			table.split[dir] = end <= 32 ? 0 : end - 32;
+		}
+		return table;
+	}
+
+	class generic {
+	public:
+		explicit generic(uint32_t bits) :
+			bits(bits),
+			mask((1u << bits) - 1)
+		{}
+
+		uint32_t words() const{
+			return packed_words(bits);
+		}
+
+		uint32_t read(const uint32_t* point, uint32_t dir) const{
+			uint32_t offset = dir * bits;
+			uint32_t word = offset / 32;
+			uint32_t end = offset % 32 + bits;
+
+			if(end <= 32) {
+				return (point[word] >> (32 - end)) & mask;
+			}
+			return (point[word] << (end - 32) | point[word + 1] >> (64 - end)) & mask;
+		}
+
+		void write(uint32_t* point, uint32_t dir, uint32_t value) const{
+			uint32_t offset = dir * bits;
+			uint32_t word = offset / 32;
+			uint32_t end = offset % 32 + bits;
+
+			if(end <= 32) {
+				point[word] = (point[word] & ~(mask << (32 - end))) | value << (32 - end);
+				return;
+			}
+			point[word] = (point[word] & ~(mask >> (end - 32))) | value >> (end - 32);
+			point[word + 1] = (point[word + 1] & ~(mask << (64 - end))) | value << (64 - end);
+		}
+
+		void unpack(const uint32_t* point, uint32_t* values) const{
+			for(uint32_t dir = 0; dir < DIRECTIONS; dir++) {
+				values[dir] = read(point, dir);
+			}
+		}
+
+		void pack(const uint32_t* values, uint32_t* point) const{
+			for(uint32_t word = 0; word < words(); word++) {
+				point[word] = 0;
+			}
+			for(uint32_t dir = 0; dir < DIRECTIONS; dir++) {
+				write(point, dir, values[dir]);
+			}
+		}
+
+	private:
+		uint32_t bits;
+		uint32_t mask;
+	};
+
+	namespace detail {
+		//four words at a time for the widths that divide 32, the other widths don't have it.
+		//the words after SIMD_WORDS are left to the scalar code, PACK is false if pack is left to it as well
+		template<uint32_t BITS>
+		struct sse2_fields {
+			static constexpr bool ENABLED = false;
+			static constexpr bool PACK = false;
+			static constexpr uint32_t SIMD_WORDS = 0;
+
+			static void unpack(const uint32_t*, uint32_t*){}
+			static void pack(const uint32_t*, uint32_t*){}
+		};
+
+#ifdef DIRECTION_CODEC_SSE2
+		//two fields per word, the high halves are the even directions
+		template<>
+		struct sse2_fields<16> {
+			static constexpr bool ENABLED = true;
+			static constexpr bool PACK = false;
+			static constexpr uint32_t SIMD_WORDS = 8;
+
+			static void unpack(const uint32_t* point, uint32_t* values){
+				const __m128i mask = _mm_set1_epi32(0xFFFF);
+
+				for(uint32_t word = 0; word < SIMD_WORDS; word += 4) {
+					__m128i words = _mm_loadu_si128(reinterpret_cast<const __m128i*>(point + word));
+					__m128i even = _mm_srli_epi32(words, 16);
+					__m128i odd = _mm_and_si128(words, mask);
+
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(values + 2 * word), _mm_unpacklo_epi32(even, odd));
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(values + 2 * word + 4), _mm_unpackhi_epi32(even, odd));
+				}
+			}
+
+			//gathering the even and odd fields takes two shuffles and two unpacks per four words, which lose against the shifts and ors of pack_scalar
+			static void pack(const uint32_t*, uint32_t*){}
+		};
+
+		//four fields per word, the shifts give one field of every word and a 4 x 4 transpose puts them in order
+		template<>
+		struct sse2_fields<8> {
+			static constexpr bool ENABLED = true;
+			static constexpr bool PACK = true;
+			static constexpr uint32_t SIMD_WORDS = 4;
+
+			static void unpack(const uint32_t* point, uint32_t* values){
+				const __m128i mask = _mm_set1_epi32(0xFF);
+				__m128i words = _mm_loadu_si128(reinterpret_cast<const __m128i*>(point));
+
+				__m128i f0 = _mm_srli_epi32(words, 24);
+				__m128i f1 = _mm_and_si128(_mm_srli_epi32(words, 16), mask);
+				__m128i f2 = _mm_and_si128(_mm_srli_epi32(words, 8), mask);
+				__m128i f3 = _mm_and_si128(words, mask);
+
+				__m128i t0 = _mm_unpacklo_epi32(f0, f1);
+				__m128i t1 = _mm_unpacklo_epi32(f2, f3);
+				__m128i t2 = _mm_unpackhi_epi32(f0, f1);
+				__m128i t3 = _mm_unpackhi_epi32(f2, f3);
+
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(values), _mm_unpacklo_epi64(t0, t1));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(values + 4), _mm_unpackhi_epi64(t0, t1));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(values + 8), _mm_unpacklo_epi64(t2, t3));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(values + 12), _mm_unpackhi_epi64(t2, t3));
+			}
+
+			static void pack(const uint32_t* values, uint32_t* point){
+				__m128i w0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values));
+				__m128i w1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + 4));
+				__m128i w2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + 8));
+				__m128i w3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + 12));
+
+				__m128i t0 = _mm_unpacklo_epi32(w0, w1);
+				__m128i t1 = _mm_unpacklo_epi32(w2, w3);
+				__m128i t2 = _mm_unpackhi_epi32(w0, w1);
+				__m128i t3 = _mm_unpackhi_epi32(w2, w3);
+
+				__m128i words = _mm_or_si128(
+					_mm_or_si128(_mm_slli_epi32(_mm_unpacklo_epi64(t0, t1), 24), _mm_slli_epi32(_mm_unpackhi_epi64(t0, t1), 16)),
+					_mm_or_si128(_mm_slli_epi32(_mm_unpacklo_epi64(t2, t3), 8), _mm_unpackhi_epi64(t2, t3)));
+
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(point), words);
+			}
+		};
+#endif
+	}
+
+	template<uint32_t BITS>
+	class fixed {
+		static_assert(BITS >= 1 && BITS <= MAX_BITS, "a direction has between 1 and 16 bits");
+
+	public:
+		static constexpr uint32_t WORDS = packed_words(BITS);
+		static constexpr uint32_t MASK = (1u << BITS) - 1;
+		static constexpr field_table FIELDS = make_field_table(BITS);
+		static constexpr bool SIMD = detail::sse2_fields<BITS>::ENABLED;
+		static constexpr bool SIMD_PACK = detail::sse2_fields<BITS>::PACK;
+
+		uint32_t words() const{
+			return WORDS;
+		}
+
+		uint32_t read(const uint32_t* point, uint32_t dir) const{
+			uint32_t word = FIELDS.word[dir];
+			uint32_t split = FIELDS.split[dir];
+
+			if(split == 0) {
+				return (point[word] >> FIELDS.shift[dir]) & MASK;
+			}
+			return (point[word] << split | point[word + 1] >> (32 - split)) & MASK;
+		}
+
+		void write(uint32_t* point, uint32_t dir, uint32_t value) const{
+			uint32_t word = FIELDS.word[dir];
+			uint32_t split = FIELDS.split[dir];
+
+			if(split == 0) {
+				uint32_t shift = FIELDS.shift[dir];
+
+				point[word] = (point[word] & ~(MASK << shift)) | value << shift;
+				return;
+			}
+			point[word] = (point[word] & ~(MASK >> split)) | value >> split;
+			point[word + 1] = (point[word + 1] & ~(MASK << (32 - split))) | value << (32 - split);
+		}
+
+		//with SSE2 if the width has it, see sse2_fields
+		void unpack(const uint32_t* point, uint32_t* values) const{
+			if(SIMD) {
+				detail::sse2_fields<BITS>::unpack(point, values);
+				unpack_fields(point, values, std::make_index_sequence<DIRECTIONS>(), simd_dirs());
+				return;
+			}
+			unpack_scalar(point, values);
+		}
+
+		void pack(const uint32_t* values, uint32_t* point) const{
+			if(SIMD_PACK) {
+				detail::sse2_fields<BITS>::pack(values, point);
+				pack_fields(values, point, std::make_index_sequence<DIRECTIONS>(), simd_dirs());
+				return;
+			}
+			pack_scalar(values, point);
+		}
+
+		//pack and unpack one field at a time, with the shifts and masks as constants
+		void unpack_scalar(const uint32_t* point, uint32_t* values) const{
+			unpack_fields(point, values, std::make_index_sequence<DIRECTIONS>(), 0);
+		}
+
+		void pack_scalar(const uint32_t* values, uint32_t* point) const{
+			pack_fields(values, point, std::make_index_sequence<DIRECTIONS>(), 0);
+		}
+
+	private:
+		//the directions the SSE2 loops convert, they take up whole words
+		static constexpr uint32_t simd_dirs(){
+			return detail::sse2_fields<BITS>::SIMD_WORDS * 32 / BITS;
+		}
+
+		//directions from first on, every one a separate call with dir as a constant
+		template<size_t... DIRS>
+		void unpack_fields(const uint32_t* point, uint32_t* values, std::index_sequence<DIRS...>, uint32_t first) const{
+			int expand[] = {(DIRS >= first ? (values[DIRS] = read(point, DIRS), 0) : 0)...};
+			(void)expand;
+		}
+
+		//the words from the one of direction first on are cleared and or'ed together
+		template<size_t... DIRS>
+		void pack_fields(const uint32_t* values, uint32_t* point, std::index_sequence<DIRS...>, uint32_t first) const{
+			for(uint32_t word = first * BITS / 32; word < WORDS; word++) {
+				point[word] = 0;
+			}
+			int expand[] = {(DIRS >= first ? (or_field(point, DIRS, values[DIRS]), 0) : 0)...};
+			(void)expand;
+		}
+
+		void or_field(uint32_t* point, uint32_t dir, uint32_t value) const{
+			uint32_t word = FIELDS.word[dir];
+			uint32_t split = FIELDS.split[dir];
+
+			if(split == 0) {
+				point[word] |= value << FIELDS.shift[dir];
+				return;
+			}
+			point[word] |= value >> split;
+			point[word + 1] |= value << (32 - split);
+		}
+	};
+
+	template<uint32_t BITS>
+	constexpr uint32_t fixed<BITS>::WORDS;
+	template<uint32_t BITS>
+	constexpr uint32_t fixed<BITS>::MASK;
+	template<uint32_t BITS>
+	constexpr field_table fixed<BITS>::FIELDS;
+	template<uint32_t BITS>
+	constexpr bool fixed<BITS>::SIMD;
+	template<uint32_t BITS>
+	constexpr bool fixed<BITS>::SIMD_PACK;
+
+	//calls fn with fixed<bits> for 8, 10, 12 and 16 bits and with generic for the others
+	template<class F>
+	void dispatch(uint32_t bits, F&& fn){
+		switch(bits) {
+		case 8:
+			fn(fixed<8>());
+			break;
+		case 10:
+			fn(fixed<10>());
+			break;
+		case 12:
+			fn(fixed<12>());
+			break;
+		case 16:
+			fn(fixed<16>());
+			break;
+		default:
+			fn(generic(bits));
+			break;
+		}
+	}
+}
@@ -0,0 +1,556 @@
+#include "lattice_engine.h"
+#include "src/Utility/tracer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+constexpr uint32_t lattice_engine::DIRECTIONS;
+constexpr uint32_t lattice_engine::MAX_BITS_PER_DIRECTION;
+constexpr uint32_t lattice_engine::MIN_SLAB_PLANES;
+
+namespace {
+	constexpr size_t POINT_GRAIN = 2048;
+	constexpr size_t ROW_GRAIN = 16;
+
+	//direction_vectors of the shader
+	const int DIRECTION_VECTORS[lattice_engine::DIRECTIONS][3] = {
+		{0, 0, 0},
+
+		{0, 1, 0},
+		{0, -1, 0},
+		{0, 0, 1},
+		{0, 0, -1},
+		{1, 0, 0},
+		{-1, 0, 0},
+
+		{1, 0, 1},
+		{-1, 0, -1},
+		{0, 1, 1},
+		{0, -1, -1},
+		{1, 1, 0},
+		{-1, -1, 0},
+
+		{0, 1, -1},
+		{0, -1, 1},
+		{1, -1, 0},
+		{-1, 1, 0},
+		{-1, 0, 1},
+		{1, 0, -1},
+	};
+
+	//inverse_lookup_table of the shader, the direction you get by flipping the sign of the x, y or z component
+	const uint32_t INVERSE_DIRECTIONS[lattice_engine::DIRECTIONS][3] = {
+		{0, 0, 0},
+
+		{1, 2, 1},
+		{2, 1, 2},
+		{3, 3, 4},
+		{4, 4, 3},
+		{6, 5, 5},
+		{5, 6, 6},
+
+		{17, 7, 18},
+		{18, 8, 17},
+		{9, 14, 13},
+		{10, 13, 14},
+		{16, 15, 11},
+		{15, 16, 12},
+
+		{13, 10, 9},
+		{14, 9, 10},
+		{12, 11, 15},
+		{11, 12, 16},
+		{7, 17, 8},
+		{8, 18, 7},
+	};
+
+	//the direction with all components flipped
+	const uint32_t OPPOSITE_DIRECTIONS[lattice_engine::DIRECTIONS] = {0, 2, 1, 4, 3, 6, 5, 8, 7, 10, 9, 12, 11, 14, 13, 16, 15, 18, 17};
+
+	//float to uint as D3D converts them: NaN becomes 0, everything else is clamped to the range of uint first
+	uint32_t to_uint(float f){
+		if(!(f > 0.f)) {
+			return 0;
+		}
+		return f >= 4294967296.f ? 0xFFFFFFFF : static_cast<uint32_t>(f);
+	}
+}
+
+lattice_parameters lattice_parameters::from_simulation1(){
+	lattice_parameters params;
+
+	params.dim[0] = 3 * 30;
+	params.dim[1] = 1 * 30;
+	params.dim[2] = 3 * 30;
+
+	params.bits_per_direction = 16;
+	params.bytes_per_lattice_point = 40;
+	params.start_value = 1000;
+
+	params.particle_threshold = 1500;
+	params.points_per_lattice = 8;
+	params.unit_length = 1.f / 30.f;
+
+	params.timestep = 0.35f;
+	params.gravity_factor = 1.f;
+	params.momentum_exponent = 1.f;
+	params.include_reality_increasing_terms = false;
+
+	return params;
+}
+
+lattice_engine::lattice_engine(const lattice_parameters& params, thread_pool& pool, lattice_update update) :
+	params(params),
+	pool(pool),
+	emitter(params.dim[0], params.dim[1], params.dim[2], params.unit_length, params.points_per_lattice, params.particle_threshold),
+	codec(1),
+	update(update),
+	swapped(false),
+	words_per_point(params.bytes_per_lattice_point / 4),
+	max_value(0)
+{
+	if(params.bits_per_direction == 0 || params.bits_per_direction > MAX_BITS_PER_DIRECTION) {
+		throw std::runtime_error("a direction has to have between 1 and 16 bits");
+	}
+	max_value = (1u << params.bits_per_direction) - 1;
+	codec = direction_codec::generic(params.bits_per_direction);
+
+	if(params.bytes_per_lattice_point % 4 != 0 || params.bytes_per_lattice_point * 8 < DIRECTIONS * params.bits_per_direction) {
+		throw std::runtime_error("a lattice point has to be a multiple of 4 bytes that holds all of its directions");
+	}
+
+	const uint32_t dim_x = params.dim[0];
+	const uint32_t dim_y = params.dim[1];
+
+	for(uint32_t dir = 0; dir < DIRECTIONS; dir++) {
+		const int* v = DIRECTION_VECTORS[dir];
+		float length = std::sqrt(static_cast<float>(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]));
+
+		for(int k = 0; k < 3; k++) {
+			unit_vectors[dir][k] = dir == 0 ? 0.f : v[k] / length;
+		}
+
+		//1 / length(v) + gravity_factor * dot((0, -1, 0), normalize(v)), never below 0
+		direction_weights[dir] = dir == 0 ? 1.f : std::max(0.f, 1.f / length + params.gravity_factor * -unit_vectors[dir][1]);
+
+		pull_offsets[dir] = -((static_cast<int64_t>(v[2]) * dim_y + v[1]) * dim_x + v[0]);
+	}
+
+	lattice.assign(static_cast<size_t>(lattice_count()) * words_per_point, 0);
+	if(update == lattice_update::two_pass) {
+		collided.assign(lattice.size(), 0);
+	}
+	point_sums.assign(lattice_count(), 0);
+}
+
+void lattice_engine::load_initial_cube(){
+	const uint32_t* dim = params.dim;
+
+	std::fill(lattice.begin(), lattice.end(), 0);
+	std::fill(point_sums.begin(), point_sums.end(), 0);
+
+	uint32_t values[DIRECTIONS];
+	std::fill(values, values + DIRECTIONS, std::min(params.start_value, max_value));
+
+	for(uint32_t z = dim[2] / 3; z < 2 * dim[2] / 3; z++) {
+		for(uint32_t y = 0; y < dim[1]; y++) {
+			for(uint32_t x = dim[0] / 3; x < 2 * dim[0] / 3; x++) {
+				size_t i = (static_cast<size_t>(z) * dim[1] + y) * dim[0] + x;
+
+				codec.pack(values, lattice.data() + i * words_per_point);
+				point_sums[i] = values[0] * DIRECTIONS;
+			}
+		}
+	}
+
+	//fused keeps the collided state, the first step starts by streaming it
+	if(update == lattice_update::fused) {
+		swapped = false;
+
+		direction_codec::dispatch(params.bits_per_direction, [this](auto point_codec) {
+			pool.parallel_for(lattice_count(), POINT_GRAIN, [this, point_codec](size_t begin, size_t end, unsigned) {
+				for(size_t i = begin; i < end; i++) {
+					collide_point(point_codec, lattice.data() + i * words_per_point, lattice.data() + i * words_per_point);
+				}
+			});
+		});
+	}
+}
+
+void lattice_engine::step(){
+	if(update == lattice_update::fused) {
+		fused_step();
+		return;
+	}
+
+	collide();
+	stream();
+}
+
+void lattice_engine::collide(){
+	TRACE_SCOPE("collide");
+
+	if(update != lattice_update::two_pass) {
+		throw std::runtime_error("collide and stream are the passes of lattice_update::two_pass");
+	}
+
+	direction_codec::dispatch(params.bits_per_direction, [this](auto point_codec) {
+		pool.parallel_for(lattice_count(), POINT_GRAIN, [this, point_codec](size_t begin, size_t end, unsigned) {
+			for(size_t i = begin; i < end; i++) {
+				collide_point(point_codec, lattice.data() + i * words_per_point, collided.data() + i * words_per_point);
+			}
+		});
+	});
+}
+
+void lattice_engine::stream(){
+	TRACE_SCOPE("stream");
+
+	if(update != lattice_update::two_pass) {
+		throw std::runtime_error("collide and stream are the passes of lattice_update::two_pass");
+	}
+
+	const uint32_t dim_y = params.dim[1];
+
+	direction_codec::dispatch(params.bits_per_direction, [this, dim_y](auto point_codec) {
+		pool.parallel_for(static_cast<size_t>(dim_y) * params.dim[2], ROW_GRAIN, [this, dim_y, point_codec](size_t begin, size_t end, unsigned) {
+			for(size_t row = begin; row < end; row++) {
+				stream_row(point_codec, static_cast<uint32_t>(row % dim_y), static_cast<uint32_t>(row / dim_y));
+			}
+		});
+	});
+}
+
+lattice_update lattice_engine::get_lattice_update() const{
+	return update;
+}
+
+size_t lattice_engine::emit_points(float4* points) const{
+	return emitter.emit(pool, point_sums.data(), points);
+}
+
+size_t lattice_engine::max_points() const{
+	return emitter.max_points();
+}
+
+uint32_t lattice_engine::lattice_count() const{
+	return emitter.lattice_count();
+}
+
+uint32_t lattice_engine::direction(uint32_t i, uint32_t dir) const{
+	return codec.read(lattice.data() + static_cast<size_t>(i) * words_per_point, dir);
+}
+
+const std::vector<uint32_t>& lattice_engine::sums() const{
+	return point_sums;
+}
+
+uint64_t lattice_engine::total_particles() const{
+	uint64_t total = 0;
+
+	for(uint32_t i = 0; i < lattice_count(); i++) {
+		for(uint32_t dir = 0; dir < DIRECTIONS; dir++) {
+			total += direction(i, dir);
+		}
+	}
+	return total;
+}
+
+uint64_t lattice_engine::state_hash() const{
+	uint64_t hash = 0xcbf29ce484222325ull;
+	const unsigned char* bytes = reinterpret_cast<const unsigned char*>(lattice.data());
+
+	for(size_t i = 0; i < lattice.size() * sizeof(uint32_t); i++) {
+		hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+	}
+	return hash;
+}
+
+const lattice_parameters& lattice_engine::parameters() const{
+	return params;
+}
+
+template<class Codec>
+void lattice_engine::collide_point(const Codec& codec, const uint32_t* in, uint32_t* out) const{
+	uint32_t values[DIRECTIONS];
+
+	codec.unpack(in, values);
+	collide_values(values);
+	codec.pack(values, out);
+}
+
+void lattice_engine::collide_values(uint32_t* dir) const{
+	uint32_t num_particles = 0;
+	float momentum[3] = {0.f, 0.f, 0.f};
+
+	for(uint32_t i = 0; i < DIRECTIONS; i++) {
+		num_particles += dir[i];
+		for(int k = 0; k < 3; k++) {
+			momentum[k] += static_cast<float>(DIRECTION_VECTORS[i][k] * static_cast<int>(dir[i]));
+		}
+	}
+
+	if(num_particles > 0) {
+		float speed_of_sound_squared = 0.f;
+		float equilibrium_factor = 0.f;
+		float momentum_squared = momentum[0] * momentum[0] + momentum[1] * momentum[1] + momentum[2] * momentum[2];
+
+		if(params.include_reality_increasing_terms) {
+			speed_of_sound_squared = std::pow(params.unit_length / params.timestep, 2.f) / 3;
+			equilibrium_factor = momentum_squared / (2 * speed_of_sound_squared);
+		}
+
+		//normalize in the shader, 0 / 0 for a lattice point at rest
+		float inverse_length = 1.f / std::sqrt(momentum_squared);
+		float unit_momentum[3] = {momentum[0] * inverse_length, momentum[1] * inverse_length, momentum[2] * inverse_length};
+
+		float momentum_components[DIRECTIONS];
+		momentum_weights(unit_momentum, num_particles, momentum_components);
+
+		float weights[DIRECTIONS];
+		float weight_sum = 0.f;
+
+		for(uint32_t i = 0; i < DIRECTIONS; i++) {
+			weights[i] = weight(i, momentum, momentum_components[i], equilibrium_factor, speed_of_sound_squared);
+			weight_sum += weights[i];
+		}
+
+		uint32_t sum_after = 0;
+
+		for(uint32_t i = 0; i < DIRECTIONS; i++) {
+			float equilibrium = weights[i] / weight_sum * static_cast<float>(num_particles);
+
+			dir[i] -= to_uint(std::round(params.timestep * (static_cast<float>(dir[i]) - equilibrium)));
+			dir[i] = std::min(max_value, dir[i]);
+			sum_after += dir[i];
+		}
+
+		//the particles lost or created by rounding are added to or taken from the directions in their order,
+		//at most a 19th of them per direction
+		int particle_diff = static_cast<int>(num_particles - sum_after);
+		float share = particle_diff / static_cast<float>(DIRECTIONS);
+		int equal_correction = static_cast<int>(particle_diff < 0 ? std::floor(share) : std::ceil(share));
+
+		for(uint32_t i = 0; particle_diff != 0 && i < DIRECTIONS; i++) {
+			int int_dir = static_cast<int>(dir[i]);
+			int cor = 0;
+
+			if(particle_diff < 0) {
+				cor = std::max(std::max(particle_diff, equal_correction), -int_dir);
+			} else {
+				cor = std::min(std::min(particle_diff, equal_correction), static_cast<int>(max_value) - int_dir);
+			}
+
+			dir[i] += cor;
+			particle_diff -= cor;
+		}
+	}
+}
+
+//fmin and fmax drop a NaN operand like min and max in HLSL do
+void lattice_engine::momentum_weights(const float* unit_momentum, uint32_t particle_count, float* components) const{
+	components[0] = 1.f;
+
+	if(params.momentum_exponent <= 0.01f) {
+		std::fill(components + 1, components + DIRECTIONS, 1.f);
+		return;
+	}
+
+	const float scale = params.particle_threshold * 2.f / static_cast<float>(particle_count);
+
+	for(uint32_t dir = 1; dir < DIRECTIONS; dir++) {
+		const float* u = unit_vectors[dir];
+		float alignment = u[0] * unit_momentum[0] + u[1] * unit_momentum[1] + u[2] * unit_momentum[2];
+
+		components[dir] = std::fmax(0.01f, std::fmin(20.f, scale * alignment));
+	}
+
+	//pow(x, 1) is x, which spares Simulation1 18 pows per lattice point
+	if(params.momentum_exponent != 1.f) {
+		for(uint32_t dir = 1; dir < DIRECTIONS; dir++) {
+			components[dir] = std::pow(components[dir], params.momentum_exponent);
+		}
+	}
+}
+
+float lattice_engine::weight(uint32_t dir, const float* momentum, float momentum_component, float equilibrium_factor, float speed_of_sound_squared) const{
+	if(dir == 0) {
+		return 1.f;
+	}
+
+	float component = direction_weights[dir] * momentum_component;
+
+	if(!params.include_reality_increasing_terms) {
+		return component;
+	}
+
+	const int* v = DIRECTION_VECTORS[dir];
+	float momentum_dot = v[0] * momentum[0] + v[1] * momentum[1] + v[2] * momentum[2];
+	float ratio = momentum_dot / speed_of_sound_squared;
+	float physics_component_squared = 1 + ratio + ratio * ratio / 2 - equilibrium_factor;
+
+	if(physics_component_squared < 0.f) {
+		return component;
+	}
+	return component * std::sqrt(physics_component_squared);
+}
+
+//lattice points off the boundary pull every direction from a fixed offset,
+//the others check every component as secondRun does and fall back to the reflected direction of their own
+template<class Codec>
+void lattice_engine::stream_row(const Codec& codec, uint32_t y, uint32_t z){
+	const uint32_t* dim = params.dim;
+	const size_t row_start = (static_cast<size_t>(z) * dim[1] + y) * dim[0];
+	const bool inner_row = y > 0 && y + 1 < dim[1] && z > 0 && z + 1 < dim[2];
+
+	uint32_t values[DIRECTIONS];
+
+	for(uint32_t x = 0; x < dim[0]; x++) {
+		const size_t i = row_start + x;
+		uint32_t sum = 0;
+
+		if(inner_row && x > 0 && x + 1 < dim[0]) {
+			for(uint32_t dir = 0; dir < DIRECTIONS; dir++) {
+				values[dir] = codec.read(collided.data() + (i + pull_offsets[dir]) * words_per_point, dir);
+				sum += values[dir];
+			}
+		} else {
+			for(uint32_t dir = 0; dir < DIRECTIONS; dir++) {
+				uint32_t other_dir;
+				size_t other_point = pull_source(x, y, z, dir, other_dir);
+
+				values[dir] = codec.read(collided.data() + other_point * words_per_point, other_dir);
+				sum += values[dir];
+			}
+		}
+
+		codec.pack(values, lattice.data() + i * words_per_point);
+		point_sums[i] = sum;
+	}
+}
+
+//if the neighbor is off the lattice in any component, the direction is flipped in those components and read from the lattice point itself
+size_t lattice_engine::pull_source(uint32_t x, uint32_t y, uint32_t z, uint32_t dir, uint32_t& source_dir) const{
+	const uint32_t* dim = params.dim;
+	const int64_t point[3] = {x, y, z};
+	const size_t i = (static_cast<size_t>(z) * dim[1] + y) * dim[0] + x;
+	bool reflect = false;
+
+	source_dir = dir;
+
+	for(int k = 0; k < 3; k++) {
+		int64_t other = point[k] - DIRECTION_VECTORS[dir][k];
+
+		if(other < 0 || other >= dim[k]) {
+			source_dir = INVERSE_DIRECTIONS[source_dir][k];
+			reflect = true;
+		}
+	}
+
+	return reflect ? i : i + pull_offsets[dir];
+}
+
+void lattice_engine::fused_step(){
+	TRACE_SCOPE("fused step");
+
+	const uint32_t* dim = params.dim;
+
+	direction_codec::dispatch(params.bits_per_direction, [this, dim](auto point_codec) {
+		if(swapped) {
+			pool.parallel_for(lattice_count(), POINT_GRAIN, [this, point_codec](size_t begin, size_t end, unsigned) { fused_local(point_codec, begin, end); });
+			return;
+		}
+
+		//two slabs per thread, so both halves keep every thread busy
+		uint32_t slabs = std::max<uint32_t>(1, std::min<uint32_t>(2 * pool.size(), dim[2] / MIN_SLAB_PLANES));
+
+		for(uint32_t parity = 0; parity < 2; parity++) {
+			pool.run((slabs + 1 - parity) / 2, [this, dim, slabs, parity, point_codec](size_t task, unsigned) {
+				uint32_t slab = static_cast<uint32_t>(2 * task + parity);
+
+				fused_pull(point_codec, dim[2] * slab / slabs, dim[2] * (slab + 1) / slabs);
+			});
+		}
+	});
+
+	swapped = !swapped;
+}
+
+//pulls and collides as stream and collide would. direction dir then goes to the neighbor it streams to,
+//into the slot the opposite direction was read from. if that neighbor is off the lattice, the opposite direction was reflected,
+//and the slot of dir on the lattice point itself, which no neighbor writes, gets the direction the reflection reads instead.
+//secondRun can read the same direction for two reflected ones at an edge and no direction leaves through it, so some directions
+//are stored twice and others dropped, as the two passes do
+template<class Codec>
+void lattice_engine::fused_pull(const Codec& codec, uint32_t z_begin, uint32_t z_end){
+	const uint32_t* dim = params.dim;
+
+	uint32_t values[DIRECTIONS];
+	uint32_t* slots[DIRECTIONS];
+	uint32_t slot_dirs[DIRECTIONS];
+	bool reflected[DIRECTIONS];
+
+	for(uint32_t z = z_begin; z < z_end; z++) {
+		for(uint32_t y = 0; y < dim[1]; y++) {
+			const size_t row_start = (static_cast<size_t>(z) * dim[1] + y) * dim[0];
+			const bool inner_row = y > 0 && y + 1 < dim[1] && z > 0 && z + 1 < dim[2];
+
+			for(uint32_t x = 0; x < dim[0]; x++) {
+				const size_t i = row_start + x;
+				const bool inner = inner_row && x > 0 && x + 1 < dim[0];
+				uint32_t* point = lattice.data() + i * words_per_point;
+				uint32_t sum = 0;
+
+				for(uint32_t dir = 0; dir < DIRECTIONS; dir++) {
+					size_t source = i + pull_offsets[dir];
+					slot_dirs[dir] = dir;
+
+					if(!inner) {
+						source = pull_source(x, y, z, dir, slot_dirs[dir]);
+					}
+
+					reflected[dir] = dir != 0 && source == i;
+					slots[dir] = lattice.data() + source * words_per_point;
+					values[dir] = codec.read(slots[dir], slot_dirs[dir]);
+					sum += values[dir];
+				}
+
+				point_sums[i] = sum;
+				collide_values(values);
+
+				for(uint32_t dir = 0; dir < DIRECTIONS; dir++) {
+					uint32_t opposite = OPPOSITE_DIRECTIONS[dir];
+
+					if(reflected[opposite]) {
+						codec.write(point, dir, values[slot_dirs[opposite]]);
+					} else {
+						codec.write(slots[opposite], slot_dirs[opposite], values[dir]);
+					}
+				}
+			}
+		}
+	}
+}
+
+//the even step left the particles streaming in direction dir in the slot of the opposite direction
+template<class Codec>
+void lattice_engine::fused_local(const Codec& codec, size_t begin, size_t end){
+	uint32_t stored[DIRECTIONS];
+	uint32_t values[DIRECTIONS];
+
+	for(size_t i = begin; i < end; i++) {
+		uint32_t* point = lattice.data() + i * words_per_point;
+		uint32_t sum = 0;
+
+		codec.unpack(point, stored);
+		for(uint32_t dir = 0; dir < DIRECTIONS; dir++) {
+			values[dir] = stored[OPPOSITE_DIRECTIONS[dir]];
+			sum += values[dir];
+		}
+
+		point_sums[i] = sum;
+		collide_values(values);
+		codec.pack(values, point);
+	}
+}
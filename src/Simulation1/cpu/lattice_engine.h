@@ -0,0 +1,158 @@
+#pragma once
+
+#include "direction_codec.h"
+#include "point_emitter.h"
+#include "src/Utility/thread_pool.h"
+
+#include <cstdint>
+#include <vector>
+
+//runtime counterpart of the constants Simulation1 hands to compute_shader.hlsl, so the CPU engine can run other lattice sizes
+struct lattice_parameters {
+	//lattice points along x, y and z, global_X/Y/Z in the shader
+	uint32_t dim[3];
+
+	//bits per direction of a lattice point, at most 16, and the bytes the 19 directions of a lattice point are stored in.
+	//the bytes have to be a multiple of 4 and hold 19 * bits_per_direction bits
+	uint32_t bits_per_direction;
+	uint32_t bytes_per_lattice_point;
+
+	//the particles of every direction of the lattice points in the starting cube
+	uint32_t start_value;
+
+	uint32_t particle_threshold;
+	uint32_t points_per_lattice;
+	float unit_length;
+
+	float timestep;
+	float gravity_factor;
+	float momentum_exponent;
+	bool include_reality_increasing_terms;
+
+	//the values Simulation1 runs with
+	static lattice_parameters from_simulation1();
+};
+
+//how a step updates the lattice
+//
+//two_pass:
+//	collide writes every lattice point to a second buffer and stream pulls from there back into the first one,
+//	as the two dispatches of Simulation1 do with its two lattice buffers.
+//
+//fused:
+//	a single sweep per step pulls, collides and stores every lattice point, in place in one buffer (the AA pattern).
+//	the stored state is the collided one, the pull of the next step streams it. the even steps pull from the neighbors
+//	and write every collided direction into the neighbor it streams to, in the slot the opposite direction was read from.
+//	the odd steps find all directions of a lattice point in its own slots in that swapped order, and write them back in the natural one.
+//	so every step reads and writes each direction once, and every slot is read and written by the same lattice point.
+//	the particle counts and render points after every step are the same as with two_pass, bit for bit.
+//	the even steps write bit fields of neighbors, which share 32 bit words with fields written by other lattice points,
+//	so slabs of at least two z planes run in parallel, first the even slabs, then the odd ones.
+enum class lattice_update {
+	two_pass,
+	fused,
+};
+
+//multithreaded CPU implementation of the lattice gas in compute_shader.hlsl of Simulation1
+//
+//	collide:	(firstRun) redistributes the particles of every lattice point over its 19 directions by calculateWeight
+//				and corrects the rounding so that no particle is lost or created. writes the result to the second buffer
+//	stream:		(secondRun) every lattice point pulls the particles heading towards it from its neighbors in the second buffer,
+//				at the boundary it takes the reflected direction of its own instead, see inverse_lookup_table.
+//				writes the result back to the first buffer and keeps the particle count of every lattice point for emit_points
+//
+//the lattice is stored as on the GPU: the directions of a lattice point are bits_per_direction bit fields,
+//packed from the most significant bit of its first 32 bit word on, bytes_per_lattice_point bytes per lattice point, x fastest.
+//the passes run with the direction_codec of bits_per_direction, a fixed one for the widths that have it.
+//the particle counts follow the integer semantics of the shader, down to float to uint conversions that clamp negative values to 0.
+//every lattice point only reads the other buffer and writes its own, so the result doesn't depend on the number of threads.
+class lattice_engine {
+public:
+	static constexpr uint32_t DIRECTIONS = direction_codec::DIRECTIONS;
+	static constexpr uint32_t MAX_BITS_PER_DIRECTION = direction_codec::MAX_BITS;
+
+	//z planes per slab of the even fused steps, a lattice point writes the planes next to its own
+	static constexpr uint32_t MIN_SLAB_PLANES = 2;
+
+	//fused only keeps one lattice buffer, and its state can't be turned back into the one of two_pass, so the update is fixed here
+	lattice_engine(const lattice_parameters& params, thread_pool& pool, lattice_update update = lattice_update::two_pass);
+
+	//fills the cube Simulation1::generateInitialLatticeBufferData starts with, the middle third of x and z and all of y
+	void load_initial_cube();
+
+	//runs collide and stream, or the fused sweep
+	void step();
+
+	//the passes of two_pass
+	void collide();
+	void stream();
+
+	lattice_update get_lattice_update() const;
+
+	//the render points of the lattice points with more than particle_threshold particles after the last stream, see point_emitter
+	//points needs room for max_points, returns the number of points written
+	size_t emit_points(float4* points) const;
+	size_t max_points() const;
+
+	uint32_t lattice_count() const;
+	//the particles stored in the slot of direction dir of lattice point i = (z * dim[1] + y) * dim[0] + x,
+	//for fused these are collided and in every other step in the swapped order, see lattice_update
+	uint32_t direction(uint32_t i, uint32_t dir) const;
+	//particles per lattice point after the last stream
+	const std::vector<uint32_t>& sums() const;
+	//particles stored in the whole lattice
+	uint64_t total_particles() const;
+
+	//FNV-1a hash over the lattice buffer, for comparing runs
+	uint64_t state_hash() const;
+
+	const lattice_parameters& parameters() const;
+
+private:
+	lattice_parameters params;
+	thread_pool& pool;
+	point_emitter emitter;
+	//for everything outside of the passes
+	direction_codec::generic codec;
+	lattice_update update;
+	//whether the last fused step left the directions in the swapped order
+	bool swapped;
+
+	uint32_t words_per_point;
+	uint32_t max_value;
+
+	//normalized direction vectors, and the part of calculateWeight that only depends on the direction
+	float unit_vectors[DIRECTIONS][3];
+	float direction_weights[DIRECTIONS];
+	//offset of the lattice point a direction pulls from when streaming, in lattice points
+	int64_t pull_offsets[DIRECTIONS];
+
+	//the state between the steps, and the result of collide that stream reads, which fused doesn't need
+	std::vector<uint32_t> lattice;
+	std::vector<uint32_t> collided;
+	std::vector<uint32_t> point_sums;
+
+	//firstRun on the particles of one lattice point
+	void collide_values(uint32_t* values) const;
+	template<class Codec>
+	void collide_point(const Codec& codec, const uint32_t* in, uint32_t* out) const;
+	//the part of calculateWeight that depends on the alignment of every direction with the momentum,
+	//unit_momentum is the normalized momentum, NaN if the momentum is 0 as in the shader
+	void momentum_weights(const float* unit_momentum, uint32_t particle_count, float* components) const;
+	//calculateWeight, momentum_component is the one of momentum_weights
+	float weight(uint32_t dir, const float* momentum, float momentum_component, float equilibrium_factor, float speed_of_sound_squared) const;
+	//the lattice point secondRun reads direction dir of lattice point (x, y, z) from, source_dir becomes the direction it reads
+	size_t pull_source(uint32_t x, uint32_t y, uint32_t z, uint32_t dir, uint32_t& source_dir) const;
+
+	//streams the lattice points of the row (y, z)
+	template<class Codec>
+	void stream_row(const Codec& codec, uint32_t y, uint32_t z);
+
+	void fused_step();
+	//the even fused step of the z planes [z_begin, z_end)
+	template<class Codec>
+	void fused_pull(const Codec& codec, uint32_t z_begin, uint32_t z_end);
+	//the odd fused step of the lattice points [begin, end)
+	template<class Codec>
+	void fused_local(const Codec& codec, size_t begin, size_t end);
+};
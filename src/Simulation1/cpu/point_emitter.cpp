@@ -0,0 +1,70 @@
+#include "point_emitter.h"
+
+#include "src/Utility/parallel_primitives.h"
+#include "src/Utility/tracer.h"
+
+#include <stdexcept>
+
+point_emitter::point_emitter(uint32_t dim_x, uint32_t dim_y, uint32_t dim_z, float unit_length, uint32_t points_per_lattice, uint32_t particle_threshold) :
+	dim_x(dim_x),
+	dim_y(dim_y),
+	dim_z(dim_z),
+	unit_length(unit_length),
+	points_per_point(points_per_lattice),
+	particle_threshold(particle_threshold)
+{
+	if(points_per_lattice != 1 && points_per_lattice != 8) {
+		throw std::runtime_error("a lattice point emits either 1 or 8 points");
+	}
+	if(dim_x == 0 || dim_y == 0 || dim_z == 0 || static_cast<uint64_t>(dim_x) * dim_y * dim_z > 0xFFFFFFFF) {
+		throw std::runtime_error("the lattice has to have between 1 and 2^32 - 1 points");
+	}
+}
+
+uint32_t point_emitter::lattice_count() const{
+	return dim_x * dim_y * dim_z;
+}
+
+uint32_t point_emitter::points_per_lattice() const{
+	return points_per_point;
+}
+
+size_t point_emitter::max_points() const{
+	return static_cast<size_t>(lattice_count()) * points_per_point;
+}
+
+size_t point_emitter::emit(thread_pool& pool, const uint32_t* sums, float4* points) const{
+	TRACE_SCOPE("emit points");
+
+	const uint32_t threshold = particle_threshold;
+
+	size_t emitted = parallel_primitives::compact_scatter(pool, lattice_count(),
+		[&](size_t i) { return sums[i] > threshold; },
+		[](size_t) {},
+		[&](size_t i, size_t position) { lattice_points(static_cast<uint32_t>(i), sums[i], points + position * points_per_point); });
+
+	return emitted * points_per_point;
+}
+
+void point_emitter::lattice_points(uint32_t i, uint32_t sum, float4* out) const{
+	float x = (i % dim_x) * unit_length;
+	float y = (i / dim_x % dim_y) * unit_length;
+	float z = (i / dim_x / dim_y) * unit_length;
+	float w = static_cast<float>(sum);
+
+	if(points_per_point == 1) {
+		out[0] = make_float4(x, y, z, w);
+		return;
+	}
+
+	//the corners of a cube of half the lattice spacing
+	const float offset = unit_length * 0.25f;
+
+	for(int corner = 0; corner < 8; corner++) {
+		out[corner] = make_float4(
+			x + (corner & 1 ? offset : -offset),
+			y + (corner & 2 ? offset : -offset),
+			z + (corner & 4 ? offset : -offset),
+			w);
+	}
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "src/Utility/float4x4.h"
+#include "src/Utility/thread_pool.h"
+
+#include <cstddef>
+#include <cstdint>
+
+//CPU version of appendPoints (shader/compute/compute_shader.hlsl): the render points of every lattice point with more than particle_threshold particles
+//
+//the shader appends them to point_buffer through its hidden counter, so their order changes from frame to frame
+//and every emitting lattice point increments the same atomic. here the emission is a stream compaction instead:
+//the lattice is cut into blocks, every block counts its lattice points above the threshold, an exclusive scan of the counts
+//gives every block its first slot, and a second pass writes the points of the block from there (see parallel_primitives::compact_scatter).
+//the points come out in lattice order, x fastest, followed by y and z as in the lattice index of the shader,
+//whatever the number of threads, and go straight into the vertex array without a shared counter.
+class point_emitter {
+public:
+	//x, y and z lattice points, the distance between two of them in lattice space, and 1 or 8 points per lattice point
+	point_emitter(uint32_t dim_x, uint32_t dim_y, uint32_t dim_z, float unit_length, uint32_t points_per_lattice, uint32_t particle_threshold);
+
+	uint32_t lattice_count() const;
+	uint32_t points_per_lattice() const;
+	//the most points emit writes, what the vertex array has to hold
+	size_t max_points() const;
+
+	//sums[i] is the particle count of the lattice point i = (z * dim_y + y) * dim_x + x
+	//writes (position, particle count) of the emitted points to points, which needs room for max_points, and returns how many there are
+	size_t emit(thread_pool& pool, const uint32_t* sums, float4* points) const;
+
+	//writes the points_per_lattice points of lattice point i with the given particle count from out on, in the order of appendPoints
+	void lattice_points(uint32_t i, uint32_t sum, float4* out) const;
+
+private:
+	uint32_t dim_x;
+	uint32_t dim_y;
+	uint32_t dim_z;
+	float unit_length;
+	uint32_t points_per_point;
+	uint32_t particle_threshold;
+};
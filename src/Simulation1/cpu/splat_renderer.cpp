@@ -0,0 +1,425 @@
+#include "splat_renderer.h"
+#include "src/Utility/parallel_primitives.h"
+#include "src/Utility/pixel_math.h"
+#include "src/Utility/tracer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+	//the visibility pass refreshes the farthest depth of the tile blocks after this many points
+	constexpr int REFRESH_INTERVAL = 64;
+
+	float3 lerp(float3 a, float3 b, float t){
+		return a + (b - a) * t;
+	}
+
+	float3 lerp3(float3 a, float3 b, float3 c, float t){
+		return lerp(lerp(a, b, t), lerp(b, c, t), t);
+	}
+
+	float smoothstep(float low, float high, float x){
+		float t = std::min(std::max((x - low) / (high - low), 0.f), 1.f);
+		return t * t * (3.f - 2.f * t);
+	}
+
+	//the blend operation of the position target
+	float3 blend_max(float3 a, float3 b){
+		return make_float3(std::fmax(a.x, b.x), std::fmax(a.y, b.y), std::fmax(a.z, b.z));
+	}
+}
+
+constexpr uint32_t splat_renderer::TILE_SIZE;
+constexpr int32_t splat_renderer::BLOCK_SIZE;
+constexpr int32_t splat_renderer::BLOCKS_PER_TILE;
+constexpr float splat_renderer::GROUND_EXTENT;
+
+splat_parameters splat_parameters::from_simulation1(float aspect_ratio){
+	splat_parameters params;
+
+	params.radius = 1.f / 30.f;
+	params.epsilon = 0.1f;
+	params.particle_threshold = 1500;
+	params.color_upper_bound = 0;
+	params.ground = true;
+
+	params.eye = make_float3(0.f, 1.75f, -5.5f);
+	params.light = make_float3(0.f, 2.f, -3.f);
+
+	params.world_liquid = translation(-1.5f, 0.2f, -3.f);
+	params.view = look_at_lh(params.eye, make_float3(0.f, 0.f, 1.f), make_float3(0.f, 1.f, 0.f));
+	params.projection = perspective_fov_lh(1.5708f, aspect_ratio, 0.1f, 100.f);
+
+	return params;
+}
+
+splat_renderer::splat_renderer(uint32_t width, uint32_t height, const splat_parameters& params, thread_pool& pool) :
+	target_width(width),
+	target_height(height),
+	params(params),
+	pool(pool),
+	binner(width, height, TILE_SIZE, pool),
+	view_projection(params.view * params.projection),
+	inverse_view(rigid_inverse(params.view)),
+	worker_accumulators(pool.size(), std::vector<accumulator>(TILE_SIZE * TILE_SIZE)),
+	color_target(width * height, 0),
+	depth_target(width * height, 1.f),
+	visible_splats(0)
+{}
+
+void splat_renderer::render(const float4* points, size_t count){
+	render(points, nullptr, count);
+}
+
+void splat_renderer::render(const float4* points, const float* radii, size_t count){
+	TRACE_SCOPE("splat_renderer");
+
+	setup(points, radii, count);
+	binner.bin(bounds.data(), count);
+	shade();
+}
+
+uint32_t splat_renderer::width() const{
+	return target_width;
+}
+
+uint32_t splat_renderer::height() const{
+	return target_height;
+}
+
+const splat_parameters& splat_renderer::parameters() const{
+	return params;
+}
+
+const std::vector<uint32_t>& splat_renderer::color() const{
+	return color_target;
+}
+
+const std::vector<float>& splat_renderer::depth() const{
+	return depth_target;
+}
+
+size_t splat_renderer::visible_count() const{
+	return visible_splats;
+}
+
+uint64_t splat_renderer::fragment_count() const{
+	uint64_t total = 0;
+	for(uint64_t fragments : tile_fragments) {
+		total += fragments;
+	}
+	return total;
+}
+
+//the vertex and geometry shaders of both passes
+void splat_renderer::setup(const float4* points, const float* radii, size_t count){
+	TRACE_SCOPE("setup");
+
+	splats.resize(count);
+	visibility_bounds.resize(count);
+	blending_bounds.resize(count);
+	bounds.resize(count);
+
+	const bool uniform_color = params.particle_threshold > params.color_upper_bound;
+	visible_splats = parallel_primitives::transform_reduce<size_t>(pool, count, [&](size_t i) -> size_t {
+		splat& s = splats[i];
+		pixel_rect& v = visibility_bounds[i];
+		pixel_rect& b = blending_bounds[i];
+
+		float4 world = transform_point(make_float3(points[i].x, points[i].y, points[i].z), params.world_liquid);
+		s.world_position = make_float3(world.x, world.y, world.z);
+		s.radius = radii ? radii[i] : params.radius;
+
+		float3 pushed_back = s.world_position + params.epsilon * normalize(s.world_position - params.eye);
+
+		bool visible_in_depth = project(transform_point(pushed_back, view_projection), s.radius, s.visibility, v);
+		bool visible_in_blending = project(transform_point(s.world_position, view_projection), s.radius, s.blending, b);
+
+		if(visible_in_depth && visible_in_blending) {
+			bounds[i].first_x = std::min(v.first_x, b.first_x);
+			bounds[i].end_x = std::max(v.end_x, b.end_x);
+			bounds[i].first_y = std::min(v.first_y, b.first_y);
+			bounds[i].end_y = std::max(v.end_y, b.end_y);
+		} else {
+			bounds[i] = visible_in_depth ? v : b;
+		}
+
+		if(!visible_in_depth && !visible_in_blending) {
+			return 0;
+		}
+
+		if(uniform_color) {
+			s.color = make_float3(0.1f, 0.58f, 0.69f);
+		} else {
+			float t = smoothstep(static_cast<float>(params.particle_threshold), static_cast<float>(params.color_upper_bound), points[i].w);
+			s.color = lerp3(make_float3(0.9f, 0.2f, 0.1f), make_float3(0.f, 0.f, 1.f), make_float3(0.2f, 0.9f, 0.3f), t);
+		}
+		return 1;
+	});
+}
+
+bool splat_renderer::project(float4 clip, float radius, quad& q, pixel_rect& r) const{
+	r.first_x = r.end_x = r.first_y = r.end_y = 0;
+
+	//all four corners share z and w, so the quad is clipped against the depth range as a whole
+	if(!(clip.w > 0.f) || !(clip.z >= 0.f && clip.z <= clip.w)) {
+		return false;
+	}
+
+	float half_width = radius / clip.w * 0.5f * target_width;
+	float half_height = radius / clip.w * 0.5f * target_height;
+
+	q.center_x = (clip.x / clip.w + 1.f) * 0.5f * target_width;
+	q.center_y = (1.f - clip.y / clip.w) * 0.5f * target_height;
+	q.offset_scale_x = 2.f * clip.w / target_width;
+	q.offset_scale_y = -2.f * clip.w / target_height;
+	q.depth = clip.z / clip.w;
+
+	r.first_x = pixel_bound(q.center_x - half_width, target_width);
+	r.end_x = pixel_bound(q.center_x + half_width, target_width);
+	r.first_y = pixel_bound(q.center_y - half_height, target_height);
+	r.end_y = pixel_bound(q.center_y + half_height, target_height);
+
+	return r.first_x < r.end_x && r.first_y < r.end_y;
+}
+
+bool splat_renderer::ground_fragment(int32_t x, int32_t y, float& depth, float3& position) const{
+	float ndc_x = (x + 0.5f) / target_width * 2.f - 1.f;
+	float ndc_y = 1.f - (y + 0.5f) / target_height * 2.f;
+
+	//the point of the pixel on the view space plane z = 1
+	float3 direction = transform_vector(make_float3(ndc_x / params.projection.m[0][0], ndc_y / params.projection.m[1][1], 1.f), inverse_view);
+	float t = -params.eye.y / direction.y;
+
+	if(!(t > 0.f)) {
+		return false;
+	}
+
+	position = params.eye + direction * t;
+	position.y = 0.f;
+
+	if(!(std::abs(position.x) <= GROUND_EXTENT && std::abs(position.z) <= GROUND_EXTENT)) {
+		return false;
+	}
+
+	float4 clip = transform_point(position, view_projection);
+	depth = clip.z / clip.w;
+
+	return depth >= 0.f && depth <= 1.f;
+}
+
+void splat_renderer::farthest_depths(const pixel_rect& tile, float* block_depths) const{
+	std::fill(block_depths, block_depths + BLOCKS_PER_TILE * BLOCKS_PER_TILE, 0.f);
+
+	for(int32_t y = tile.first_y; y < tile.end_y; y++) {
+		const float* depth = depth_target.data() + y * target_width;
+		float* blocks = block_depths + (y - tile.first_y) / BLOCK_SIZE * BLOCKS_PER_TILE;
+
+		for(int32_t x = tile.first_x; x < tile.end_x; x++) {
+			float& block = blocks[(x - tile.first_x) / BLOCK_SIZE];
+			block = std::max(block, depth[x]);
+		}
+	}
+}
+
+bool splat_renderer::is_occluded(float depth, const pixel_rect& r, const pixel_rect& tile, const float* block_depths) const{
+	int32_t first_x = (std::max(r.first_x, tile.first_x) - tile.first_x) / BLOCK_SIZE;
+	int32_t end_x = (std::min(r.end_x, tile.end_x) - tile.first_x - 1) / BLOCK_SIZE;
+	int32_t first_y = (std::max(r.first_y, tile.first_y) - tile.first_y) / BLOCK_SIZE;
+	int32_t end_y = (std::min(r.end_y, tile.end_y) - tile.first_y - 1) / BLOCK_SIZE;
+
+	for(int32_t y = first_y; y <= end_y; y++) {
+		for(int32_t x = first_x; x <= end_x; x++) {
+			if(depth <= block_depths[y * BLOCKS_PER_TILE + x]) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+void splat_renderer::shade(){
+	TRACE_SCOPE("shade");
+
+	tile_fragments.assign(binner.tile_count(), 0);
+
+	pool.run(binner.tile_count(), [this](size_t tile, unsigned worker) {
+		shade_tile(static_cast<uint32_t>(tile), worker_accumulators[worker]);
+	});
+}
+
+//all three passes for the pixels of one tile, the points in the order they were given
+void splat_renderer::shade_tile(uint32_t tile, std::vector<accumulator>& accumulators){
+	const pixel_rect t = binner.tile_rect(tile);
+
+	//--------visibility pass--------
+	for(int32_t y = t.first_y; y < t.end_y; y++) {
+		float* depth = depth_target.data() + y * target_width;
+
+		for(int32_t x = t.first_x; x < t.end_x; x++) {
+			float ground_depth;
+			float3 ground_position;
+
+			depth[x] = 1.f;
+			if(params.ground && ground_fragment(x, y, ground_depth, ground_position)) {
+				depth[x] = ground_depth;
+			}
+		}
+	}
+
+	//depths only ever decrease, so a point behind the farthest depth of every block it overlaps can't pass the depth test
+	float block_depths[BLOCKS_PER_TILE * BLOCKS_PER_TILE];
+	int until_refresh = 0;
+
+	for(const uint32_t* i = binner.begin(tile); i != binner.end(tile); i++) {
+		const quad& q = splats[*i].visibility;
+		const pixel_rect& r = visibility_bounds[*i];
+		const float r2 = splats[*i].radius * splats[*i].radius;
+
+		if(until_refresh-- == 0) {
+			farthest_depths(t, block_depths);
+			until_refresh = REFRESH_INTERVAL - 1;
+		}
+		if(is_occluded(q.depth, r, t, block_depths)) {
+			continue;
+		}
+
+		for(int32_t y = std::max(r.first_y, t.first_y); y < std::min(r.end_y, t.end_y); y++) {
+			float offset_y = (y + 0.5f - q.center_y) * q.offset_scale_y;
+			float offset_y2 = offset_y * offset_y;
+
+			float* depth = depth_target.data() + y * target_width;
+
+			for(int32_t x = std::max(r.first_x, t.first_x); x < std::min(r.end_x, t.end_x); x++) {
+				float offset_x = (x + 0.5f - q.center_x) * q.offset_scale_x;
+
+				if(offset_x * offset_x + offset_y2 <= r2 && q.depth <= depth[x]) {
+					depth[x] = q.depth;
+				}
+			}
+		}
+	}
+
+	//--------blending pass--------
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+	const float3 view_x = transform_vector(make_float3(1.f, 0.f, 0.f), inverse_view);
+	const float3 view_y = transform_vector(make_float3(0.f, 1.f, 0.f), inverse_view);
+	const float3 view_z = transform_vector(make_float3(0.f, 0.f, 1.f), inverse_view);
+
+	const int32_t tile_width = t.end_x - t.first_x;
+
+	for(accumulator& a : accumulators) {
+		a.position = make_float3(nan, nan, nan);
+		a.normal = make_float3(0.f, 0.f, 0.f);
+		a.color = make_float3(0.f, 0.f, 0.f);
+		a.weight = 0.f;
+	}
+
+	uint64_t fragments = 0;
+
+	farthest_depths(t, block_depths);
+
+	for(const uint32_t* i = binner.begin(tile); i != binner.end(tile); i++) {
+		const splat& s = splats[*i];
+		const quad& q = s.blending;
+		const pixel_rect& r = blending_bounds[*i];
+		const float r2 = s.radius * s.radius;
+
+		//most points inside the liquid lie further than epsilon behind the visible surface
+		if(is_occluded(q.depth, r, t, block_depths)) {
+			continue;
+		}
+
+		for(int32_t y = std::max(r.first_y, t.first_y); y < std::min(r.end_y, t.end_y); y++) {
+			float offset_y = (y + 0.5f - q.center_y) * q.offset_scale_y;
+			float offset_y2 = offset_y * offset_y;
+
+			const float* depth = depth_target.data() + y * target_width;
+			accumulator* row = accumulators.data() + (y - t.first_y) * tile_width - t.first_x;
+
+			for(int32_t x = std::max(r.first_x, t.first_x); x < std::min(r.end_x, t.end_x); x++) {
+				float offset_x = (x + 0.5f - q.center_x) * q.offset_scale_x;
+				float d2 = offset_x * offset_x + offset_y2;
+
+				//discarded, or behind the visible surface
+				if(d2 > r2 || !(q.depth <= depth[x])) {
+					continue;
+				}
+				fragments++;
+
+				//the fragment is the point of the sphere facing the viewer, so its view space depth is negative
+				float frag_depth = -std::sqrt(r2 - d2);
+				float3 world_offset = offset_x * view_x + offset_y * view_y + frag_depth * view_z;
+				float3 normal = normalize(world_offset);
+
+				float weight = std::max(0.f, 1.f - std::sqrt(d2) / s.radius) * std::max(0.f, (params.epsilon + frag_depth) / params.epsilon);
+
+				accumulator& a = row[x];
+				a.position = blend_max(a.position, s.world_position + world_offset);
+				a.normal += weight * normal;
+				a.color += weight * s.color;
+				a.weight += weight;
+			}
+		}
+	}
+
+	if(params.ground) {
+		for(int32_t y = t.first_y; y < t.end_y; y++) {
+			const float* depth = depth_target.data() + y * target_width;
+			accumulator* row = accumulators.data() + (y - t.first_y) * tile_width - t.first_x;
+
+			for(int32_t x = t.first_x; x < t.end_x; x++) {
+				float ground_depth;
+				float3 ground_position;
+
+				if(!ground_fragment(x, y, ground_depth, ground_position) || !(ground_depth <= depth[x])) {
+					continue;
+				}
+
+				//a chessboard of 10 x 10 fields over the texture coordinates
+				int field_x = static_cast<int>((ground_position.x + GROUND_EXTENT) / (2.f * GROUND_EXTENT) * 10.f);
+				int field_z = static_cast<int>((ground_position.z + GROUND_EXTENT) / (2.f * GROUND_EXTENT) * 10.f);
+				float value = (field_x + field_z) & 1 ? 0.2f : 0.8f;
+
+				accumulator& a = row[x];
+				a.position = blend_max(a.position, ground_position);
+				a.normal += make_float3(0.f, 1.f, 0.f);
+				a.color += make_float3(value, value, value);
+				a.weight += 1.f;
+			}
+		}
+	}
+
+	//--------shading pass--------
+	for(int32_t y = t.first_y; y < t.end_y; y++) {
+		uint32_t* color = color_target.data() + y * target_width;
+		const accumulator* row = accumulators.data() + (y - t.first_y) * tile_width - t.first_x;
+
+		for(int32_t x = t.first_x; x < t.end_x; x++) {
+			const accumulator& a = row[x];
+
+			//nothing was drawn
+			if(std::isnan(a.position.x)) {
+				color[x] = pack_color(make_float3(0.1f, 0.1f, 0.1f));
+				continue;
+			}
+
+			float3 c = a.color / a.weight;
+
+			float3 L = normalize(params.light - a.position);
+			float3 V = normalize(params.eye - a.position);
+			float3 N = normalize(a.normal);
+			float3 R = reflect(-V, N);
+
+			const float ambient = 0.2f;
+
+			float3 final_color = c * ambient + c * std::max(0.f, (1.f - ambient) * dot(N, L)) +
+				make_float3(1.f, 1.f, 1.f) * std::pow(std::max(0.f, dot(L, R)), 64.f);
+
+			color[x] = pack_color(final_color);
+		}
+	}
+
+	tile_fragments[tile] = fragments;
+}
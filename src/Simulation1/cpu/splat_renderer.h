@@ -0,0 +1,145 @@
+#pragma once
+
+#include "src/Utility/float3.h"
+#include "src/Utility/float4x4.h"
+#include "src/Utility/thread_pool.h"
+#include "src/Utility/tile_binner.h"
+
+#include <cstdint>
+#include <vector>
+
+//the constants Simulation1::LoadAssets hands to the shaders
+struct splat_parameters {
+	//radius of the quads in clip space units, 1 / LatticePointsPerUnit
+	float radius;
+	//VisiblityPassPointOffset: how far the visibility pass pushes the points away from the eye,
+	//and the view space depth over which the blending weights fall off
+	float epsilon;
+	//the liquid gets a color gradient over the particle counts [particle_threshold, color_upper_bound],
+	//a uniform color if particle_threshold > color_upper_bound
+	uint32_t particle_threshold;
+	uint32_t color_upper_bound;
+	//draw the chessboard ground of Simulation1
+	bool ground;
+
+	float4x4 world_liquid;
+	float4x4 view;
+	//a perspective_fov_lh matrix
+	float4x4 projection;
+
+	float3 eye;
+	float3 light;
+
+	//the values of Simulation1, with UniformColor
+	static splat_parameters from_simulation1(float aspect_ratio);
+};
+
+//headless CPU version of the three pass renderer of Simulation1, for points as the compute shader appends them (position, particle count)
+//
+//	visibility:	(visibility/*.hlsl) fills the depth buffer with the ground and with every point pushed back by epsilon
+//	blending:	(blending/*.hlsl) every point that lies at most about epsilon in front of the visible surface adds its sphere
+//				to float accumulation buffers, weighted as in Adams et al.: the positions are combined with max, the weighted normals
+//				and colors are summed up. the ground adds its fragments with weight 1
+//	shading:	(shading/deferred_shading.hlsl) normalizes the sums and applies the Phong model
+//
+//the points are binned into screen tiles (see tile_binner), and every tile runs all three passes on its own,
+//with the accumulation buffers of the tile in the memory of its worker.
+//within a tile the points are drawn in the order they were given, so the sums and the image don't depend on the number of threads.
+//the ground is not rasterized as two triangles, every pixel intersects its view ray with the ground plane instead.
+class splat_renderer {
+public:
+	//pixels per side of a screen tile
+	static constexpr uint32_t TILE_SIZE = 32;
+	//pixels per side of the blocks whose farthest depth is tracked to skip hidden points
+	static constexpr int32_t BLOCK_SIZE = 8;
+	static constexpr int32_t BLOCKS_PER_TILE = TILE_SIZE / BLOCK_SIZE;
+	//half the side length of the ground square in the xz plane
+	static constexpr float GROUND_EXTENT = 5.f;
+
+	splat_renderer(uint32_t width, uint32_t height, const splat_parameters& params, thread_pool& pool);
+
+	//the points are in the space of the lattice, w is the number of particles the point stands for
+	void render(const float4* points, size_t count);
+	//points of their own radius each instead of params.radius, like the splats of particle_lod
+	void render(const float4* points, const float* radii, size_t count);
+
+	uint32_t width() const;
+	uint32_t height() const;
+	const splat_parameters& parameters() const;
+
+	//R8G8B8A8 pixels, red in the lowest byte, rows from top to bottom
+	const std::vector<uint32_t>& color() const;
+	//the depth buffer after the visibility pass
+	const std::vector<float>& depth() const;
+
+	//points drawn in at least one pass and liquid fragments added to the accumulation buffers in the last render
+	size_t visible_count() const;
+	uint64_t fragment_count() const;
+
+private:
+	//a quad after the viewport transform
+	struct quad {
+		float center_x;
+		float center_y;
+		//clip space offset per pixel
+		float offset_scale_x;
+		float offset_scale_y;
+		float depth;
+	};
+
+	struct splat {
+		quad visibility;
+		quad blending;
+		float3 world_position;
+		float3 color;
+		float radius;
+	};
+
+	//a pixel of the accumulation buffers, the position and normal targets are float4 on the GPU, but their w is constant
+	struct accumulator {
+		float3 position;
+		float3 normal;
+		float3 color;
+		float weight;
+	};
+
+	uint32_t target_width;
+	uint32_t target_height;
+	splat_parameters params;
+
+	thread_pool& pool;
+	tile_binner binner;
+
+	float4x4 view_projection;
+	float4x4 inverse_view;
+
+	std::vector<splat> splats;
+	std::vector<pixel_rect> visibility_bounds;
+	std::vector<pixel_rect> blending_bounds;
+	//union of both, what the points are binned by
+	std::vector<pixel_rect> bounds;
+
+	//per worker, TILE_SIZE^2 pixels
+	std::vector<std::vector<accumulator>> worker_accumulators;
+	std::vector<uint64_t> tile_fragments;
+
+	std::vector<uint32_t> color_target;
+	std::vector<float> depth_target;
+
+	size_t visible_splats;
+
+	//radii[i], or params.radius without radii
+	void setup(const float4* points, const float* radii, size_t count);
+	void shade();
+	void shade_tile(uint32_t tile, std::vector<accumulator>& accumulators);
+
+	//the farthest depth of every block of the tile
+	void farthest_depths(const pixel_rect& tile, float* block_depths) const;
+	//true if every pixel of r within the tile is closer than depth
+	bool is_occluded(float depth, const pixel_rect& r, const pixel_rect& tile, const float* block_depths) const;
+
+	//clip space position to pixels, returns false if the quad lies outside the depth range
+	bool project(float4 clip, float radius, quad& q, pixel_rect& r) const;
+	//the ground fragment at the center of the given pixel, false if the ray misses the ground square or the depth range
+	bool ground_fragment(int32_t x, int32_t y, float& depth, float3& position) const;
+};
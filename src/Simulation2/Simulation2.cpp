@@ -1,10 +1,13 @@
 #include "src/Utility/stdafx.h"
 #include "Simulation2.h" 
+#include "src/Utility/tracer.h"
 
 #include <chrono>
 #include <functional>
 
 //#define DEBUG_SYNCRO
+//#define RECORD_TRAJECTORY
+//#define TRACE_TIMELINE
 
 Simulation2::Simulation2(UINT width, UINT height, std::wstring name) :
   DXSample(width, height, name),
@@ -16,6 +19,12 @@ Simulation2::Simulation2(UINT width, UINT height, std::wstring name) :
 }
 
 void Simulation2::OnInit(){
+#ifdef TRACE_TIMELINE
+  //the compute and render threads record about 8 events per step or frame, this covers a few minutes
+  tracer::instance().start(1 << 20);
+#endif
+  tracer::instance().set_thread_name("render");
+
   LoadPipeline();
   LoadAssets();
   spawn_compute_thread();
@@ -134,7 +143,7 @@ void Simulation2::LoadAssets(){
 
     std::vector<ComPtr<ID3D12Resource>> upload_heaps;  
 
-    std::shared_ptr<buffer> vertex_buffer = std::make_shared<buffer>(vertex_buffer_com, num_elements, stride, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    vertex_buffer = std::make_shared<buffer>(vertex_buffer_com, num_elements, stride, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
 
     vertex_buffer->get()->SetName(L"vertex_buffer");
 
@@ -146,6 +155,13 @@ void Simulation2::LoadAssets(){
 
     WaitForGpu();
   }
+
+#ifdef RECORD_TRAJECTORY
+  {//trajectory output
+    const float domain_min[3] = {0.f, 0.f, 0.f};
+    trajectory = std::make_unique<trajectory_writer>("trajectory.lqtr", PARTICLE_COUNT, domain_min, SIMULATION_BOX_BOUNDARY);
+  }
+#endif
 }
 
 
@@ -154,17 +170,23 @@ void Simulation2::spawn_compute_thread(){
 }
 
 void Simulation2::async_compute_loop(){
+  tracer::instance().set_thread_name("compute");
 
   auto start = std::chrono::system_clock::now();
+  UINT64 step = 0;
 
   while(!shut_down.load(std::memory_order_relaxed)) {
+    TRACE_SCOPE("compute step");
+
     auto now = std::chrono::system_clock::now();
     std::chrono::milliseconds duration = std::chrono::duration_cast<std::chrono::milliseconds>(now - start);
 
     ID3D12CommandList* command_lists[] = {compute_obj.populate_command_list(static_cast<float>(duration.count() * 0.001f))};
 
     {
+      tracer::instance().begin("wait for mutex");
       std::lock_guard<std::mutex> lock(mutex);
+      tracer::instance().end("wait for mutex");
 
       UINT64 render_value = render_fence_value.load(std::memory_order_seq_cst);
 
@@ -173,6 +195,7 @@ void Simulation2::async_compute_loop(){
 #ifdef DEBUG_SYNCRO
         OutputDebugStringA((std::string("compute run #") + std::to_string(compute_fence_value + 1) + " waiting for render run #" + std::to_string(render_value) + "\n").c_str());
 #endif
+        tracer::instance().instant("queue waits for render fence");
         compute_queue->Wait(render_fence.Get(), render_value);
       }
 
@@ -180,19 +203,42 @@ void Simulation2::async_compute_loop(){
       compute_queue->Signal(compute_fence.Get(), ++compute_fence_value);
     }
 
-    compute_fence->SetEventOnCompletion(compute_fence_value.load(std::memory_order_relaxed), compute_fence_event);
-    WaitForSingleObject(compute_fence_event, INFINITE);
+    {
+      TRACE_SCOPE("wait for compute fence");
+      compute_fence->SetEventOnCompletion(compute_fence_value.load(std::memory_order_relaxed), compute_fence_event);
+      WaitForSingleObject(compute_fence_event, INFINITE);
+    }
+
+    if(trajectory && step % TRAJECTORY_INTERVAL == 0) {
+      record_trajectory(step);
+    }
+    step++;
 
    // shut_down.store(true);
   }
 }
 
+//hands the positions of the last finished compute step to the trajectory writer
+//the vertex buffer lives in a CPU visible heap, so it can be read directly once the compute fence has passed
+void Simulation2::record_trajectory(UINT64 step){
+  float* positions = nullptr;
+  CD3DX12_RANGE read_range(0, vertex_buffer->size());
+
+  ThrowIfFailed(vertex_buffer->get()->Map(0, &read_range, reinterpret_cast<void**>(&positions)));
+  trajectory->submit(step, positions);
+  vertex_buffer->get()->Unmap(0, &D3D12_RANGE());
+}
+
 void Simulation2::OnRender(){
+  TRACE_SCOPE("render frame");
+
   UINT backbuffer_idx = swap_chain->GetCurrentBackBufferIndex();
   ID3D12CommandList* command_lists[] = {render_obj.populate_command_list(backbuffer_idx)};
   
   {
+    tracer::instance().begin("wait for mutex");
     std::lock_guard<std::mutex> lock(mutex);
+    tracer::instance().end("wait for mutex");
     
     UINT64 compute_fence_val = compute_fence_value.load(std::memory_order_seq_cst);
 
@@ -200,6 +246,7 @@ void Simulation2::OnRender(){
 #ifdef DEBUG_SYNCRO
       OutputDebugStringA((std::string("render run #") + std::to_string(render_fence_value + 1) + " waiting for compute run #" + std::to_string(compute_fence_val)+ "\n").c_str());
 #endif
+      tracer::instance().instant("queue waits for compute fence");
       graphics_queue->Wait(compute_fence.Get(), compute_fence_val);
     }
 
@@ -210,9 +257,13 @@ void Simulation2::OnRender(){
     ThrowIfFailed(graphics_queue->Signal(render_fence.Get(), fence_value));
   }
   
-  ThrowIfFailed(swap_chain->Present(1, 0));
+  {
+    TRACE_SCOPE("present");
+    ThrowIfFailed(swap_chain->Present(1, 0));
+  }
     
   if(render_fence->GetCompletedValue() < frame_fence_values[swap_chain->GetCurrentBackBufferIndex()]) {
+    TRACE_SCOPE("wait for frame fence");
     render_fence->SetEventOnCompletion(frame_fence_values[swap_chain->GetCurrentBackBufferIndex()], render_fence_event);
     WaitForSingleObject(render_fence_event, INFINITE);
   }
@@ -240,6 +291,23 @@ void Simulation2::OnDestroy(){
 
   CloseHandle(render_fence_event);
   CloseHandle(compute_fence_event);
+
+  if(trajectory) {
+    trajectory->flush();
+    trajectory_writer::statistics stats = trajectory->stats();
+
+    OutputDebugStringA((std::string("trajectory: ") + std::to_string(stats.frames_written) + " frames written, " + std::to_string(stats.frames_dropped) + " dropped, " +
+      "compression ratio " + std::to_string(stats.compression_ratio()) + ", " + std::to_string(stats.throughput_mb_per_second()) + " MB/s\n").c_str());
+
+    trajectory.reset();
+  }
+
+  if(tracer::instance().enabled()) {
+    tracer::instance().stop();
+    tracer::instance().write_chrome_trace("trace.json");
+
+    OutputDebugStringA((std::string("trace: ") + std::to_string(tracer::instance().dropped_events()) + " events dropped\n").c_str());
+  }
 }
 
 void Simulation2::WaitForGpu(){
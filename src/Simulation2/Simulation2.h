@@ -9,6 +9,7 @@
 #include "computation.h"
 #include "frame_constants.h"
 #include "rendering.h"
+#include "trajectory_writer.h"
 
 using namespace DirectX;
 using Microsoft::WRL::ComPtr;
@@ -56,6 +57,9 @@ private:
   std::atomic_bool shut_down;
   UINT64 frame_fence_values[FRAME_COUNT];
 
+  std::shared_ptr<buffer> vertex_buffer;
+  std::unique_ptr<trajectory_writer> trajectory;
+
   void LoadPipeline();
   void LoadAssets();
   void MoveToNextFrame(UINT old_backbuffer_idx);
@@ -63,4 +67,5 @@ private:
 
   void spawn_compute_thread();
   void async_compute_loop();
+  void record_trajectory(UINT64 step);
 };
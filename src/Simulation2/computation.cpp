@@ -1,4 +1,5 @@
 #include "src/Simulation2/computation.h"
+#include "src/Simulation2/sph_kernels.h"
 #include "src/Utility/DXSampleHelper.h"
 #include "my_utils.h"
 
@@ -6,11 +7,11 @@
 
 computation::computation()
 {	
-	constants.density_kernel_constant = 315.f / (64 * XM_PI * pow(frame_constants::KERNEL_RADIUS, 9));
+	constants.density_kernel_constant = poly6_kernel::normalization(frame_constants::KERNEL_RADIUS);
 	constants.particle_count = frame_constants::PARTICLE_COUNT;
 	constants.pressure_constant = frame_constants::PRESSURE_CONSTANT;
 
-	constants.pressure_kernel_constant = -45.f / (XM_PI * pow(frame_constants::KERNEL_RADIUS, 6));
+	constants.pressure_kernel_constant = spiky_kernel::gradient_factor(frame_constants::KERNEL_RADIUS);
 	constants.reference_density = frame_constants::REFERENCE_DENSITY;
 	constants.smoothing_radius = frame_constants::KERNEL_RADIUS;
 
@@ -22,6 +23,8 @@ computation::computation()
 
 	constants.particle_radius = frame_constants::PARTICLE_RADIUS;
 	memcpy(constants.grid_size, frame_constants::GRID_SIZE, sizeof(frame_constants::GRID_SIZE));
+
+	table_generation = 0;
 }
 
 void computation::load_pipeline(ComPtr<ID3D12Device> device){
@@ -65,13 +68,14 @@ ID3D12CommandList* computation::load_assets(ComPtr<ID3D12Device> device, std::sh
 		force_range[1].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 4, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_VOLATILE);
 		force_range[2].Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 2, 4, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_VOLATILE);
 		
-		CD3DX12_ROOT_PARAMETER1 signature_parameter[6];
+		CD3DX12_ROOT_PARAMETER1 signature_parameter[7];
 		signature_parameter[SHADER_ORDER::CREATE_GRID].InitAsDescriptorTable(_countof(grid_range), grid_range);
 		signature_parameter[SHADER_ORDER::SORT].InitAsDescriptorTable(_countof(sort_range), sort_range);
 		signature_parameter[SHADER_ORDER::CREATE_TABLE].InitAsDescriptorTable(_countof(table_range), table_range);
 		signature_parameter[SHADER_ORDER::DENSITY_EVALUATION].InitAsDescriptorTable(_countof(density_range), density_range);
 		signature_parameter[SHADER_ORDER::APPLY_FORCES].InitAsDescriptorTable(_countof(force_range), force_range);
 		signature_parameter[SORTING_CONTANTS_SLOT].InitAsConstants(sizeof(SortParameters) >> 2, 1, 0);
+		signature_parameter[TABLE_CONSTANTS_SLOT].InitAsConstants(1, 5, 0);
 
 		CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC root_signature_desc;
 		root_signature_desc.Init_1_1(_countof(signature_parameter), signature_parameter);
@@ -184,7 +188,8 @@ ID3D12CommandList* computation::load_assets(ComPtr<ID3D12Device> device, std::sh
 	CD3DX12_RANGE readRange(0, 0);
 	ThrowIfFailed(lookup_reset_buffer->Map(0, &readRange, reinterpret_cast<void**>(&reset_buffer)));
 
-	memset(reset_buffer, 0xFFFF, LOOKUP_TABLE_SIZE);
+	//generation 0 is never used, so a zeroed table is empty
+	memset(reset_buffer, 0, LOOKUP_TABLE_SIZE);
 
 	lookup_reset_buffer->Unmap(0, nullptr);
 	//command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(lookup_reset_buffer.Get(), D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_COPY_SOURCE));
@@ -285,7 +290,7 @@ ID3D12CommandList* computation::load_assets(ComPtr<ID3D12Device> device, std::sh
 	table_uav_desc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
 	table_uav_desc.Buffer.FirstElement = 0;
 	table_uav_desc.Buffer.NumElements = frame_constants::GRID_SIZE_FLAT;
-	table_uav_desc.Buffer.StructureByteStride = sizeof(UINT);
+	table_uav_desc.Buffer.StructureByteStride = sizeof(UINT) * 2;
 	table_uav_desc.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_NONE;
 
 	device->CreateUnorderedAccessView(lookup_buffer.Get(), nullptr, &table_uav_desc, heap_handle);
@@ -429,17 +434,22 @@ ID3D12CommandList* computation::populate_command_list(float time){
 	}
 
 	command_list->SetPipelineState(pso.create_table.Get());
-	CD3DX12_RESOURCE_BARRIER create_table_barriers[] = {
-		CD3DX12_RESOURCE_BARRIER::Transition(grid_buffer.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE),
-		CD3DX12_RESOURCE_BARRIER::Transition(lookup_buffer.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_DEST),
-	};
+	command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(grid_buffer.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE));
 
-	command_list->ResourceBarrier(_countof(create_table_barriers), create_table_barriers);
-	command_list->CopyBufferRegion(lookup_buffer.Get(), 0, lookup_reset_buffer.Get(), 0, LOOKUP_TABLE_SIZE);
-	command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(lookup_buffer.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
+	//the table is only cleared before the first step and when the generation wraps around, otherwise the new generation hides the old entries.
+	//a cleared table holds generation 0, so the generation starts over at 1
+	bool clear_table = table_generation == 0 || table_generation == UINT_MAX;
+	table_generation = clear_table ? 1 : table_generation + 1;
+
+	if(clear_table) {
+		command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(lookup_buffer.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_DEST));
+		command_list->CopyBufferRegion(lookup_buffer.Get(), 0, lookup_reset_buffer.Get(), 0, LOOKUP_TABLE_SIZE);
+		command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(lookup_buffer.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
+	}
 
 	CD3DX12_GPU_DESCRIPTOR_HANDLE table_pass_handle(descriptor_heap->GetGPUDescriptorHandleForHeapStart(), descriptor_offset.create_table, srv_descriptor_size);
 	command_list->SetComputeRootDescriptorTable(SHADER_ORDER::CREATE_TABLE, table_pass_handle);
+	command_list->SetComputeRoot32BitConstants(TABLE_CONSTANTS_SLOT, 1, &table_generation, 0);
 	command_list->Dispatch(frame_constants::PARTICLE_COUNT / frame_constants::COMPUTE_SHADE_GROUP_SIZE, 1, 1);
 
 	command_list->SetPipelineState(pso.density.Get());
@@ -51,12 +51,14 @@ private:
 	};
 
 	static constexpr UINT SORTING_CONTANTS_SLOT = APPLY_FORCES + 1;
+	//the generation of create_table.hlsl
+	static constexpr UINT TABLE_CONSTANTS_SLOT = SORTING_CONTANTS_SLOT + 1;
 
 	static constexpr std::array<int, 5> DESCRIPTOR_PER_PASS = {3, 1, 3, 3, 4};
 
 	static constexpr int SHADER_INPUT_SIZE = (sizeof(SimulationConstants) & (~0xFF)) + 0x100;		//constant buffer requires a size divisible by 256 (= 0x100)
 
-	static constexpr int LOOKUP_TABLE_SIZE = frame_constants::GRID_SIZE_FLAT * sizeof(UINT);
+	static constexpr int LOOKUP_TABLE_SIZE = frame_constants::GRID_SIZE_FLAT * sizeof(UINT) * 2;		//generation and start of every cell
 
 	ComPtr<ID3D12CommandAllocator> command_allocator;
 	ComPtr<ID3D12GraphicsCommandList> command_list;
@@ -93,6 +95,9 @@ private:
 
 	SimulationConstants constants;
 
+	//tags the entries create_table writes in a step, the ones of older steps count as empty
+	UINT table_generation;
+
 public:
 	computation();
 
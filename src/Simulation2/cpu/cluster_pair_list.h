@@ -0,0 +1,349 @@
+#pragma once
+
+#include "src/Utility/float3.h"
+#include "src/Utility/thread_pool.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+//particles grouped into clusters of CLUSTER_SIZE close particles, as in the cluster pair scheme of GROMACS
+//
+//a cluster never spans two cells, the last cluster of a cell is padded with lanes far outside the box.
+//within a cell the particles are ordered along a Z-order curve over 8x8x8 sub-cells before they are cut into clusters,
+//so the bounding boxes of the clusters stay small. consecutive particles of the sorted order would spread over the whole cell,
+//and almost no cluster pair could be skipped.
+//every cluster gets a list of the clusters in the 27 cells around it whose bounding boxes come closer than the smoothing radius,
+//so the neighbor loops compare a particle against a whole cluster at once, with a fixed trip count the compiler can vectorize.
+//lane l of cluster c is stored at c * CLUSTER_SIZE + l, positions, velocities and densities in structure of arrays layout.
+//on periodic axes the cells wrap around, every pair carries the shift that brings the other cluster next to this one.
+template<size_t CLUSTER_SIZE>
+class cluster_pair_list {
+public:
+	static constexpr uint32_t EMPTY_LANE = 0xFFFFFFFF;
+	//clusters per task of the parallel loops
+	static constexpr size_t CLUSTER_GRAIN = 1024 / CLUSTER_SIZE;
+
+	//cell_of(i) returns the cell of the i-th particle of the sorted order, positions are in the sorted order as well
+	//period is the box length on periodic axes and 0 on the others
+	template<class CellOf>
+	void build(size_t n, CellOf&& cell_of, const float3* positions, const uint32_t grid_dim[3], const float cell_size[3], const float period[3],
+		float radius, thread_pool& pool)
+	{
+		uint32_t grid_flat = grid_dim[0] * grid_dim[1] * grid_dim[2];
+
+		for(int i = 0; i < 27; i++) {
+			images[i] = make_float3((i % 3 - 1) * period[0], (i / 3 % 3 - 1) * period[1], (i / 9 - 1) * period[2]);
+		}
+
+		//the runs of the cells in the sorted order
+		cell_runs.clear();
+		for(size_t i = 0; i < n; i++) {
+			if(i == 0 || cell_of(i) != cell_of(i - 1)) {
+				cell_runs.push_back(static_cast<uint32_t>(i));
+			}
+		}
+		cell_runs.push_back(static_cast<uint32_t>(n));
+
+		order.resize(n);
+		order_key.resize(n);
+
+		pool.parallel_for(cell_runs.size() - 1, CLUSTER_GRAIN, [&](size_t begin, size_t end, unsigned) {
+			for(size_t r = begin; r < end; r++) {
+				uint32_t run_begin = cell_runs[r];
+				uint32_t run_end = cell_runs[r + 1];
+				uint32_t c = cell_of(run_begin);
+
+				float origin[3] = {
+					(c % grid_dim[0]) * cell_size[0],
+					((c / grid_dim[0]) % grid_dim[1]) * cell_size[1],
+					(c / (grid_dim[0] * grid_dim[1])) * cell_size[2],
+				};
+
+				for(uint32_t i = run_begin; i < run_end; i++) {
+					order[i] = i;
+					order_key[i] = z_order(positions[i], origin, cell_size);
+				}
+
+				std::sort(order.begin() + run_begin, order.begin() + run_end, [&](uint32_t a, uint32_t b) {
+					return order_key[a] < order_key[b] || (order_key[a] == order_key[b] && a < b);
+				});
+			}
+		});
+
+		//cut the order into clusters, a new one starts with every cell and every CLUSTER_SIZE particles
+		first.clear();
+		count.clear();
+		cell.clear();
+		cell_first_cluster.assign(grid_flat, EMPTY_LANE);
+
+		for(size_t i = 0; i < n; i++) {
+			uint32_t c = cell_of(i);
+
+			if(first.empty() || cell.back() != c || count.back() == CLUSTER_SIZE) {
+				if(first.empty() || cell.back() != c) {
+					cell_first_cluster[c] = static_cast<uint32_t>(first.size());
+				}
+
+				first.push_back(static_cast<uint32_t>(i));
+				count.push_back(0);
+				cell.push_back(c);
+			}
+			count.back()++;
+		}
+
+		size_t clusters = first.size();
+
+		lane.resize(clusters * CLUSTER_SIZE);
+		x.resize(clusters * CLUSTER_SIZE);
+		y.resize(clusters * CLUSTER_SIZE);
+		z.resize(clusters * CLUSTER_SIZE);
+		vx.resize(clusters * CLUSTER_SIZE);
+		vy.resize(clusters * CLUSTER_SIZE);
+		vz.resize(clusters * CLUSTER_SIZE);
+		density.resize(clusters * CLUSTER_SIZE);
+		box_min.resize(clusters);
+		box_max.resize(clusters);
+		pair_range.resize(clusters);
+		pair_lists.resize(clusters);
+		pair_images.resize(clusters);
+		block_pairs.resize((clusters + CLUSTER_GRAIN - 1) / CLUSTER_GRAIN);
+		block_images.resize(block_pairs.size());
+
+		pool.parallel_for(clusters, CLUSTER_GRAIN, [&](size_t begin, size_t end, unsigned) {
+			for(size_t c = begin; c < end; c++) {
+				float3 lo = positions[order[first[c]]];
+				float3 hi = lo;
+
+				for(size_t l = 0; l < CLUSTER_SIZE; l++) {
+					size_t k = c * CLUSTER_SIZE + l;
+
+					if(l < count[c]) {
+						uint32_t idx = order[first[c] + l];
+						float3 p = positions[idx];
+
+						lane[k] = idx;
+						x[k] = p.x;
+						y[k] = p.y;
+						z[k] = p.z;
+
+						lo = make_float3(std::min(lo.x, p.x), std::min(lo.y, p.y), std::min(lo.z, p.z));
+						hi = make_float3(std::max(hi.x, p.x), std::max(hi.y, p.y), std::max(hi.z, p.z));
+					} else {
+						lane[k] = EMPTY_LANE;
+						x[k] = PADDING;
+						y[k] = PADDING;
+						z[k] = PADDING;
+					}
+				}
+
+				box_min[c] = lo;
+				box_max[c] = hi;
+			}
+		});
+
+		float r2 = radius * radius;
+
+		//the image of a wrapped neighbor cell is -1, 0 or 1 box lengths along each axis
+		auto wrap = [&](int axis, int coordinate, int& image) {
+			int dim = static_cast<int>(grid_dim[axis]);
+			image = 0;
+
+			if(period[axis] > 0.f && coordinate < 0) {
+				image = -1;
+				return coordinate + dim;
+			}
+			if(period[axis] > 0.f && coordinate >= dim) {
+				image = 1;
+				return coordinate - dim;
+			}
+			return coordinate;
+		};
+
+		auto for_each_close_cluster = [&](size_t c, auto&& fn) {
+			int cx = cell[c] % grid_dim[0];
+			int cy = (cell[c] / grid_dim[0]) % grid_dim[1];
+			int cz = cell[c] / (grid_dim[0] * grid_dim[1]);
+
+			for(int dz = -1; dz <= 1; dz++) {
+				int iz;
+				int nz = wrap(2, cz + dz, iz);
+				if(nz < 0 || nz >= static_cast<int>(grid_dim[2])) {
+					continue;
+				}
+
+				for(int dy = -1; dy <= 1; dy++) {
+					int iy;
+					int ny = wrap(1, cy + dy, iy);
+					if(ny < 0 || ny >= static_cast<int>(grid_dim[1])) {
+						continue;
+					}
+
+					for(int dx = -1; dx <= 1; dx++) {
+						int ix;
+						int nx = wrap(0, cx + dx, ix);
+						if(nx < 0 || nx >= static_cast<int>(grid_dim[0])) {
+							continue;
+						}
+
+						uint32_t neighbor_cell = (nz * grid_dim[1] + ny) * grid_dim[0] + nx;
+						uint8_t image = static_cast<uint8_t>((ix + 1) + 3 * (iy + 1) + 9 * (iz + 1));
+
+						for(uint32_t j = cell_first_cluster[neighbor_cell]; j < clusters && cell[j] == neighbor_cell; j++) {
+							if(box_distance2(c, j, images[image]) < r2) {
+								fn(j, image);
+							}
+						}
+					}
+				}
+			}
+		};
+
+		//every block of clusters appends its pair lists to its own buffer, which keeps its capacity from step to step
+		pool.parallel_for(clusters, CLUSTER_GRAIN, [&](size_t begin, size_t end, unsigned) {
+			std::vector<uint32_t>& out = block_pairs[begin / CLUSTER_GRAIN];
+			std::vector<uint8_t>& out_images = block_images[begin / CLUSTER_GRAIN];
+			out.clear();
+			out_images.clear();
+
+			for(size_t c = begin; c < end; c++) {
+				pair_range[c].first = out.size();
+				for_each_close_cluster(c, [&](uint32_t j, uint8_t image) {
+					out.push_back(j);
+					out_images.push_back(image);
+				});
+				pair_range[c].second = out.size();
+			}
+
+			//the buffers don't grow anymore, so the offsets can be turned into pointers
+			for(size_t c = begin; c < end; c++) {
+				pair_lists[c].first = out.data() + pair_range[c].first;
+				pair_lists[c].second = out.data() + pair_range[c].second;
+				pair_images[c] = out_images.data() + pair_range[c].first;
+			}
+		});
+	}
+
+	//copies velocities and densities in the sorted order into the lanes, padding lanes get no velocity and a density of 1
+	void load_state(const float3* velocities, const float* densities, thread_pool& pool){
+		pool.parallel_for(cluster_count(), CLUSTER_GRAIN, [&](size_t begin, size_t end, unsigned) {
+			for(size_t k = begin * CLUSTER_SIZE; k < end * CLUSTER_SIZE; k++) {
+				bool used = lane[k] != EMPTY_LANE;
+
+				vx[k] = used ? velocities[lane[k]].x : 0.f;
+				vy[k] = used ? velocities[lane[k]].y : 0.f;
+				vz[k] = used ? velocities[lane[k]].z : 0.f;
+				density[k] = used ? densities[lane[k]] : 1.f;
+			}
+		});
+	}
+
+	size_t cluster_count() const{
+		return first.size();
+	}
+
+	//number of used lanes of cluster c
+	uint32_t size(size_t c) const{
+		return count[c];
+	}
+
+	uint64_t pair_count() const{
+		uint64_t pairs = 0;
+		for(const std::vector<uint32_t>& block : block_pairs) {
+			pairs += block.size();
+		}
+		return pairs;
+	}
+
+	//the clusters close to cluster c, including c itself
+	const uint32_t* pairs_begin(size_t c) const{
+		return pair_lists[c].first;
+	}
+
+	const uint32_t* pairs_end(size_t c) const{
+		return pair_lists[c].second;
+	}
+
+	//one image code for every pair of cluster c, in the same order as the pairs
+	const uint8_t* images_begin(size_t c) const{
+		return pair_images[c];
+	}
+
+	//what has to be added to the positions of the other cluster of a pair to bring it next to this one
+	float3 image_offset(uint8_t image) const{
+		return images[image];
+	}
+
+	//index into the sorted order of every lane, EMPTY_LANE for padding
+	std::vector<uint32_t> lane;
+
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<float> z;
+	std::vector<float> vx;
+	std::vector<float> vy;
+	std::vector<float> vz;
+	std::vector<float> density;
+
+private:
+	//far enough away from any box that padding lanes never come close to a particle, but r^2 stays finite
+	static constexpr float PADDING = 1e15f;
+
+	std::vector<uint32_t> cell_runs;
+
+	//the sorted order with the particles of every cell in Z-order, clusters are consecutive ranges of it
+	std::vector<uint32_t> order;
+	std::vector<uint32_t> order_key;
+
+	std::vector<uint32_t> first;
+	std::vector<uint32_t> count;
+	std::vector<uint32_t> cell;
+	std::vector<uint32_t> cell_first_cluster;
+
+	std::vector<float3> box_min;
+	std::vector<float3> box_max;
+
+	std::vector<std::pair<size_t, size_t>> pair_range;
+	std::vector<std::pair<const uint32_t*, const uint32_t*>> pair_lists;
+	std::vector<const uint8_t*> pair_images;
+	std::vector<std::vector<uint32_t>> block_pairs;
+	std::vector<std::vector<uint8_t>> block_images;
+
+	float3 images[27];
+
+	//position of p on a Z-order curve over 8x8x8 sub-cells of the cell starting at origin
+	static uint32_t z_order(float3 p, const float origin[3], const float cell_size[3]){
+		float local[3] = {p.x - origin[0], p.y - origin[1], p.z - origin[2]};
+		uint32_t key = 0;
+
+		for(int axis = 0; axis < 3; axis++) {
+			//particles outside the box are clamped into the border cells, so they can lie outside of their cell
+			uint32_t sub_cell = static_cast<uint32_t>(std::min(7.f, std::max(0.f, local[axis] / cell_size[axis] * 8.f)));
+
+			for(int bit = 0; bit < 3; bit++) {
+				key |= ((sub_cell >> bit) & 1) << (bit * 3 + axis);
+			}
+		}
+		return key;
+	}
+
+	//squared distance between the bounding box of a and the one of b moved by image
+	float box_distance2(size_t a, size_t b, float3 image) const{
+		float3 b_min = box_min[b] + image;
+		float3 b_max = box_max[b] + image;
+
+		float dx = std::max(0.f, std::max(box_min[a].x - b_max.x, b_min.x - box_max[a].x));
+		float dy = std::max(0.f, std::max(box_min[a].y - b_max.y, b_min.y - box_max[a].y));
+		float dz = std::max(0.f, std::max(box_min[a].z - b_max.z, b_min.z - box_max[a].z));
+
+		return dx * dx + dy * dy + dz * dz;
+	}
+};
+
+template<size_t CLUSTER_SIZE>
+constexpr uint32_t cluster_pair_list<CLUSTER_SIZE>::EMPTY_LANE;
+template<size_t CLUSTER_SIZE>
+constexpr size_t cluster_pair_list<CLUSTER_SIZE>::CLUSTER_GRAIN;
+template<size_t CLUSTER_SIZE>
+constexpr float cluster_pair_list<CLUSTER_SIZE>::PADDING;
@@ -0,0 +1,1276 @@
+#include "cpu_engine.h"
+#include "src/Simulation2/frame_constants.h"
+#include "src/Utility/grid_cell.h"
+#include "src/Utility/parallel_primitives.h"
+#include "src/Utility/tracer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+	//particles per task of the per particle passes
+	constexpr size_t PARTICLE_GRAIN = 1024;
+
+	uint64_t sort_key(uint32_t cell_id, uint32_t particle_id){
+		return (static_cast<uint64_t>(cell_id) << 32) | particle_id;
+	}
+
+	//returns a matrix representing a -90 degree rotation around the given axis, see apply_forces.hlsl
+	float3 rotate(float3 axis, float3 v){
+		float3 n = normalize(axis);
+
+		float3 row0 = make_float3(n.x * n.x, n.x * n.y + n.z, n.x * n.z - n.y);
+		float3 row1 = make_float3(n.x * n.y - n.z, n.y * n.y, n.y * n.z + n.x);
+		float3 row2 = make_float3(n.x * n.z + n.y, n.y * n.z - n.x, n.z * n.z);
+
+		return make_float3(dot(row0, v), dot(row1, v), dot(row2, v));
+	}
+}
+
+constexpr size_t cpu_engine::DETERMINISTIC_BLOCK_SIZE;
+constexpr size_t cpu_engine::STATISTICS_HISTORY;
+
+simulation_parameters simulation_parameters::from_frame_constants(){
+	simulation_parameters params;
+
+	params.particle_count = frame_constants::PARTICLE_COUNT;
+	params.smoothing_radius = frame_constants::KERNEL_RADIUS;
+	params.pressure_constant = frame_constants::PRESSURE_CONSTANT;
+	params.viscosity_constant = frame_constants::VISCOSITY_CONSANT;
+	params.reference_density = frame_constants::REFERENCE_DENSITY;
+	params.timestep = frame_constants::TIMESTEP;
+	params.particle_radius = frame_constants::PARTICLE_RADIUS;
+	params.initial_displacement = frame_constants::INITIAL_DISPLACEMENT;
+
+	memcpy(params.gravity, frame_constants::GRAVITY, sizeof(params.gravity));
+	memcpy(params.boundary, frame_constants::SIMULATION_BOX_BOUNDARY, sizeof(params.boundary));
+
+	//Simulation2 has walls on all sides
+	for(int i = 0; i < 3; i++) {
+		params.periodic[i] = false;
+	}
+
+	return params;
+}
+
+cpu_engine::cpu_engine(const simulation_parameters& params, thread_pool& pool) :
+	params(params),
+	pool(pool),
+	mode(execution_mode::fast),
+	evaluation(kernel_evaluation::analytic),
+	forces(force_evaluation::full_stencil),
+	loops(neighbor_loop::per_particle),
+	sorting(cell_sort::comparison),
+	analytic_density(params.smoothing_radius),
+	analytic_pressure(params.smoothing_radius),
+	analytic_viscosity(params.smoothing_radius),
+	tabulated_density(params.smoothing_radius),
+	tabulated_pressure(params.smoothing_radius),
+	tabulated_viscosity(params.smoothing_radius),
+	viscosity_scale(params.viscosity_constant / analytic_viscosity.normalization()),
+	table_generation(0),
+	contact_count(0)
+#ifdef ENABLE_PASS_STATISTICS
+	, step_count(0)
+	, current_statistics()
+	, last_step_statistics()
+	, history(STATISTICS_HISTORY)
+	, counters(pool.size())
+#endif
+{
+	grid_flat = 1;
+	for(int i = 0; i < 3; i++) {
+		if(params.periodic[i]) {
+			//cells at least as large as the smoothing radius that tile the box exactly, so wrapping a cell index wraps the position
+			grid_dim[i] = static_cast<uint32_t>(params.boundary[i] / params.smoothing_radius);
+
+			if(grid_dim[i] < 3) {
+				throw std::runtime_error("a periodic axis needs a box of at least three smoothing radii");
+			}
+
+			cell_size[i] = params.boundary[i] / grid_dim[i];
+			period[i] = params.boundary[i];
+		} else {
+			grid_dim[i] = static_cast<uint32_t>(params.boundary[i] / params.smoothing_radius + 1);
+			cell_size[i] = params.smoothing_radius;
+			period[i] = 0.f;
+		}
+		grid_flat *= grid_dim[i];
+	}
+
+	size_t n = params.particle_count;
+
+	pos.assign(n, make_float3(0.f, 0.f, 0.f));
+	vel.assign(n, make_float3(0.f, 0.f, 0.f));
+	density.assign(n, params.reference_density);
+
+	grid.resize(n);
+	grid_scratch.resize(n);
+	lookup.assign(grid_flat, cell_entry{0, 0, 0});
+
+	sorted_pos.resize(n);
+	sorted_vel.resize(n);
+	sorted_density.resize(n);
+	next_pos.resize(n);
+	next_vel.resize(n);
+
+	for(uint32_t i = 0; i < n; i++) {
+		grid[i].cell_id = 0;
+		grid[i].particle_id = i;
+	}
+}
+
+void cpu_engine::load_initial_cube(){
+	uint32_t n = params.particle_count;
+	float diff = params.initial_displacement;
+
+	float cube_length_particles = std::pow(static_cast<float>(n), 0.3333333333333333f);
+	float cube_length = cube_length_particles * diff;
+	float start_x = (params.boundary[0] - cube_length) * 0.5f;
+	float start_z = (params.boundary[2] - cube_length) * 0.5f;
+
+	uint32_t i = 0;
+	for(int x = 0; x < cube_length_particles && i < n; x++) {
+		for(int y = 0; y < cube_length_particles && i < n; y++) {
+			for(int z = 0; z < cube_length_particles && i < n; z++) {
+				pos[i] = make_float3(start_x + x * diff, (y + 1) * diff, start_z + z * diff);
+				vel[i] = make_float3(0.f, 0.f, 0.f);
+				i++;
+			}
+		}
+	}
+}
+
+void cpu_engine::set_state(const float3* positions, const float3* velocities){
+	std::copy(positions, positions + params.particle_count, pos.begin());
+	std::copy(velocities, velocities + params.particle_count, vel.begin());
+}
+
+void cpu_engine::set_execution_mode(execution_mode mode){
+	this->mode = mode;
+}
+
+execution_mode cpu_engine::get_execution_mode() const{
+	return mode;
+}
+
+void cpu_engine::set_kernel_evaluation(kernel_evaluation evaluation){
+	this->evaluation = evaluation;
+}
+
+kernel_evaluation cpu_engine::get_kernel_evaluation() const{
+	return evaluation;
+}
+
+void cpu_engine::set_force_evaluation(force_evaluation evaluation){
+	forces = evaluation;
+}
+
+force_evaluation cpu_engine::get_force_evaluation() const{
+	return forces;
+}
+
+void cpu_engine::set_neighbor_loop(neighbor_loop loop){
+	loops = loop;
+}
+
+neighbor_loop cpu_engine::get_neighbor_loop() const{
+	return loops;
+}
+
+void cpu_engine::set_cell_sort(cell_sort sort){
+	sorting = sort;
+}
+
+cell_sort cpu_engine::get_cell_sort() const{
+	return sorting;
+}
+
+void cpu_engine::step(){
+	TRACE_SCOPE("step");
+
+	create_grid();
+	sort();
+	create_table();
+	evaluate_density();
+	apply_forces();
+
+	PASS_COUNTER(record_statistics());
+}
+
+#ifdef ENABLE_PASS_STATISTICS
+void cpu_engine::record_statistics(){
+	pass_counters total = pass_counters();
+
+	for(pass_counters& c : counters) {
+		total.occupied_cells += c.occupied_cells;
+		total.neighbors += c.neighbors;
+		total.max_neighbors = std::max(total.max_neighbors, c.max_neighbors);
+		total.collisions_resolved += c.collisions_resolved;
+		total.boundary_clamps += c.boundary_clamps;
+		total.sort_swaps += c.sort_swaps;
+
+		c = pass_counters();
+	}
+
+	current_statistics.step = step_count++;
+	current_statistics.occupied_cells = static_cast<uint32_t>(total.occupied_cells);
+	current_statistics.mean_neighbors = grid.empty() ? 0.0 : static_cast<double>(total.neighbors) / grid.size();
+	current_statistics.max_neighbors = total.max_neighbors;
+	//every colliding pair is seen from both of its particles
+	current_statistics.collisions_resolved = total.collisions_resolved / 2;
+	current_statistics.boundary_clamps = total.boundary_clamps;
+	current_statistics.sort_swaps = total.sort_swaps;
+
+	history.push(current_statistics);
+	last_step_statistics = current_statistics;
+	current_statistics = step_statistics();
+}
+
+const step_statistics& cpu_engine::last_statistics() const{
+	return last_step_statistics;
+}
+
+const statistics_ring& cpu_engine::statistics_history() const{
+	return history;
+}
+#endif
+
+uint32_t cpu_engine::cell_of(float3 p) const{
+	//particles are kept inside the box by apply_forces, the clamp only guards against positions handed in from outside
+	return clamped_cell(p, grid_dim, cell_size);
+}
+
+bool cpu_engine::neighbor_coordinate(int axis, int c, int d, int& neighbor, float& image) const{
+	int dim = static_cast<int>(grid_dim[axis]);
+
+	neighbor = c + d;
+	image = 0.f;
+
+	if(neighbor >= 0 && neighbor < dim) {
+		return true;
+	}
+	if(!params.periodic[axis]) {
+		return false;
+	}
+
+	//the cell behind the last one is the first one, one box length further
+	if(neighbor < 0) {
+		neighbor += dim;
+		image = -period[axis];
+	} else {
+		neighbor -= dim;
+		image = period[axis];
+	}
+	return true;
+}
+
+float3 cpu_engine::minimum_image(float3 d) const{
+	if(params.periodic[0]) {
+		d.x -= period[0] * std::round(d.x / period[0]);
+	}
+	if(params.periodic[1]) {
+		d.y -= period[1] * std::round(d.y / period[1]);
+	}
+	if(params.periodic[2]) {
+		d.z -= period[2] * std::round(d.z / period[2]);
+	}
+	return d;
+}
+
+//assigns a cell to each particle, see create_grid.hlsl
+//the pairs keep the order of the last step, so the sort mostly finds them already ordered
+void cpu_engine::create_grid(){
+	TRACE_SCOPE("create_grid");
+	PASS_TIMER(current_statistics.pass_seconds[PASS_CREATE_GRID]);
+
+	//the first pass of a step, the scratch of the last one is no longer used
+	scratch.reset();
+
+	pool.parallel_for(grid.size(), PARTICLE_GRAIN, [this](size_t begin, size_t end, unsigned) {
+		for(size_t i = begin; i < end; i++) {
+			grid[i].cell_id = cell_of(pos[grid[i].particle_id]);
+		}
+	});
+}
+
+//orders the pairs by cell as cell_sort describes, afterwards the particle state is gathered into the sorted order
+void cpu_engine::sort(){
+	TRACE_SCOPE("sort");
+	PASS_TIMER(current_statistics.pass_seconds[PASS_SORT]);
+
+#ifdef ENABLE_PASS_STATISTICS
+	pool.parallel_for(grid.size(), PARTICLE_GRAIN, [this](size_t begin, size_t end, unsigned worker) {
+		for(size_t i = std::max<size_t>(begin, 1); i < end; i++) {
+			if(grid[i - 1].cell_id > grid[i].cell_id) {
+				counters[worker].sort_swaps++;
+			}
+		}
+	});
+#endif
+
+	if(sorting == cell_sort::counting) {
+		counting_sort();
+	} else {
+		comparison_sort();
+	}
+
+	pool.parallel_for(grid.size(), PARTICLE_GRAIN, [this](size_t begin, size_t end, unsigned) {
+		for(size_t i = begin; i < end; i++) {
+			uint32_t id = grid[i].particle_id;
+
+			sorted_pos[i] = pos[id];
+			sorted_vel[i] = vel[id];
+		}
+	});
+}
+
+//sorts one chunk of the pairs per thread and merges the chunks pairwise
+void cpu_engine::comparison_sort(){
+	bool deterministic = mode == execution_mode::deterministic;
+
+	auto less = [deterministic](const pair& a, const pair& b) {
+		if(deterministic) {
+			return sort_key(a.cell_id, a.particle_id) < sort_key(b.cell_id, b.particle_id);
+		}
+		return a.cell_id < b.cell_id;
+	};
+
+	size_t n = grid.size();
+	size_t num_chunks = std::max<size_t>(1, std::min<size_t>(pool.size(), n / PARTICLE_GRAIN));
+
+	size_t* bounds = scratch.allocate<size_t>(num_chunks + 1);
+	size_t bound_count = num_chunks + 1;
+
+	for(size_t i = 0; i <= num_chunks; i++) {
+		bounds[i] = n * i / num_chunks;
+	}
+
+	pool.run(num_chunks, [&](size_t chunk, unsigned) {
+		std::sort(grid.begin() + bounds[chunk], grid.begin() + bounds[chunk + 1], less);
+	});
+
+	while(bound_count > 2) {
+		pool.run(bound_count / 2, [&](size_t merge, unsigned) {
+			size_t first = bounds[2 * merge];
+			size_t middle = bounds[2 * merge + 1];
+
+			//an odd chunk at the end is copied over unchanged
+			if(2 * merge + 2 >= bound_count) {
+				std::copy(grid.begin() + first, grid.begin() + middle, grid_scratch.begin() + first);
+				return;
+			}
+
+			size_t last = bounds[2 * merge + 2];
+			std::merge(grid.begin() + first, grid.begin() + middle, grid.begin() + middle, grid.begin() + last, grid_scratch.begin() + first, less);
+		});
+
+		//every merge keeps the first bound of its pair, compacted in place as bound i only moves to i / 2
+		size_t merged_count = 0;
+		for(size_t i = 0; i < bound_count; i += 2) {
+			bounds[merged_count++] = bounds[i];
+		}
+		if(bounds[merged_count - 1] != n) {
+			bounds[merged_count++] = n;
+		}
+
+		bound_count = merged_count;
+		grid.swap(grid_scratch);
+	}
+}
+
+//a stable counting sort by cell, whose scan over the cells writes the table of the occupied ones on the way
+void cpu_engine::counting_sort(){
+	uint32_t generation = next_table_generation();
+
+	auto table_entry = [this, generation](size_t cell, uint32_t start, uint32_t count, unsigned worker) {
+		PASS_WORKER(worker);
+		if(count > 0) {
+			lookup[cell] = {generation, start, count};
+			PASS_COUNTER(counters[worker].occupied_cells++);
+		}
+	};
+
+	parallel_primitives::counting_sort(pool, grid.size(), grid_flat,
+		[this](size_t i, auto&& add) { add(grid[i].cell_id); },
+		table_entry,
+		[](size_t) {},
+		[this](size_t i, uint32_t position) { grid_scratch[position] = grid[i]; },
+		scratch);
+
+	grid.swap(grid_scratch);
+}
+
+uint32_t cpu_engine::next_table_generation(){
+	//after 2^32 tables the generation wraps around and old entries could look current, so the table is cleared once
+	if(++table_generation == 0) {
+		std::fill(lookup.begin(), lookup.end(), cell_entry{0, 0, 0});
+		table_generation = 1;
+	}
+	return table_generation;
+}
+
+//finds the index at which every cell first appears in the sorted array, see create_table.hlsl, and how many pairs follow it
+//a pair starts a cell if its predecessor belongs to another one, so each entry has exactly one writer.
+//the entries are tagged with a new generation, which leaves the ones of the last step behind as empty
+void cpu_engine::create_table(){
+	TRACE_SCOPE("create_table");
+	PASS_TIMER(current_statistics.pass_seconds[PASS_CREATE_TABLE]);
+
+	//counting_sort already wrote the table
+	if(sorting == cell_sort::comparison) {
+		uint32_t generation = next_table_generation();
+
+		pool.parallel_for(grid.size(), PARTICLE_GRAIN, [this, generation](size_t begin, size_t end, unsigned worker) {
+			PASS_WORKER(worker);
+			size_t n = grid.size();
+
+			for(size_t i = begin; i < end; i++) {
+				uint32_t cell_id = grid[i].cell_id;
+
+				if(i == 0 || grid[i - 1].cell_id != cell_id) {
+					size_t last = i + 1;
+					while(last < n && grid[last].cell_id == cell_id) {
+						last++;
+					}
+
+					lookup[cell_id] = {generation, static_cast<uint32_t>(i), static_cast<uint32_t>(last - i)};
+					PASS_COUNTER(counters[worker].occupied_cells++);
+				}
+			}
+		});
+	}
+
+	if(loops != neighbor_loop::per_particle) {
+		TRACE_SCOPE("cluster_pairs");
+
+		auto cell_of_pair = [this](size_t i) { return grid[i].cell_id; };
+
+		if(loops == neighbor_loop::cluster_pairs_4) {
+			clusters_4.build(grid.size(), cell_of_pair, sorted_pos.data(), grid_dim, cell_size, period, params.smoothing_radius, pool);
+		} else {
+			clusters_8.build(grid.size(), cell_of_pair, sorted_pos.data(), grid_dim, cell_size, period, params.smoothing_radius, pool);
+		}
+	}
+}
+
+template<class F>
+void cpu_engine::for_each_neighbor_cell(uint32_t cell_id, F&& fn) const{
+	int x = cell_id % grid_dim[0];
+	int y = (cell_id / grid_dim[0]) % grid_dim[1];
+	int z = cell_id / (grid_dim[0] * grid_dim[1]);
+
+	for(int dz = -1; dz <= 1; dz++) {
+		int nz;
+		float image_z;
+		if(!neighbor_coordinate(2, z, dz, nz, image_z)) {
+			continue;
+		}
+
+		for(int dy = -1; dy <= 1; dy++) {
+			int ny;
+			float image_y;
+			if(!neighbor_coordinate(1, y, dy, ny, image_y)) {
+				continue;
+			}
+
+			for(int dx = -1; dx <= 1; dx++) {
+				int nx;
+				float image_x;
+				if(!neighbor_coordinate(0, x, dx, nx, image_x)) {
+					continue;
+				}
+
+				const cell_entry& entry = lookup[(nz * grid_dim[1] + ny) * grid_dim[0] + nx];
+
+				if(entry.generation != table_generation) {
+					continue;
+				}
+
+				float3 image = make_float3(image_x, image_y, image_z);
+
+				for(uint32_t j = entry.start; j < entry.start + entry.count; j++) {
+					fn(j, image);
+				}
+			}
+		}
+	}
+}
+
+template<class F>
+void cpu_engine::for_each_forward_neighbor(uint32_t idx, F&& fn) const{
+	uint32_t cell_id = grid[idx].cell_id;
+	const cell_entry& own = lookup[cell_id];
+
+	//the rest of the own cell
+	for(uint32_t j = idx + 1; j < own.start + own.count; j++) {
+		fn(j, make_float3(0.f, 0.f, 0.f));
+	}
+
+	int x = cell_id % grid_dim[0];
+	int y = (cell_id / grid_dim[0]) % grid_dim[1];
+	int z = cell_id / (grid_dim[0] * grid_dim[1]);
+
+	//the 13 cells on the positive side of the own one, the other 13 see this cell on their positive side
+	for(int dz = 0; dz <= 1; dz++) {
+		int nz;
+		float image_z;
+		if(!neighbor_coordinate(2, z, dz, nz, image_z)) {
+			continue;
+		}
+
+		for(int dy = dz == 0 ? 0 : -1; dy <= 1; dy++) {
+			int ny;
+			float image_y;
+			if(!neighbor_coordinate(1, y, dy, ny, image_y)) {
+				continue;
+			}
+
+			for(int dx = dz == 0 && dy == 0 ? 1 : -1; dx <= 1; dx++) {
+				int nx;
+				float image_x;
+				if(!neighbor_coordinate(0, x, dx, nx, image_x)) {
+					continue;
+				}
+
+				const cell_entry& entry = lookup[(nz * grid_dim[1] + ny) * grid_dim[0] + nx];
+
+				if(entry.generation != table_generation) {
+					continue;
+				}
+
+				float3 image = make_float3(image_x, image_y, image_z);
+
+				for(uint32_t j = entry.start; j < entry.start + entry.count; j++) {
+					fn(j, image);
+				}
+			}
+		}
+	}
+}
+
+//see density_evaluation.hlsl
+void cpu_engine::evaluate_density(){
+	TRACE_SCOPE("density");
+	PASS_TIMER(current_statistics.pass_seconds[PASS_DENSITY]);
+
+	if(evaluation == kernel_evaluation::tabulated) {
+		density_pass(tabulated_density);
+	} else {
+		density_pass(analytic_density);
+	}
+}
+
+template<class DensityKernel>
+void cpu_engine::density_pass(const DensityKernel& density_w){
+	if(loops == neighbor_loop::cluster_pairs_4) {
+		cluster_density_pass(clusters_4, density_w);
+		return;
+	}
+	if(loops == neighbor_loop::cluster_pairs_8) {
+		cluster_density_pass(clusters_8, density_w);
+		return;
+	}
+
+	pool.parallel_for(grid.size(), PARTICLE_GRAIN, [this, &density_w](size_t begin, size_t end, unsigned worker) {
+		PASS_WORKER(worker);
+		float h2 = params.smoothing_radius * params.smoothing_radius;
+
+		for(size_t i = begin; i < end; i++) {
+			float3 my_pos = sorted_pos[i];
+			float result = 0.f;
+			PASS_COUNTER(uint32_t neighbors = 0);
+
+			for_each_neighbor_cell(grid[i].cell_id, [&](uint32_t j, float3 image) {
+				float3 diff = sorted_pos[j] + image - my_pos;
+				float r2 = dot(diff, diff);
+
+				if(r2 < h2) {
+					result += density_w.value(r2);
+					PASS_COUNTER(neighbors++);
+				}
+			});
+
+			//the particle itself is part of the sum, but not one of its neighbors
+			PASS_COUNTER(counters[worker].add_neighbors(neighbors - 1));
+
+			sorted_density[i] = std::max(params.reference_density, result);
+			density[grid[i].particle_id] = sorted_density[i];
+		}
+	});
+}
+
+float cpu_engine::pressure_at(float particle_density) const{
+	return params.pressure_constant * (particle_density - params.reference_density);
+}
+
+//see apply_forces.hlsl
+void cpu_engine::apply_forces(){
+	TRACE_SCOPE("apply_forces");
+	PASS_TIMER(current_statistics.pass_seconds[PASS_FORCES]);
+
+	if(evaluation == kernel_evaluation::tabulated) {
+		force_pass(tabulated_pressure, tabulated_viscosity);
+	} else {
+		force_pass(analytic_pressure, analytic_viscosity);
+	}
+
+	pool.parallel_for(grid.size(), PARTICLE_GRAIN, [this](size_t begin, size_t end, unsigned) {
+		for(size_t i = begin; i < end; i++) {
+			uint32_t id = grid[i].particle_id;
+
+			pos[id] = next_pos[i];
+			vel[id] = next_vel[i];
+		}
+	});
+}
+
+template<class PressureKernel, class ViscosityKernel>
+void cpu_engine::force_pass(const PressureKernel& pressure_w, const ViscosityKernel& viscosity_w){
+	if(loops == neighbor_loop::cluster_pairs_4) {
+		cluster_force_pass(clusters_4, pressure_w, viscosity_w);
+		return;
+	}
+	if(loops == neighbor_loop::cluster_pairs_8) {
+		cluster_force_pass(clusters_8, pressure_w, viscosity_w);
+		return;
+	}
+	if(forces == force_evaluation::half_stencil) {
+		half_stencil_force_pass(pressure_w, viscosity_w);
+		return;
+	}
+
+	pool.parallel_for(grid.size(), PARTICLE_GRAIN, [&](size_t begin, size_t end, unsigned worker) {
+		for(size_t i = begin; i < end; i++) {
+			update_particle(static_cast<uint32_t>(i), worker, pressure_w, viscosity_w);
+		}
+	});
+}
+
+template<class PressureKernel, class ViscosityKernel>
+void cpu_engine::update_particle(uint32_t idx, unsigned worker, const PressureKernel& pressure_w, const ViscosityKernel& viscosity_w){
+	float3 my_pos = sorted_pos[idx];
+	float3 my_velocity = sorted_vel[idx];
+	float my_density = sorted_density[idx];
+	float my_pressure = pressure_at(my_density);
+
+	float h = params.smoothing_radius;
+	float h2 = h * h;
+	float collision_distance = params.particle_radius * 2;
+
+	float3 viscosity_force = make_float3(0.f, 0.f, 0.f);
+	float3 pressure_force = make_float3(0.f, 0.f, 0.f);
+
+	for_each_neighbor_cell(grid[idx].cell_id, [&](uint32_t i, float3 image) {
+		if(i == idx) {
+			return;
+		}
+
+		float3 diff = sorted_pos[i] + image - my_pos;
+		float r2 = dot(diff, diff);
+		float r = std::sqrt(r2);
+
+		if(r < collision_distance) {
+			collide(my_pos, my_velocity, diff, r2, sorted_vel[i], worker);
+		}
+
+		if(0.00001f < r2 && r2 < h2) {
+			float their_pressure = pressure_at(sorted_density[i]);
+			float pressure_kernel_value = pressure_w.gradient(r2);
+			float3 dir = diff / r;
+
+			pressure_force += (my_pressure + their_pressure) * pressure_kernel_value * dir / (2 * my_density * sorted_density[i]);
+
+			float viscosity_kernel_value = viscosity_w.value(r2);
+
+			viscosity_force += (sorted_vel[i] - my_velocity) * viscosity_kernel_value * dir / sorted_density[i];
+		}
+	});
+
+	integrate(idx, my_pos, my_velocity, viscosity_force, pressure_force, worker);
+}
+
+template<class PressureKernel, class ViscosityKernel>
+void cpu_engine::half_stencil_force_pass(const PressureKernel& pressure_w, const ViscosityKernel& viscosity_w){
+	size_t n = grid.size();
+
+	pressure_sum.resize(n);
+	viscosity_sum.resize(n);
+	clear_contacts();
+
+	pool.parallel_for(n, PARTICLE_GRAIN, [this](size_t begin, size_t end, unsigned) {
+		std::fill(pressure_sum.begin() + begin, pressure_sum.begin() + end, make_float3(0.f, 0.f, 0.f));
+		std::fill(viscosity_sum.begin() + begin, viscosity_sum.begin() + end, make_float3(0.f, 0.f, 0.f));
+	});
+
+	auto first_pair_of_cell = [this](uint32_t cell_id) {
+		return static_cast<uint32_t>(std::lower_bound(grid.begin(), grid.end(), cell_id, [](const pair& p, uint32_t id) {
+			return p.cell_id < id;
+		}) - grid.begin());
+	};
+
+	//a cell only writes to itself, the cells next to it along x and y and the plane after it.
+	//so the planes are colored by parity and cut into bands of at least two cells along x and y, colored by parity as well,
+	//and no two tasks of the same color ever write the same particle. the bands only depend on the grid, which keeps the summation
+	//order independent of the number of threads. along a periodic x or y axis the first and the last band touch, so there are an even number of them.
+	//on a periodic z axis the last plane writes to the first one, with an odd number of planes it gets a phase of its own
+	auto band_count = [this](int axis) {
+		uint32_t bands = std::max<uint32_t>(1, grid_dim[axis] / 2);
+		return params.periodic[axis] && bands > 1 && bands % 2 == 1 ? bands - 1 : bands;
+	};
+
+	const uint32_t x_bands = band_count(0);
+	const uint32_t y_bands = band_count(1);
+	uint32_t last_plane_alone = params.periodic[2] && grid_dim[2] % 2 == 1 ? 1 : 0;
+	uint32_t paired_planes = grid_dim[2] - last_plane_alone;
+
+	auto run_planes = [&](uint32_t first_plane, uint32_t planes, uint32_t x_parity, uint32_t y_parity) {
+		uint32_t phase_x_bands = (x_bands + 1 - x_parity) / 2;
+		uint32_t phase_y_bands = (y_bands + 1 - y_parity) / 2;
+
+		pool.run(static_cast<size_t>(planes) * phase_y_bands * phase_x_bands, [&](size_t task, unsigned worker) {
+			uint32_t z = first_plane + static_cast<uint32_t>(task / (phase_x_bands * phase_y_bands)) * 2;
+			uint32_t y_band = static_cast<uint32_t>(task / phase_x_bands % phase_y_bands) * 2 + y_parity;
+			uint32_t x_band = static_cast<uint32_t>(task % phase_x_bands) * 2 + x_parity;
+			uint32_t x_begin = grid_dim[0] * x_band / x_bands;
+			uint32_t x_end = grid_dim[0] * (x_band + 1) / x_bands;
+
+			for(uint32_t y = grid_dim[1] * y_band / y_bands; y < grid_dim[1] * (y_band + 1) / y_bands; y++) {
+				uint32_t row = (z * grid_dim[1] + y) * grid_dim[0];
+				uint32_t end = first_pair_of_cell(row + x_end);
+
+				for(uint32_t idx = first_pair_of_cell(row + x_begin); idx < end; idx++) {
+					accumulate_pairs(idx, worker, pressure_w, viscosity_w);
+				}
+			}
+		});
+	};
+
+	for(uint32_t color = 0; color < 4; color++) {
+		uint32_t x_parity = color & 1;
+		uint32_t y_parity = color >> 1;
+
+		run_planes(0, (paired_planes + 1) / 2, x_parity, y_parity);
+		run_planes(1, paired_planes / 2, x_parity, y_parity);
+
+		if(last_plane_alone) {
+			run_planes(grid_dim[2] - 1, 1, x_parity, y_parity);
+		}
+	}
+
+	resolve_contacts_and_integrate();
+}
+
+template<class PressureKernel, class ViscosityKernel>
+void cpu_engine::accumulate_pairs(uint32_t idx, unsigned worker, const PressureKernel& pressure_w, const ViscosityKernel& viscosity_w){
+	float3 my_pos = sorted_pos[idx];
+	float3 my_velocity = sorted_vel[idx];
+	float my_density = sorted_density[idx];
+	float my_pressure = pressure_at(my_density);
+
+	float h = params.smoothing_radius;
+	float h2 = h * h;
+	float collision_distance = params.particle_radius * 2;
+
+	float3 my_pressure_sum = make_float3(0.f, 0.f, 0.f);
+	float3 my_viscosity_sum = make_float3(0.f, 0.f, 0.f);
+
+	for_each_forward_neighbor(idx, [&](uint32_t j, float3 image) {
+		float3 diff = sorted_pos[j] + image - my_pos;
+		float r2 = dot(diff, diff);
+		float r = std::sqrt(r2);
+
+		if(r < collision_distance) {
+			add_contact(idx, j, worker);
+			add_contact(j, idx, worker);
+		}
+
+		if(0.00001f < r2 && r2 < h2) {
+			float their_density = sorted_density[j];
+			float3 dir = diff / r;
+
+			//the pressure term is antisymmetric in the pair, the viscosity term symmetric, but divided by the density of the other particle
+			float3 pressure_term = (my_pressure + pressure_at(their_density)) * pressure_w.gradient(r2) * dir / (2 * my_density * their_density);
+			float3 viscosity_term = (sorted_vel[j] - my_velocity) * viscosity_w.value(r2) * dir;
+
+			my_pressure_sum += pressure_term;
+			my_viscosity_sum += viscosity_term / their_density;
+
+			pressure_sum[j] -= pressure_term;
+			viscosity_sum[j] += viscosity_term / my_density;
+		}
+	});
+
+	pressure_sum[idx] += my_pressure_sum;
+	viscosity_sum[idx] += my_viscosity_sum;
+}
+
+template<size_t CLUSTER_SIZE, class DensityKernel>
+void cpu_engine::cluster_density_pass(const cluster_pair_list<CLUSTER_SIZE>& clusters, const DensityKernel& density_w){
+	pool.parallel_for(clusters.cluster_count(), cluster_pair_list<CLUSTER_SIZE>::CLUSTER_GRAIN, [&](size_t begin, size_t end, unsigned worker) {
+		PASS_WORKER(worker);
+		float h2 = params.smoothing_radius * params.smoothing_radius;
+
+		for(size_t c = begin; c < end; c++) {
+			const float* xi = clusters.x.data() + c * CLUSTER_SIZE;
+			const float* yi = clusters.y.data() + c * CLUSTER_SIZE;
+			const float* zi = clusters.z.data() + c * CLUSTER_SIZE;
+
+			float sum[CLUSTER_SIZE] = {};
+			PASS_COUNTER(uint32_t neighbors[CLUSTER_SIZE] = {});
+
+			const uint8_t* image = clusters.images_begin(c);
+
+			for(const uint32_t* j = clusters.pairs_begin(c); j != clusters.pairs_end(c); ++j, ++image) {
+				const float* xj = clusters.x.data() + *j * CLUSTER_SIZE;
+				const float* yj = clusters.y.data() + *j * CLUSTER_SIZE;
+				const float* zj = clusters.z.data() + *j * CLUSTER_SIZE;
+				float3 offset = clusters.image_offset(*image);
+
+				for(uint32_t jl = 0; jl < clusters.size(*j); jl++) {
+					float px = xj[jl] + offset.x;
+					float py = yj[jl] + offset.y;
+					float pz = zj[jl] + offset.z;
+
+					//one particle against all lanes, no branches, so this loop gets vectorized
+					for(size_t il = 0; il < CLUSTER_SIZE; il++) {
+						float dx = px - xi[il];
+						float dy = py - yi[il];
+						float dz = pz - zi[il];
+						float r2 = dx * dx + dy * dy + dz * dz;
+						float w = density_w.value(r2);
+
+						sum[il] += r2 < h2 ? w : 0.f;
+						PASS_COUNTER(neighbors[il] += r2 < h2 ? 1 : 0);
+					}
+				}
+			}
+
+			for(size_t il = 0; il < clusters.size(c); il++) {
+				uint32_t idx = clusters.lane[c * CLUSTER_SIZE + il];
+
+				//the particle itself is part of the sum, but not one of its neighbors
+				PASS_COUNTER(counters[worker].add_neighbors(neighbors[il] - 1));
+
+				sorted_density[idx] = std::max(params.reference_density, sum[il]);
+				density[grid[idx].particle_id] = sorted_density[idx];
+			}
+		}
+	});
+}
+
+template<size_t CLUSTER_SIZE, class PressureKernel, class ViscosityKernel>
+void cpu_engine::cluster_force_pass(cluster_pair_list<CLUSTER_SIZE>& clusters, const PressureKernel& pressure_w, const ViscosityKernel& viscosity_w){
+	size_t n = grid.size();
+
+	clusters.load_state(sorted_vel.data(), sorted_density.data(), pool);
+
+	pressure_sum.resize(n);
+	viscosity_sum.resize(n);
+	clear_contacts();
+
+	pool.parallel_for(clusters.cluster_count(), cluster_pair_list<CLUSTER_SIZE>::CLUSTER_GRAIN, [&](size_t begin, size_t end, unsigned worker) {
+		float h2 = params.smoothing_radius * params.smoothing_radius;
+		float collision_distance = params.particle_radius * 2;
+
+		for(size_t c = begin; c < end; c++) {
+			size_t ci = c * CLUSTER_SIZE;
+			const float* xi = clusters.x.data() + ci;
+			const float* yi = clusters.y.data() + ci;
+			const float* zi = clusters.z.data() + ci;
+			const float* vxi = clusters.vx.data() + ci;
+			const float* vyi = clusters.vy.data() + ci;
+			const float* vzi = clusters.vz.data() + ci;
+			const float* di = clusters.density.data() + ci;
+
+			float pi[CLUSTER_SIZE];
+			for(size_t il = 0; il < CLUSTER_SIZE; il++) {
+				pi[il] = pressure_at(di[il]);
+			}
+
+			float px[CLUSTER_SIZE] = {};
+			float py[CLUSTER_SIZE] = {};
+			float pz[CLUSTER_SIZE] = {};
+			float vx[CLUSTER_SIZE] = {};
+			float vy[CLUSTER_SIZE] = {};
+			float vz[CLUSTER_SIZE] = {};
+			float lane_r2[CLUSTER_SIZE];
+
+			const uint8_t* image = clusters.images_begin(c);
+
+			for(const uint32_t* j = clusters.pairs_begin(c); j != clusters.pairs_end(c); ++j, ++image) {
+				size_t cj = *j * CLUSTER_SIZE;
+				float3 offset = clusters.image_offset(*image);
+
+				for(uint32_t jl = 0; jl < clusters.size(*j); jl++) {
+					float xj = clusters.x[cj + jl] + offset.x;
+					float yj = clusters.y[cj + jl] + offset.y;
+					float zj = clusters.z[cj + jl] + offset.z;
+					float vxj = clusters.vx[cj + jl];
+					float vyj = clusters.vy[cj + jl];
+					float vzj = clusters.vz[cj + jl];
+					float dj = clusters.density[cj + jl];
+					float pj = pressure_at(dj);
+
+					float nearest = std::numeric_limits<float>::max();
+					for(size_t il = 0; il < CLUSTER_SIZE; il++) {
+						float dx = xj - xi[il];
+						float dy = yj - yi[il];
+						float dz = zj - zi[il];
+
+						lane_r2[il] = dx * dx + dy * dy + dz * dz;
+						nearest = std::min(nearest, lane_r2[il]);
+					}
+
+					//most particles of a close cluster are still out of reach for a whole cluster, they skip the expensive part
+					if(nearest >= h2) {
+						continue;
+					}
+
+					//the same terms as update_particle, dir = diff / r folded into the factors
+					for(size_t il = 0; il < CLUSTER_SIZE; il++) {
+						float dx = xj - xi[il];
+						float dy = yj - yi[il];
+						float dz = zj - zi[il];
+						float r2 = lane_r2[il];
+						float r = std::sqrt(r2);
+
+						bool interacts = 0.00001f < r2 && r2 < h2;
+						float pressure_factor = (pi[il] + pj) * pressure_w.gradient(r2) / (2 * di[il] * dj * r);
+						float viscosity_factor = viscosity_w.value(r2) / (dj * r);
+
+						px[il] += interacts ? pressure_factor * dx : 0.f;
+						py[il] += interacts ? pressure_factor * dy : 0.f;
+						pz[il] += interacts ? pressure_factor * dz : 0.f;
+						vx[il] += interacts ? (vxj - vxi[il]) * viscosity_factor * dx : 0.f;
+						vy[il] += interacts ? (vyj - vyi[il]) * viscosity_factor * dy : 0.f;
+						vz[il] += interacts ? (vzj - vzi[il]) * viscosity_factor * dz : 0.f;
+					}
+
+					//contacts are rare, they are looked for only if one of the lanes is close enough
+					//the bound is a little wider than the exact test below, which takes the square root like update_particle
+					if(nearest < collision_distance * collision_distance * 1.01f) {
+						uint32_t other = clusters.lane[cj + jl];
+
+						for(size_t il = 0; il < clusters.size(c); il++) {
+							uint32_t idx = clusters.lane[ci + il];
+
+							if(idx != other && std::sqrt(lane_r2[il]) < collision_distance) {
+								add_contact(idx, other, worker);
+							}
+						}
+					}
+				}
+			}
+
+			for(size_t il = 0; il < clusters.size(c); il++) {
+				uint32_t idx = clusters.lane[ci + il];
+
+				pressure_sum[idx] = make_float3(px[il], py[il], pz[il]);
+				viscosity_sum[idx] = make_float3(vx[il], vy[il], vz[il]);
+			}
+		}
+	});
+
+	resolve_contacts_and_integrate();
+}
+
+void cpu_engine::clear_contacts(){
+	worker_contacts.resize(pool.size());
+
+	for(std::vector<contact>& c : worker_contacts) {
+		c.clear();
+	}
+	contact_count.store(0, std::memory_order_relaxed);
+}
+
+void cpu_engine::add_contact(uint32_t idx, uint32_t other, unsigned worker){
+	size_t slot = contact_count.fetch_add(1, std::memory_order_relaxed);
+
+	if(slot < contacts.size()) {
+		contacts[slot] = {idx, other};
+	} else {
+		worker_contacts[worker].push_back({idx, other});
+	}
+}
+
+void cpu_engine::resolve_contacts_and_integrate(){
+	size_t n = grid.size();
+	size_t found = contact_count.load(std::memory_order_relaxed);
+
+	//more contacts than ever before, the lists of the workers are only needed until contacts has grown
+	if(found > contacts.size()) {
+		size_t stored = contacts.size();
+		contacts.resize(found + found / 4);
+
+		for(std::vector<contact>& c : worker_contacts) {
+			std::copy(c.begin(), c.end(), contacts.begin() + stored);
+			stored += c.size();
+			std::vector<contact>().swap(c);
+		}
+	}
+	const auto contacts_end = contacts.begin() + found;
+
+	//sorting makes the order of the contacts independent of which worker found them
+	std::sort(contacts.begin(), contacts_end, [](const contact& a, const contact& b) {
+		return a.idx < b.idx || (a.idx == b.idx && a.other < b.other);
+	});
+
+	pool.parallel_for(n, PARTICLE_GRAIN, [this, contacts_end](size_t begin, size_t end, unsigned worker) {
+		float collision_distance = params.particle_radius * 2;
+
+		auto c = std::lower_bound(contacts.begin(), contacts_end, static_cast<uint32_t>(begin), [](const contact& a, uint32_t idx) {
+			return a.idx < idx;
+		});
+
+		for(size_t idx = begin; idx < end; idx++) {
+			float3 my_pos = sorted_pos[idx];
+			float3 my_velocity = sorted_vel[idx];
+
+			//by ascending index of the other particle, full_stencil resolves them as it meets them instead, see force_evaluation
+			for(; c != contacts_end && c->idx == idx; ++c) {
+				float3 diff = minimum_image(sorted_pos[c->other] - my_pos);
+				float r2 = dot(diff, diff);
+
+				if(std::sqrt(r2) < collision_distance) {
+					collide(my_pos, my_velocity, diff, r2, sorted_vel[c->other], worker);
+				}
+			}
+
+			integrate(static_cast<uint32_t>(idx), my_pos, my_velocity, viscosity_sum[idx], pressure_sum[idx], worker);
+		}
+	});
+}
+
+void cpu_engine::collide(float3& my_pos, float3& my_velocity, float3 diff, float r2, float3 their_velocity, unsigned worker){
+	PASS_WORKER(worker);
+	PASS_COUNTER(counters[worker].collisions_resolved++);
+
+	float r = std::sqrt(r2);
+	float collision_distance = params.particle_radius * 2;
+	float cos_alpha = dot(normalize(my_velocity), normalize(diff));
+
+	if(cos_alpha > 0) { // this particle actively collides with the other one
+		float3 axis = cross(my_velocity, diff);
+
+		//a head on collision has no rotation axis, the shader produces NaNs there, the remaining velocity would be zero anyway
+		if(r2 > 0.0001f && dot(axis, axis) > 0.f) {
+			my_velocity = rotate(axis, normalize(diff) * length(my_velocity) * std::sqrt(std::max(0.f, 1 - cos_alpha * cos_alpha)));
+		} else {
+			my_velocity = make_float3(0.f, 0.f, 0.f);
+		}
+	} else {
+		cos_alpha = dot(normalize(their_velocity), normalize(-diff));
+
+		if(cos_alpha > 0) { // the other particle plays the active role
+			my_velocity += normalize(-diff) * length(their_velocity) * cos_alpha;
+		}
+	}
+
+	//two particles at the exact same spot have no direction to be pushed apart in
+	if(r2 > 0.f) {
+		my_pos += normalize(-diff) * (collision_distance - r);
+	}
+}
+
+void cpu_engine::integrate(uint32_t idx, float3 my_pos, float3 my_velocity, float3 viscosity_force, float3 pressure_force, unsigned worker){
+	PASS_WORKER(worker);
+	float my_density = sorted_density[idx];
+
+	viscosity_force *= viscosity_scale;
+
+	float3 gravity = make_float3(params.gravity[0], params.gravity[1], params.gravity[2]);
+	my_velocity += params.timestep * ((viscosity_force - pressure_force) / my_density + gravity);
+	my_pos += params.timestep * my_velocity;
+
+	//particles leaving through a periodic face come back in on the other side
+	if(params.periodic[0]) {
+		my_pos.x -= period[0] * std::floor(my_pos.x / period[0]);
+	}
+	if(params.periodic[1]) {
+		my_pos.y -= period[1] * std::floor(my_pos.y / period[1]);
+	}
+	if(params.periodic[2]) {
+		my_pos.z -= period[2] * std::floor(my_pos.z / period[2]);
+	}
+
+	//keep the particles in a finite box
+	{
+		float3 normal = make_float3(0.f, 0.f, 0.f);
+
+		if(!params.periodic[0] && my_pos.x < 0.f) {
+			normal += make_float3(1, 0, 0);
+		}
+		if(!params.periodic[0] && my_pos.x > params.boundary[0]) {
+			normal += make_float3(-1, 0, 0);
+		}
+
+		if(!params.periodic[1] && my_pos.y < 0.f) {
+			normal += make_float3(0, 1, 0);
+		}
+		if(!params.periodic[1] && my_pos.y > params.boundary[1]) {
+			normal += make_float3(0, -1, 0);
+		}
+
+		if(!params.periodic[2] && my_pos.z < 0.f) {
+			normal += make_float3(0, 0, 1);
+		}
+		if(!params.periodic[2] && my_pos.z > params.boundary[2]) {
+			normal += make_float3(0, 0, -1);
+		}
+
+		if(dot(normal, normal) > 0.1f) {
+			PASS_COUNTER(counters[worker].boundary_clamps++);
+
+			float speed = length(my_velocity);
+
+			//a resting particle has no direction to be reflected, the shader would produce NaNs here
+			if(speed > 0.f) {
+				my_velocity = 0.5f * speed * normalize(reflect(normalize(my_velocity), normalize(normal)));
+			}
+
+			my_pos.x = std::max(0.f, std::min(params.boundary[0], my_pos.x));
+			my_pos.y = std::max(0.f, std::min(params.boundary[1], my_pos.y));
+			my_pos.z = std::max(0.f, std::min(params.boundary[2], my_pos.z));
+		}
+	}
+
+	next_pos[idx] = my_pos;
+	next_vel[idx] = my_velocity;
+}
+
+cpu_engine::step_summary cpu_engine::summarize() const{
+	struct partial {
+		double kinetic_energy;
+		double density_sum;
+		float max_density;
+		float max_speed;
+	};
+
+	auto accumulate = [this](partial& p, size_t begin, size_t end) {
+		for(size_t i = begin; i < end; i++) {
+			float speed2 = dot(vel[i], vel[i]);
+
+			p.kinetic_energy += 0.5 * speed2;
+			p.density_sum += density[i];
+			p.max_density = std::max(p.max_density, density[i]);
+			p.max_speed = std::max(p.max_speed, std::sqrt(speed2));
+		}
+	};
+
+	size_t n = pos.size();
+
+	step_arena::scope scope(scratch);
+	partial* partials;
+	size_t partial_count;
+
+	if(mode == execution_mode::deterministic) {
+		//one partial per fixed block, combined in block order below
+		partial_count = (n + DETERMINISTIC_BLOCK_SIZE - 1) / DETERMINISTIC_BLOCK_SIZE;
+		partials = scratch.allocate<partial>(partial_count);
+		std::fill(partials, partials + partial_count, partial());
+
+		pool.parallel_for(n, DETERMINISTIC_BLOCK_SIZE, [&](size_t begin, size_t end, unsigned) {
+			accumulate(partials[begin / DETERMINISTIC_BLOCK_SIZE], begin, end);
+		});
+	} else {
+		//one partial per worker, which blocks a worker picks up changes from run to run
+		partial_count = pool.size();
+		partials = scratch.allocate<partial>(partial_count);
+		std::fill(partials, partials + partial_count, partial());
+
+		pool.parallel_for(n, PARTICLE_GRAIN, [&](size_t begin, size_t end, unsigned worker) {
+			accumulate(partials[worker], begin, end);
+		});
+	}
+
+	partial total = partial();
+	for(size_t i = 0; i < partial_count; i++) {
+		const partial& p = partials[i];
+
+		total.kinetic_energy += p.kinetic_energy;
+		total.density_sum += p.density_sum;
+		total.max_density = std::max(total.max_density, p.max_density);
+		total.max_speed = std::max(total.max_speed, p.max_speed);
+	}
+
+	step_summary summary;
+	summary.kinetic_energy = total.kinetic_energy;
+	summary.mean_density = n > 0 ? total.density_sum / n : 0.0;
+	summary.max_density = total.max_density;
+	summary.max_speed = total.max_speed;
+
+	return summary;
+}
+
+uint64_t cpu_engine::count_neighbor_pairs() const{
+	step_arena::scope scope(scratch);
+	uint64_t* partials = scratch.allocate<uint64_t>(pool.size());
+	std::fill(partials, partials + pool.size(), 0);
+
+	pool.parallel_for(grid.size(), PARTICLE_GRAIN, [&](size_t begin, size_t end, unsigned worker) {
+		float h2 = params.smoothing_radius * params.smoothing_radius;
+
+		for(size_t i = begin; i < end; i++) {
+			float3 my_pos = sorted_pos[i];
+
+			for_each_neighbor_cell(grid[i].cell_id, [&](uint32_t j, float3 image) {
+				float3 diff = sorted_pos[j] + image - my_pos;
+
+				if(j != i && dot(diff, diff) < h2) {
+					partials[worker]++;
+				}
+			});
+		}
+	});
+
+	uint64_t count = 0;
+	for(unsigned worker = 0; worker < pool.size(); worker++) {
+		count += partials[worker];
+	}
+	return count;
+}
+
+uint64_t cpu_engine::state_hash() const{
+	uint64_t hash = 0xcbf29ce484222325ull;
+
+	auto add = [&hash](const std::vector<float3>& values) {
+		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(values.data());
+
+		for(size_t i = 0; i < values.size() * sizeof(float3); i++) {
+			hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+		}
+	};
+
+	add(pos);
+	add(vel);
+
+	return hash;
+}
+
+const simulation_parameters& cpu_engine::parameters() const{
+	return params;
+}
+
+const uint32_t* cpu_engine::grid_size() const{
+	return grid_dim;
+}
+
+uint32_t cpu_engine::grid_size_flat() const{
+	return grid_flat;
+}
+
+const float* cpu_engine::cell_extent() const{
+	return cell_size;
+}
+
+const std::vector<float3>& cpu_engine::positions() const{
+	return pos;
+}
+
+const std::vector<float3>& cpu_engine::velocities() const{
+	return vel;
+}
@@ -0,0 +1,362 @@
+#pragma once
+
+#include "cluster_pair_list.h"
+#include "pass_statistics.h"
+#include "src/Simulation2/sph_kernels.h"
+#include "src/Utility/aligned_array.h"
+#include "src/Utility/float3.h"
+#include "src/Utility/step_arena.h"
+#include "src/Utility/thread_pool.h"
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+//runtime counterpart of frame_constants, so the CPU engine can be run with other particle counts and box sizes
+struct simulation_parameters {
+	uint32_t particle_count;
+
+	float smoothing_radius;
+	float pressure_constant;
+	float viscosity_constant;
+	float reference_density;
+	float timestep;
+	float particle_radius;
+	float initial_displacement;
+
+	float gravity[3];
+	float boundary[3];
+
+	//per axis, whether particles leaving the box on one side come back in on the other instead of bouncing off a wall
+	//a periodic axis needs a box of at least three smoothing radii, so the 27 cells around a particle are distinct
+	bool periodic[3];
+
+	//the values Simulation2 runs with
+	static simulation_parameters from_frame_constants();
+};
+
+//how the CPU engine trades speed for reproducibility
+//
+//fast:
+//	the particle pairs are sorted by cell id only. the sort runs on one chunk per thread and merges them,
+//	so the order of the particles within a cell (and with it the summation order in the density and force passes)
+//	depends on the number of threads. step summaries are accumulated per worker.
+//
+//deterministic:
+//	the pairs are sorted by (cell id, particle id), which is a total order, so every neighbor loop visits the particles in the same order.
+//	step summaries are reduced over fixed blocks of DETERMINISTIC_BLOCK_SIZE particles and combined in block order.
+//	two runs with the same input produce bitwise identical results, no matter how many threads are used.
+//	the cost is the wider sort key and the per block partial sums. the sort gets about 40% slower, but it is a tiny part of a step
+//	next to the neighbor loops, so a whole step costs the same within measurement noise (32K particles, initial cube).
+//
+//both modes read the state of the previous step and write the new one into separate buffers,
+//unlike apply_forces.hlsl, which updates pos_buffer in place while other threads read it.
+//the cell table is derived from the run boundaries of the sorted array, so every entry is written by exactly one thread
+//instead of InterlockedMin as in create_table.hlsl.
+enum class execution_mode {
+	fast,
+	deterministic,
+};
+
+//the kernels of the CPU engine, the same as in the shaders
+//the density and force loops are templates over the kernel types, so replacing a policy here gives loops specialized for the new kernel
+struct engine_kernels {
+	typedef poly6_kernel density;
+	typedef spiky_kernel pressure;
+	typedef viscosity_kernel viscosity;
+};
+
+//analytic evaluates the kernel formulas for every pair,
+//tabulated interpolates them from tabulated_kernel tables, which trades a little accuracy for no sqrt or division per kernel.
+//the force loop still needs the distance for the collision response, so with the shader kernels both run within noise of each other,
+//tables pay off for kernels with more expensive formulas.
+enum class kernel_evaluation {
+	analytic,
+	tabulated,
+};
+
+//how the force pass visits the particle pairs
+//
+//full_stencil:
+//	every particle loops over all 27 cells around it, as apply_forces.hlsl does, so every pair is evaluated twice.
+//	collisions are resolved while looping, later neighbors see the already corrected position and velocity.
+//
+//half_stencil:
+//	every pair is evaluated once, from the particle that comes first in the sorted order, which only has to visit its own cell
+//	and the 13 cells after it. the pressure and viscosity terms are added to both particles.
+//	a pair can reach one cell further along every axis, so the grid is cut into planes and bands of cells that are run in parallel
+//	in four colors by parity, and no two threads ever write the same particle. the bands only depend on the grid,
+//	so the summation order doesn't depend on the number of threads.
+//	this is a different contact integration order than full_stencil, with different results:
+//	the pair terms use the positions and velocities at the start of the step, contacts closer than two particle radii are recorded
+//	and only resolved per particle after all pairs, by ascending index of the other particle.
+//	full_stencil resolves a contact as soon as it meets it, and the later neighbors of the particle see the corrected position and velocity.
+//	the two modes drift apart step by step, after 5 steps of the default 4K particles the kinetic energy differs by about 11%.
+//	the cluster loops integrate the contacts the same way as half_stencil.
+enum class force_evaluation {
+	full_stencil,
+	half_stencil,
+};
+
+//which loops the density and force passes run
+//
+//per_particle:
+//	every particle loops over the particles of the 27 cells around it, the force pass as chosen by force_evaluation.
+//
+//cluster_pairs_4, cluster_pairs_8:
+//	create_table also cuts the sorted particles into clusters of 4 or 8 and builds their cluster_pair_list.
+//	both passes then compare one particle against all lanes of a cluster at once, which compilers turn into SIMD code.
+//	the force pass visits every pair from both sides, but otherwise works like half_stencil:
+//	velocities from the start of the step, contacts resolved afterwards. force_evaluation is ignored.
+enum class neighbor_loop {
+	per_particle,
+	cluster_pairs_4,
+	cluster_pairs_8,
+};
+
+//how sort orders the particle pairs by cell, and where the cell table comes from
+//
+//comparison:
+//	the pairs are sorted as execution_mode describes, create_table finds the cells at the run boundaries of the sorted array.
+//	the cost only depends on the number of particles, so it suits grids that are much larger than the fluid.
+//
+//counting:
+//	every chunk of pairs counts its pairs per cell, and an exclusive scan over the counts in (cell, chunk) order gives both
+//	the start of every cell and the position every chunk scatters its pairs of that cell to. the sort writes the cell table on the way.
+//	no two threads write the same count or position, and the scatter keeps the order of the last step within a cell,
+//	so the result is the same for any number of threads in both execution modes.
+//	the counts and the scan visit every cell once per chunk, which pays off while the grid has fewer cells than there are particles.
+enum class cell_sort {
+	comparison,
+	counting,
+};
+
+//multithreaded CPU implementation of the Simulation2 compute passes
+//
+//the passes mirror the shaders in shader/compute, but the density and force passes only visit the 27 cells around a particle
+//instead of every particle.
+class cpu_engine {
+public:
+	struct step_summary {
+		double kinetic_energy;
+		double mean_density;
+		float max_density;
+		float max_speed;
+	};
+
+	static constexpr size_t DETERMINISTIC_BLOCK_SIZE = 4096;
+	//number of steps kept in the statistics history
+	static constexpr size_t STATISTICS_HISTORY = 256;
+
+	cpu_engine(const simulation_parameters& params, thread_pool& pool);
+
+	//places the particles in the same cube computation::load_assets starts with
+	void load_initial_cube();
+	void set_state(const float3* positions, const float3* velocities);
+
+	void set_execution_mode(execution_mode mode);
+	execution_mode get_execution_mode() const;
+
+	void set_kernel_evaluation(kernel_evaluation evaluation);
+	kernel_evaluation get_kernel_evaluation() const;
+
+	void set_force_evaluation(force_evaluation evaluation);
+	force_evaluation get_force_evaluation() const;
+
+	void set_neighbor_loop(neighbor_loop loop);
+	neighbor_loop get_neighbor_loop() const;
+
+	void set_cell_sort(cell_sort sort);
+	cell_sort get_cell_sort() const;
+
+	//runs all passes in the order below
+	void step();
+
+	void create_grid();
+	void sort();
+	void create_table();
+	void evaluate_density();
+	void apply_forces();
+
+	step_summary summarize() const;
+
+	//number of (i, j) pairs with i != j closer than the smoothing radius, from the table of the last create_table
+	uint64_t count_neighbor_pairs() const;
+
+	//FNV-1a hash over the bit patterns of all positions and velocities, for comparing runs
+	uint64_t state_hash() const;
+
+#ifdef ENABLE_PASS_STATISTICS
+	//closes the statistics of all passes run since the last call and adds them to the history
+	//step() calls it on its own, it is only needed when the passes are run one by one
+	void record_statistics();
+
+	//statistics of the last recorded step, all zero before the first one
+	const step_statistics& last_statistics() const;
+	const statistics_ring& statistics_history() const;
+#endif
+
+	const simulation_parameters& parameters() const;
+	const uint32_t* grid_size() const;
+	uint32_t grid_size_flat() const;
+	//edge lengths of the grid cells, cell (x, y, z) starts at (x, y, z) * cell_extent()
+	const float* cell_extent() const;
+
+	//indexed by particle id
+	const std::vector<float3>& positions() const;
+	const std::vector<float3>& velocities() const;
+
+private:
+	//same layout as the Pair struct in the shaders
+	struct pair {
+		uint32_t cell_id;
+		uint32_t particle_id;
+	};
+
+	//the pairs [start, start + count) of grid belong to the cell, only valid if generation is the one of the last table
+	struct cell_entry {
+		uint32_t generation;
+		uint32_t start;
+		uint32_t count;
+	};
+
+	//two particles closer than two particle radii, as indices into grid
+	struct contact {
+		uint32_t idx;
+		uint32_t other;
+	};
+
+	simulation_parameters params;
+	thread_pool& pool;
+	execution_mode mode;
+	kernel_evaluation evaluation;
+	force_evaluation forces;
+	neighbor_loop loops;
+	cell_sort sorting;
+
+	uint32_t grid_dim[3];
+	uint32_t grid_flat;
+
+	//edge lengths of the cells, periodic axes stretch them so a whole number of cells fills the box
+	float cell_size[3];
+	//box length on periodic axes, 0 on the others
+	float period[3];
+
+	kernel<engine_kernels::density> analytic_density;
+	kernel<engine_kernels::pressure> analytic_pressure;
+	kernel<engine_kernels::viscosity> analytic_viscosity;
+	tabulated_kernel<engine_kernels::density> tabulated_density;
+	tabulated_kernel<engine_kernels::pressure> tabulated_pressure;
+	tabulated_kernel<engine_kernels::viscosity> tabulated_viscosity;
+
+	//apply_forces.hlsl uses the viscosity kernel without its normalization, viscosity_constant is tuned for that
+	float viscosity_scale;
+
+	//particle state, indexed by particle id
+	std::vector<float3> pos;
+	std::vector<float3> vel;
+	std::vector<float> density;
+
+	//particle pairs ordered by cell, grid_scratch is the merge buffer of the sort
+	std::vector<pair> grid;
+	std::vector<pair> grid_scratch;
+
+	//the pairs of every cell in grid, a cell holds no particle if its entry is from an older generation
+	//so the table is built by only writing the occupied cells instead of clearing it every step
+	std::vector<cell_entry> lookup;
+	uint32_t table_generation;
+
+	//copies of the particle state in the order of grid, so the neighbor loops read memory sequentially
+	std::vector<float3> sorted_pos;
+	std::vector<float3> sorted_vel;
+	std::vector<float> sorted_density;
+	std::vector<float3> next_pos;
+	std::vector<float3> next_vel;
+
+	//per particle sums of the half stencil force pass, in the order of grid
+	std::vector<float3> pressure_sum;
+	std::vector<float3> viscosity_sum;
+
+	//the workers take the slots of contacts from contact_count, the contacts that don't fit go to the list of their worker.
+	//contacts keeps the size of the step with the most contacts so far plus a quarter, so how the work is spread over
+	//the workers doesn't matter and only a step with more contacts than any before goes to the heap.
+	//once resolved they are sorted by (idx, other)
+	std::vector<contact> contacts;
+	std::atomic<size_t> contact_count;
+	std::vector<std::vector<contact>> worker_contacts;
+
+	//only the one of the current neighbor_loop is built
+	cluster_pair_list<4> clusters_4;
+	cluster_pair_list<8> clusters_8;
+
+	//scratch of the passes and the reductions that is only needed until the step ends, create_grid resets it
+	//mutable, as the const reductions allocate their partials from it as well
+	mutable step_arena scratch;
+
+	uint32_t cell_of(float3 p) const;
+
+	//the generation of a new cell table, clears the table when the generation wraps around
+	uint32_t next_table_generation();
+
+	void comparison_sort();
+	//the sort and the cell table of cell_sort::counting
+	void counting_sort();
+
+	//the cell coordinate at offset d from c along axis, wrapped on periodic axes
+	//image is the shift that brings the particles of the wrapped cell next to c, false if there is no such cell
+	bool neighbor_coordinate(int axis, int c, int d, int& neighbor, float& image) const;
+
+	//the shortest of the periodic images of the vector d
+	float3 minimum_image(float3 d) const;
+
+	//calls fn(j, image) for every particle j in the 27 cells around cell_id, sorted_pos[j] + image is the position closest to the cell
+	template<class F>
+	void for_each_neighbor_cell(uint32_t cell_id, F&& fn) const;
+
+	//calls fn(j, image) for every pair (idx, j) in the 27 cells around idx exactly once over all idx
+	template<class F>
+	void for_each_forward_neighbor(uint32_t idx, F&& fn) const;
+
+#ifdef ENABLE_PASS_STATISTICS
+	uint64_t step_count;
+	step_statistics current_statistics;
+	step_statistics last_step_statistics;
+	statistics_ring history;
+	aligned_array<pass_counters> counters;
+#endif
+
+	float pressure_at(float particle_density) const;
+
+	template<class DensityKernel>
+	void density_pass(const DensityKernel& density_w);
+
+	template<class PressureKernel, class ViscosityKernel>
+	void force_pass(const PressureKernel& pressure_w, const ViscosityKernel& viscosity_w);
+
+	template<class PressureKernel, class ViscosityKernel>
+	void update_particle(uint32_t idx, unsigned worker, const PressureKernel& pressure_w, const ViscosityKernel& viscosity_w);
+
+	template<class PressureKernel, class ViscosityKernel>
+	void half_stencil_force_pass(const PressureKernel& pressure_w, const ViscosityKernel& viscosity_w);
+
+	template<class PressureKernel, class ViscosityKernel>
+	void accumulate_pairs(uint32_t idx, unsigned worker, const PressureKernel& pressure_w, const ViscosityKernel& viscosity_w);
+
+	template<size_t CLUSTER_SIZE, class DensityKernel>
+	void cluster_density_pass(const cluster_pair_list<CLUSTER_SIZE>& clusters, const DensityKernel& density_w);
+
+	template<size_t CLUSTER_SIZE, class PressureKernel, class ViscosityKernel>
+	void cluster_force_pass(cluster_pair_list<CLUSTER_SIZE>& clusters, const PressureKernel& pressure_w, const ViscosityKernel& viscosity_w);
+
+	//empties contacts before a force pass
+	void clear_contacts();
+	void add_contact(uint32_t idx, uint32_t other, unsigned worker);
+	//resolves the contacts found by the force pass and integrates every particle with pressure_sum and viscosity_sum
+	void resolve_contacts_and_integrate();
+
+	//the collision response of apply_forces.hlsl for a neighbor at my_pos + diff
+	void collide(float3& my_pos, float3& my_velocity, float3 diff, float r2, float3 their_velocity, unsigned worker);
+
+	//applies the summed forces, moves the particle and keeps it in the box, writes next_pos and next_vel
+	void integrate(uint32_t idx, float3 my_pos, float3 my_velocity, float3 viscosity_force, float3 pressure_force, unsigned worker);
+};
@@ -0,0 +1,400 @@
+#include "emulated_computation.h"
+#include "src/Simulation2/sph_kernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+namespace {
+	struct float3x3 {
+		float3 rows[3];
+	};
+
+	float3x3 make_float3x3(float3 row0, float3 row1, float3 row2){
+		float3x3 result = {{row0, row1, row2}};
+		return result;
+	}
+
+	float3 mul(const float3x3& m, float3 v){
+		return make_float3(dot(m.rows[0], v), dot(m.rows[1], v), dot(m.rows[2], v));
+	}
+
+	//returns a matrix representing a -90 degree rotation around the given axis
+	float3x3 get_rotation_matrix(float3 axis){
+		float3 n = normalize(axis);
+
+		return make_float3x3(
+			make_float3(n.x * n.x, n.x * n.y + n.z, n.x * n.z - n.y),
+			make_float3(n.x * n.y - n.z, n.y * n.y, n.y * n.z + n.x),
+			make_float3(n.x * n.z + n.y, n.y * n.z - n.x, n.z * n.z)
+		);
+	}
+
+	uint32_t get_idx(uint32_t thread_id, uint32_t stepsize){
+		return ((thread_id & ~((1 << stepsize) - 1)) << 1) + (thread_id & ((1 << stepsize) - 1));
+	}
+}
+
+constexpr uint32_t emulated_computation::THREAD_COUNT;
+
+emulated_computation::emulated_computation(const simulation_parameters& params, thread_pool& pool) :
+	params(params),
+	dispatcher(pool),
+	pos_buffer(params.particle_count, make_float3(0.f, 0.f, 0.f)),
+	velocity_buffer(params.particle_count, make_float3(0.f, 0.f, 0.f)),
+	density_buffer(params.particle_count, params.reference_density),
+	grid_buffer(params.particle_count),
+	table_generation(0),
+	previous_pos(params.particle_count),
+	previous_velocity(params.particle_count)
+{
+	if(params.particle_count == 0 || params.particle_count % (2 * THREAD_COUNT) != 0) {
+		throw std::runtime_error("emulated_computation needs a particle count that is a multiple of " + std::to_string(2 * THREAD_COUNT));
+	}
+
+	//same as in the computation constructor, from the kernel policies cpu_engine evaluates
+	constants.density_kernel_constant = poly6_kernel::normalization(params.smoothing_radius);
+	constants.particle_count = params.particle_count;
+	constants.pressure_constant = params.pressure_constant;
+	constants.pressure_kernel_constant = spiky_kernel::gradient_factor(params.smoothing_radius);
+	constants.reference_density = params.reference_density;
+	constants.smoothing_radius = params.smoothing_radius;
+	constants.timestep = params.timestep;
+	constants.viscosity_constant = params.viscosity_constant;
+	constants.gravity = make_float3(params.gravity[0], params.gravity[1], params.gravity[2]);
+	constants.boundary_x = params.boundary[0];
+	constants.boundary_y = params.boundary[1];
+	constants.boundary_z = params.boundary[2];
+	constants.particle_radius = params.particle_radius;
+	constants.grid_size = make_uint3(
+		static_cast<uint32_t>(params.boundary[0] / params.smoothing_radius + 1),
+		static_cast<uint32_t>(params.boundary[1] / params.smoothing_radius + 1),
+		static_cast<uint32_t>(params.boundary[2] / params.smoothing_radius + 1));
+
+	lookup_buffer.assign(constants.grid_size.x * constants.grid_size.y * constants.grid_size.z, CellEntry{0, 0});
+}
+
+void emulated_computation::load_initial_cube(){
+	uint32_t n = params.particle_count;
+	float diff = params.initial_displacement;
+
+	float cube_length_particles = std::pow(static_cast<float>(n), 0.3333333333333333f);
+	float cube_length = cube_length_particles * diff;
+	float start_x = (params.boundary[0] - cube_length) * 0.5f;
+	float start_z = (params.boundary[2] - cube_length) * 0.5f;
+
+	uint32_t i = 0;
+	for(int x = 0; x < cube_length_particles && i < n; x++) {
+		for(int y = 0; y < cube_length_particles && i < n; y++) {
+			for(int z = 0; z < cube_length_particles && i < n; z++) {
+				pos_buffer[i] = make_float3(start_x + x * diff, (y + 1) * diff, start_z + z * diff);
+				velocity_buffer[i] = make_float3(0.f, 0.f, 0.f);
+				i++;
+			}
+		}
+	}
+}
+
+void emulated_computation::set_state(const float3* positions, const float3* velocities){
+	std::copy(positions, positions + params.particle_count, pos_buffer.begin());
+	std::copy(velocities, velocities + params.particle_count, velocity_buffer.begin());
+}
+
+void emulated_computation::step(){
+	create_grid();
+	sort();
+	create_table();
+	evaluate_density();
+	apply_forces();
+}
+
+uint3 emulated_computation::particle_groups() const{
+	return make_uint3(params.particle_count / THREAD_COUNT, 1, 1);
+}
+
+void emulated_computation::create_grid(){
+	dispatcher.dispatch(make_uint3(THREAD_COUNT, 1, 1), particle_groups(), [this](const thread_ids& ids) { create_grid_cs(ids); });
+}
+
+//the same sequence of dispatches as in computation::populate_command_list
+void emulated_computation::sort(){
+	SortParameters sort_constants;
+	sort_constants.max_idx = params.particle_count;
+
+	int max_step = static_cast<int>(std::ceil(std::log2(params.particle_count / 2)));
+	uint32_t threads_needed = params.particle_count / 2 + params.particle_count % 2;
+
+	for(int step = 0; step <= max_step; step++) {
+		sort_constants.global_stepsize = step;
+		int cur_step = step + 1;
+
+		// if the steps get too big, synchronise globally
+		do {
+			cur_step--;
+
+			sort_constants.local_stepsize = cur_step;
+
+			dispatcher.dispatch_with_barriers(make_uint3(THREAD_COUNT, 1, 1), make_uint3(threads_needed / THREAD_COUNT, 1, 1),
+				[&](const thread_ids& ids, uint32_t phase) { return sort_cs(ids, phase, sort_constants); });
+
+		} while((1u << cur_step) >= THREAD_COUNT);
+	}
+}
+
+void emulated_computation::create_table(){
+	//the table is only reset from lookup_reset_buffer when the generation wraps around
+	if(++table_generation == 0) {
+		std::fill(lookup_buffer.begin(), lookup_buffer.end(), CellEntry{0, 0});
+		table_generation = 1;
+	}
+
+	dispatcher.dispatch(make_uint3(THREAD_COUNT, 1, 1), particle_groups(), [this](const thread_ids& ids) { create_table_cs(ids); });
+}
+
+void emulated_computation::evaluate_density(){
+	dispatcher.dispatch(make_uint3(THREAD_COUNT, 1, 1), particle_groups(), [this](const thread_ids& ids) { density_evaluation_cs(ids); });
+}
+
+void emulated_computation::apply_forces(){
+	previous_pos = pos_buffer;
+	previous_velocity = velocity_buffer;
+
+	dispatcher.dispatch(make_uint3(THREAD_COUNT, 1, 1), particle_groups(), [this](const thread_ids& ids) { apply_forces_cs(ids); });
+}
+
+//create_grid.hlsl
+void emulated_computation::create_grid_cs(const thread_ids& ids){
+	uint32_t my_idx = ids.dispatch_thread_id.x;
+	float3 my_pos = pos_buffer[my_idx];
+	int cell_id_x = hlsl_float_to_int(std::floor(my_pos.x / constants.smoothing_radius));
+	int cell_id_y = hlsl_float_to_int(std::floor(my_pos.y / constants.smoothing_radius));
+	int cell_id_z = hlsl_float_to_int(std::floor(my_pos.z / constants.smoothing_radius));
+
+	int flat_cell_id = cell_id_z * constants.grid_size.x * constants.grid_size.y + cell_id_y * constants.grid_size.x + cell_id_x;
+
+	grid_buffer[my_idx].cell_id = flat_cell_id;
+	grid_buffer[my_idx].particle_id = my_idx;
+}
+
+//sort.hlsl, split at its AllMemoryBarrier
+//
+//AllMemoryBarrier only orders memory accesses and doesn't wait for the other threads of the group,
+//the shader relies on it like on AllMemoryBarrierWithGroupSync though, so that is what is emulated here
+bool emulated_computation::sort_cs(const thread_ids& ids, uint32_t phase, const SortParameters& sort_constants){
+	uint32_t id = ids.dispatch_thread_id.x;
+
+	//if the stepsize is too big, groups have to be synched globally
+	if((1u << sort_constants.local_stepsize) >= THREAD_COUNT) {
+		uint32_t idx = get_idx(id, sort_constants.local_stepsize);
+
+		compare_swap(idx, id, sort_constants.local_stepsize, sort_constants);
+		return false;
+	}
+
+	//one iteration of the while loop per phase
+	int cur_stepsize = static_cast<int>(sort_constants.local_stepsize) - static_cast<int>(phase);
+
+	uint32_t idx = get_idx(id, cur_stepsize);
+	compare_swap(idx, id, cur_stepsize, sort_constants);
+
+	return cur_stepsize != 0;
+}
+
+void emulated_computation::compare_swap(uint32_t idx, uint32_t thread_id, uint32_t cur_stepsize, const SortParameters& sort_constants){
+	if(idx < sort_constants.max_idx) {
+
+		// if the size of the array to sort is not a power of 2
+		// the indices have to be adjusted as follows
+		uint32_t my_block = idx >> (cur_stepsize + 1);
+		uint32_t next_block_max = ((my_block + 1) << (cur_stepsize + 1)) - 1;
+
+		if(next_block_max >= sort_constants.max_idx) {
+			idx += (next_block_max - sort_constants.max_idx) + 1;
+		}
+
+		uint32_t other_idx = idx + (1 << cur_stepsize);
+
+		if(other_idx < sort_constants.max_idx) {
+			bool ascending = (thread_id & (1 << sort_constants.global_stepsize)) == 0;
+
+			if(grid_buffer[idx].cell_id != grid_buffer[other_idx].cell_id) {
+
+				if((grid_buffer[idx].cell_id < grid_buffer[other_idx].cell_id) != ascending) {
+					Pair help = grid_buffer[idx];
+					grid_buffer[idx] = grid_buffer[other_idx];
+					grid_buffer[other_idx] = help;
+				}
+			}
+		}
+	}
+}
+
+//create_table.hlsl
+void emulated_computation::create_table_cs(const thread_ids& ids){
+	uint32_t id = ids.dispatch_thread_id.x;
+	uint32_t cell_id = grid_buffer[id].cell_id;
+
+	//out of bounds writes to a UAV are discarded on the GPU
+	if((id == 0 || grid_buffer[id - 1].cell_id != cell_id) && cell_id < lookup_buffer.size()) {
+		lookup_buffer[cell_id] = {table_generation, id};
+	}
+}
+
+//density_evaluation.hlsl
+void emulated_computation::density_evaluation_cs(const thread_ids& ids){
+	uint32_t my_idx = ids.dispatch_thread_id.x;
+	float3 my_pos = pos_buffer[my_idx];
+	float h2 = constants.smoothing_radius * constants.smoothing_radius;
+	float density = 0;
+
+	for(uint32_t i = 0; i < constants.particle_count; i++) {
+		float3 diff = pos_buffer[i] - my_pos;
+		float r2 = dot(diff, diff);
+
+		if(r2 < h2) {
+			density += constants.density_kernel_constant * std::pow(h2 - r2, 3.f);
+		}
+	}
+
+	density_buffer[my_idx] = std::max(constants.reference_density, density);
+}
+
+float emulated_computation::pressure_at(uint32_t idx) const{
+	return constants.pressure_constant * (density_buffer[idx] - constants.reference_density);
+}
+
+//apply_forces.hlsl
+//
+//the shader reads pos_buffer and velocity_buffer of other particles while their threads may already have written them.
+//on the CPU that would be a data race, so other particles are read from the state before the dispatch,
+//which is one of the outcomes the GPU can produce as well
+void emulated_computation::apply_forces_cs(const thread_ids& ids){
+	uint32_t my_idx = ids.dispatch_thread_id.x;
+	float3 my_pos = previous_pos[my_idx];
+
+	float my_pressure = pressure_at(my_idx);
+	float my_density = density_buffer[my_idx];
+	float3 my_velocity = previous_velocity[my_idx];
+
+	float h2 = constants.smoothing_radius * constants.smoothing_radius;
+
+	float3 viscosity_force = make_float3(0.f, 0.f, 0.f);
+	float3 pressure_force = make_float3(0.f, 0.f, 0.f);
+
+	for(uint32_t i = 0; i < constants.particle_count; i++) {
+		if(i != my_idx) {
+			float3 diff = previous_pos[i] - my_pos;
+			float r2 = dot(diff, diff);
+			float r = std::sqrt(r2);
+
+			if(r < constants.particle_radius * 2) {
+				float cos_alpha = dot(normalize(my_velocity), normalize(diff));
+
+				if(cos_alpha > 0) { // this particle actively collides with the other one
+					if(r2 > 0.0001) {
+						my_velocity = mul(get_rotation_matrix(cross(my_velocity, diff)), normalize(diff) * length(my_velocity) * std::sqrt(1 - cos_alpha * cos_alpha));
+					} else {
+						my_velocity = make_float3(0.f, 0.f, 0.f);
+					}
+				} else {
+					cos_alpha = dot(normalize(previous_velocity[i]), normalize(-diff));
+
+					if(cos_alpha > 0) { // the other particle plays the active role
+						my_velocity += normalize(-diff) * length(previous_velocity[i]) * cos_alpha;
+					}
+				}
+
+				my_pos += normalize(-diff) * (2 * constants.particle_radius - length(diff));
+			}
+
+			if(0.00001f < r2 && r2 < h2) {
+				float h = constants.smoothing_radius;
+
+				float their_pressure = pressure_at(i);
+				float pressure_kernel_value = constants.pressure_kernel_constant * std::pow(h - r, 2.f);
+				float3 dir = diff / r;
+
+				pressure_force += (my_pressure + their_pressure) * pressure_kernel_value * dir / (2 * my_density * density_buffer[i]);
+
+				float r3 = r2 * r;
+				float h3 = h2 * h;
+
+				float viscosity_kernel_value = -(r3 / (2 * h3)) + (r2 / h2) + (h / (2 * r)) - 1;
+
+				viscosity_force += (previous_velocity[i] - my_velocity) * viscosity_kernel_value * dir / density_buffer[i];
+			}
+		}
+	}
+
+	viscosity_force *= constants.viscosity_constant;
+
+	my_velocity += constants.timestep * ((viscosity_force - pressure_force) / my_density + constants.gravity);
+	my_pos += constants.timestep * my_velocity;
+
+	//keep the particles in a finite box
+	{
+		float3 normal = make_float3(0.f, 0.f, 0.f);
+
+		if(my_pos.x < 0.f) {
+			normal += make_float3(1, 0, 0);
+		}
+		if(my_pos.x > constants.boundary_x) {
+			normal += make_float3(-1, 0, 0);
+		}
+
+		if(my_pos.y < 0.f) {
+			normal += make_float3(0, 1, 0);
+		}
+		if(my_pos.y > constants.boundary_y) {
+			normal += make_float3(0, -1, 0);
+		}
+
+		if(my_pos.z < 0.f) {
+			normal += make_float3(0, 0, 1);
+		}
+		if(my_pos.z > constants.boundary_z) {
+			normal += make_float3(0, 0, -1);
+		}
+
+		if(dot(normal, normal) > 0.1f) {
+			my_velocity = 0.5f * length(my_velocity) * normalize(reflect(normalize(my_velocity), normalize(normal)));
+			my_pos.x = std::max(0.f, std::min(constants.boundary_x, my_pos.x));
+			my_pos.y = std::max(0.f, std::min(constants.boundary_y, my_pos.y));
+			my_pos.z = std::max(0.f, std::min(constants.boundary_z, my_pos.z));
+		}
+	}
+
+	velocity_buffer[my_idx] = my_velocity;
+	pos_buffer[my_idx] = my_pos;
+}
+
+//compute_shader.hlsl
+void emulated_computation::emit_triangle(compute_dispatcher& dispatcher, float time, append_buffer<float3>& out_buffer){
+	dispatcher.dispatch(make_uint3(3, 1, 1), make_uint3(1, 1, 1), [&](const thread_ids& ids) {
+		float3 vecs[3] = {
+			make_float3(-0.33f, -0.33f, 1.f),
+			make_float3(0.33f, -0.33f, 1.f),
+			make_float3(0.f, 0.33f, 1.f)};
+
+		float3 offset = 0.5f * make_float3(std::cos(time), std::sin(time), 2 * std::cos(time));
+
+		out_buffer.Append(vecs[ids.group_thread_id.x] + offset);
+	});
+}
+
+const simulation_parameters& emulated_computation::parameters() const{
+	return params;
+}
+
+const std::vector<float3>& emulated_computation::positions() const{
+	return pos_buffer;
+}
+
+const std::vector<float3>& emulated_computation::velocities() const{
+	return velocity_buffer;
+}
+
+const std::vector<float>& emulated_computation::densities() const{
+	return density_buffer;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "cpu_engine.h"
+#include "src/Utility/compute_dispatch.h"
+#include "src/Utility/float3.h"
+#include "src/Utility/thread_pool.h"
+
+#include <cstdint>
+#include <vector>
+
+//runs line-for-line C++ ports of the shaders in shader/compute with the same dispatches as computation::populate_command_list
+//
+//it is a fallback for machines without a D3D12 device and the baseline the optimized cpu_engine is judged against:
+//density and forces loop over every particle like the shaders do, and the sort is the bitonic network of sort.hlsl.
+class emulated_computation {
+public:
+	//same as in the shaders
+	static constexpr uint32_t THREAD_COUNT = 256;
+
+	//the particle count has to be a multiple of 2 * THREAD_COUNT, since the sort dispatches particle_count / 2 threads
+	emulated_computation(const simulation_parameters& params, thread_pool& pool);
+
+	//places the particles in the same cube computation::load_assets starts with
+	void load_initial_cube();
+	void set_state(const float3* positions, const float3* velocities);
+
+	//runs all passes in the order below
+	void step();
+
+	void create_grid();
+	void sort();
+	void create_table();
+	void evaluate_density();
+	void apply_forces();
+
+	//runs compute_shader.hlsl, which appends the three vertices of a triangle moving with time
+	static void emit_triangle(compute_dispatcher& dispatcher, float time, append_buffer<float3>& out_buffer);
+
+	const simulation_parameters& parameters() const;
+
+	//indexed by particle id
+	const std::vector<float3>& positions() const;
+	const std::vector<float3>& velocities() const;
+	const std::vector<float>& densities() const;
+
+private:
+	//same layout as in the shaders
+	struct Pair {
+		uint32_t cell_id;
+		uint32_t particle_id;
+	};
+
+	struct CellEntry {
+		uint32_t generation;
+		uint32_t start;
+	};
+
+	struct SimulationConstants {
+		float smoothing_radius;
+		float density_kernel_constant;
+		float pressure_kernel_constant;
+
+		float pressure_constant;
+		float viscosity_constant;
+		float timestep;
+
+		float reference_density;
+		uint32_t particle_count;
+		float3 gravity;
+
+		float boundary_x;
+		float boundary_y;
+		float boundary_z;
+
+		float particle_radius;
+		uint3 grid_size;
+	};
+
+	struct SortParameters {
+		uint32_t global_stepsize;
+		uint32_t local_stepsize;
+		uint32_t max_idx;
+	};
+
+	simulation_parameters params;
+	compute_dispatcher dispatcher;
+	SimulationConstants constants;
+
+	std::vector<float3> pos_buffer;
+	std::vector<float3> velocity_buffer;
+	std::vector<float> density_buffer;
+	std::vector<Pair> grid_buffer;
+	std::vector<CellEntry> lookup_buffer;
+	//the root constant computation::populate_command_list passes to create_table.hlsl
+	uint32_t table_generation;
+
+	//state of pos_buffer and velocity_buffer before apply_forces, see apply_forces_cs
+	std::vector<float3> previous_pos;
+	std::vector<float3> previous_velocity;
+
+	uint3 particle_groups() const;
+
+	void create_grid_cs(const thread_ids& ids);
+	bool sort_cs(const thread_ids& ids, uint32_t phase, const SortParameters& sort_constants);
+	void create_table_cs(const thread_ids& ids);
+	void density_evaluation_cs(const thread_ids& ids);
+	void apply_forces_cs(const thread_ids& ids);
+
+	void compare_swap(uint32_t idx, uint32_t thread_id, uint32_t cur_stepsize, const SortParameters& sort_constants);
+	float pressure_at(uint32_t idx) const;
+};
@@ -0,0 +1,303 @@
+#include "particle_culler.h"
+#include "src/Utility/grid_cell.h"
+#include "src/Utility/parallel_primitives.h"
+#include "src/Utility/tracer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+	constexpr size_t PARTICLE_GRAIN = 4096;
+	constexpr size_t CELL_GRAIN = 1024;
+
+	int32_t to_pixel(float coordinate, uint32_t size){
+		return static_cast<int32_t>(std::min(std::max(coordinate, 0.f), static_cast<float>(size)));
+	}
+}
+
+constexpr int32_t depth_pyramid::BLOCK_SIZE;
+
+depth_pyramid::depth_pyramid(thread_pool& pool) :
+	pool(pool)
+{}
+
+void depth_pyramid::build(const float* depth, uint32_t width, uint32_t height){
+	TRACE_SCOPE("depth_pyramid");
+
+	levels.clear();
+
+	level finest;
+	finest.width = (width + BLOCK_SIZE - 1) / BLOCK_SIZE;
+	finest.height = (height + BLOCK_SIZE - 1) / BLOCK_SIZE;
+	finest.texels.assign(finest.width * finest.height, 0.f);
+	levels.push_back(std::move(finest));
+
+	level& base = levels.back();
+	pool.parallel_for(base.height, 1, [&](size_t begin, size_t end, unsigned) {
+		for(size_t ty = begin; ty < end; ty++) {
+			float* texels = base.texels.data() + ty * base.width;
+
+			for(uint32_t y = static_cast<uint32_t>(ty) * BLOCK_SIZE; y < std::min(static_cast<uint32_t>(ty + 1) * BLOCK_SIZE, height); y++) {
+				const float* row = depth + y * width;
+
+				for(uint32_t x = 0; x < width; x++) {
+					texels[x / BLOCK_SIZE] = std::max(texels[x / BLOCK_SIZE], row[x]);
+				}
+			}
+		}
+	});
+
+	//the coarser levels are a quarter of the size each, they are cheap enough to build on one thread
+	while(levels.back().width > 1 || levels.back().height > 1) {
+		const level& fine = levels.back();
+
+		level coarse;
+		coarse.width = (fine.width + 1) / 2;
+		coarse.height = (fine.height + 1) / 2;
+		coarse.texels.assign(coarse.width * coarse.height, 0.f);
+
+		for(uint32_t y = 0; y < fine.height; y++) {
+			for(uint32_t x = 0; x < fine.width; x++) {
+				float& texel = coarse.texels[y / 2 * coarse.width + x / 2];
+				texel = std::max(texel, fine.texels[y * fine.width + x]);
+			}
+		}
+		levels.push_back(std::move(coarse));
+	}
+}
+
+bool depth_pyramid::occludes(const pixel_rect& r, float depth) const{
+	if(r.first_x >= r.end_x || r.first_y >= r.end_y) {
+		return true;
+	}
+
+	int32_t first_x = r.first_x / BLOCK_SIZE;
+	int32_t last_x = (r.end_x - 1) / BLOCK_SIZE;
+	int32_t first_y = r.first_y / BLOCK_SIZE;
+	int32_t last_y = (r.end_y - 1) / BLOCK_SIZE;
+	size_t l = 0;
+
+	while((last_x - first_x > 1 || last_y - first_y > 1) && l + 1 < levels.size()) {
+		first_x >>= 1;
+		last_x >>= 1;
+		first_y >>= 1;
+		last_y >>= 1;
+		l++;
+	}
+
+	const level& lvl = levels[l];
+	for(int32_t y = first_y; y <= last_y; y++) {
+		for(int32_t x = first_x; x <= last_x; x++) {
+			if(depth <= lvl.texels[y * lvl.width + x]) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+particle_culler::particle_culler(const uint32_t grid_dim[3], const float cell_size[3], thread_pool& pool) :
+	grid_dim{grid_dim[0], grid_dim[1], grid_dim[2]},
+	cell_size{cell_size[0], cell_size[1], cell_size[2]},
+	cells(grid_dim[0] * grid_dim[1] * grid_dim[2]),
+	pool(pool),
+	pyramid(pool),
+	screen(cells),
+	visible(cells, 1),
+	selected(cells, 0),
+	low(make_float3(0.f, 0.f, 0.f)),
+	high(make_float3(0.f, 0.f, 0.f)),
+	last_frustum_cells(0),
+	last_occluded_cells(0),
+	first_phase(0),
+	second_phase(0)
+{}
+
+void particle_culler::render(const float3* positions, size_t count, sprite_rasterizer& rasterizer){
+	TRACE_SCOPE("particle_culler");
+
+	assign_cells(positions, count);
+	project_cells(rasterizer.get_mvp(), rasterizer.width(), rasterizer.height());
+
+	last_frustum_cells = 0;
+	for(uint32_t c = 0; c < cells; c++) {
+		selected[c] = screen[c].in_frustum && visible[c];
+		last_frustum_cells += screen[c].in_frustum;
+	}
+
+	gather(count);
+	first_phase = draw_list.size();
+	rasterizer.render(positions, draw_list.data(), draw_list.size());
+
+	pyramid.build(rasterizer.depth().data(), rasterizer.width(), rasterizer.height());
+
+	auto is_visible = [this](uint32_t c) {
+		const cell_screen& s = screen[c];
+		return s.in_frustum && (!s.projected || !pyramid.occludes(s.rect, s.nearest_depth));
+	};
+
+	pool.parallel_for(cells, CELL_GRAIN, [&](size_t begin, size_t end, unsigned) {
+		for(size_t c = begin; c < end; c++) {
+			selected[c] = !visible[c] && is_visible(static_cast<uint32_t>(c));
+		}
+	});
+
+	gather(count);
+	second_phase = draw_list.size();
+
+	if(second_phase > 0) {
+		rasterizer.draw(positions, draw_list.data(), draw_list.size());
+		pyramid.build(rasterizer.depth().data(), rasterizer.width(), rasterizer.height());
+	}
+
+	pool.parallel_for(cells, CELL_GRAIN, [&](size_t begin, size_t end, unsigned) {
+		for(size_t c = begin; c < end; c++) {
+			visible[c] = is_visible(static_cast<uint32_t>(c));
+		}
+	});
+
+	last_occluded_cells = 0;
+	for(uint32_t c = 0; c < cells; c++) {
+		last_occluded_cells += screen[c].in_frustum && !visible[c];
+	}
+}
+
+void particle_culler::reset(){
+	std::fill(visible.begin(), visible.end(), 1);
+}
+
+uint32_t particle_culler::cell_count() const{
+	return cells;
+}
+
+uint32_t particle_culler::frustum_cells() const{
+	return last_frustum_cells;
+}
+
+uint32_t particle_culler::occluded_cells() const{
+	return last_occluded_cells;
+}
+
+size_t particle_culler::first_phase_count() const{
+	return first_phase;
+}
+
+size_t particle_culler::second_phase_count() const{
+	return second_phase;
+}
+
+//the cell of every particle as cpu_engine::cell_of computes it, and the bounds of all particles
+void particle_culler::assign_cells(const float3* positions, size_t count){
+	TRACE_SCOPE("assign_cells");
+
+	size_t blocks = (count + PARTICLE_GRAIN - 1) / PARTICLE_GRAIN;
+	std::vector<float3> block_low(blocks);
+	std::vector<float3> block_high(blocks);
+
+	particle_cells.resize(count);
+
+	pool.parallel_for(count, PARTICLE_GRAIN, [&](size_t begin, size_t end, unsigned) {
+		float3 lo = positions[begin];
+		float3 hi = positions[begin];
+
+		for(size_t i = begin; i < end; i++) {
+			float3 p = positions[i];
+
+			particle_cells[i] = clamped_cell(p, grid_dim, cell_size);
+
+			lo = make_float3(std::min(lo.x, p.x), std::min(lo.y, p.y), std::min(lo.z, p.z));
+			hi = make_float3(std::max(hi.x, p.x), std::max(hi.y, p.y), std::max(hi.z, p.z));
+		}
+
+		block_low[begin / PARTICLE_GRAIN] = lo;
+		block_high[begin / PARTICLE_GRAIN] = hi;
+	});
+
+	//without particles the bounds stay empty at the origin, the cells then only reach as far as the grid
+	low = blocks > 0 ? block_low[0] : make_float3(0.f, 0.f, 0.f);
+	high = blocks > 0 ? block_high[0] : make_float3(0.f, 0.f, 0.f);
+	for(size_t b = 1; b < blocks; b++) {
+		low = make_float3(std::min(low.x, block_low[b].x), std::min(low.y, block_low[b].y), std::min(low.z, block_low[b].z));
+		high = make_float3(std::max(high.x, block_high[b].x), std::max(high.y, block_high[b].y), std::max(high.z, block_high[b].z));
+	}
+}
+
+void particle_culler::project_cells(const float4x4& mvp, uint32_t width, uint32_t height){
+	TRACE_SCOPE("project_cells");
+
+	const float radius = sprite_rasterizer::SPRITE_RADIUS;
+	const float lows[3] = {low.x, low.y, low.z};
+	const float highs[3] = {high.x, high.y, high.z};
+
+	pool.parallel_for(cells, CELL_GRAIN, [&](size_t begin, size_t end, unsigned) {
+		for(size_t c = begin; c < end; c++) {
+			uint32_t coord[3] = {
+				static_cast<uint32_t>(c % grid_dim[0]),
+				static_cast<uint32_t>(c / grid_dim[0] % grid_dim[1]),
+				static_cast<uint32_t>(c / (grid_dim[0] * grid_dim[1])),
+			};
+
+			float box[2][3];
+			for(int a = 0; a < 3; a++) {
+				box[0][a] = coord[a] * cell_size[a];
+				box[1][a] = box[0][a] + cell_size[a];
+
+				if(coord[a] == 0) {
+					box[0][a] = std::min(box[0][a], lows[a]);
+				}
+				if(coord[a] == grid_dim[a] - 1) {
+					box[1][a] = std::max(box[1][a], highs[a]);
+				}
+			}
+
+			//per clip plane, whether every corner lies outside of it: left, right, bottom, top, near, far
+			bool outside[6] = {true, true, true, true, true, true};
+			bool projected = true;
+			float min_x = std::numeric_limits<float>::max();
+			float max_x = -std::numeric_limits<float>::max();
+			float min_y = std::numeric_limits<float>::max();
+			float max_y = -std::numeric_limits<float>::max();
+			float nearest = std::numeric_limits<float>::max();
+
+			for(int corner = 0; corner < 8; corner++) {
+				float4 clip = transform_point(make_float3(box[corner & 1][0], box[corner >> 1 & 1][1], box[corner >> 2][2]), mvp);
+
+				outside[0] = outside[0] && clip.x + radius < -clip.w;
+				outside[1] = outside[1] && clip.x - radius > clip.w;
+				outside[2] = outside[2] && clip.y + radius < -clip.w;
+				outside[3] = outside[3] && clip.y - radius > clip.w;
+				outside[4] = outside[4] && clip.z < 0.f;
+				outside[5] = outside[5] && clip.z > clip.w;
+
+				if(!(clip.w > 0.f)) {
+					projected = false;
+					continue;
+				}
+
+				//the quads around the corners, in normalized device coordinates
+				min_x = std::min(min_x, (clip.x - radius) / clip.w);
+				max_x = std::max(max_x, (clip.x + radius) / clip.w);
+				min_y = std::min(min_y, (clip.y - radius) / clip.w);
+				max_y = std::max(max_y, (clip.y + radius) / clip.w);
+				nearest = std::min(nearest, clip.z / clip.w);
+			}
+
+			cell_screen& s = screen[c];
+			s.in_frustum = !(outside[0] || outside[1] || outside[2] || outside[3] || outside[4] || outside[5]);
+			s.projected = projected;
+			s.nearest_depth = nearest;
+
+			s.rect.first_x = to_pixel(std::floor((min_x + 1.f) * 0.5f * width), width);
+			s.rect.end_x = to_pixel(std::ceil((max_x + 1.f) * 0.5f * width), width);
+			s.rect.first_y = to_pixel(std::floor((1.f - max_y) * 0.5f * height), height);
+			s.rect.end_y = to_pixel(std::ceil((1.f - min_y) * 0.5f * height), height);
+		}
+	});
+}
+
+void particle_culler::gather(size_t count){
+	TRACE_SCOPE("gather");
+
+	parallel_primitives::compact_indices(pool, count, [this](size_t i) { return selected[particle_cells[i]] != 0; }, draw_list);
+}
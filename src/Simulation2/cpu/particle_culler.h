@@ -0,0 +1,108 @@
+#pragma once
+
+#include "sprite_rasterizer.h"
+#include "src/Utility/float3.h"
+#include "src/Utility/float4x4.h"
+#include "src/Utility/thread_pool.h"
+#include "src/Utility/tile_binner.h"
+
+#include <cstdint>
+#include <vector>
+
+//the farthest depth of blocks of pixels, in levels of halving resolution
+class depth_pyramid {
+public:
+	//texels of the finest level cover BLOCK_SIZE^2 pixels
+	static constexpr int32_t BLOCK_SIZE = 8;
+
+	explicit depth_pyramid(thread_pool& pool);
+
+	void build(const float* depth, uint32_t width, uint32_t height);
+
+	//true if every pixel of r is closer than depth, or r is empty.
+	//the test reads at most 2 x 2 texels, of the finest level at which r spans no more than two along each axis.
+	bool occludes(const pixel_rect& r, float depth) const;
+
+private:
+	struct level {
+		uint32_t width;
+		uint32_t height;
+		std::vector<float> texels;
+	};
+
+	thread_pool& pool;
+	std::vector<level> levels;
+};
+
+//leaves out the particles of grid cells that can't contribute to the frame before they reach the sprite_rasterizer
+//
+//the particles are assigned to the cells of the simulation grid, and every cell is tested by the box around all the sprites
+//its particles could draw:
+//	frustum:	the cell is dropped if the quads around all 8 corners lie outside the same clip plane.
+//				clip coordinates are affine in the position, so then the quads of all its particles do as well.
+//	occlusion:	the screen rectangle and nearest depth of the corners are tested against a depth_pyramid.
+//
+//the occlusion test is done in two phases, so it never culls with depths of an earlier frame:
+//	1. the cells that were visible in the last frame are drawn, and the pyramid is built from their depth
+//	2. the other cells in the frustum are tested against it, and the ones that pass are drawn on top.
+//	afterwards every cell is tested against the final depth, which gives the visible cells of the next frame.
+//a cell is only dropped if sprites drawn in this frame hide it, so the image is the one of drawing every particle,
+//except for sprites at exactly the same depth, which can resolve in another order as phase 2 draws after phase 1.
+//within each phase the particles are drawn in the order of their ids, so the frame doesn't depend on the number of threads.
+class particle_culler {
+public:
+	particle_culler(const uint32_t grid_dim[3], const float cell_size[3], thread_pool& pool);
+
+	//draws the particles that survive culling with the mvp of the rasterizer
+	void render(const float3* positions, size_t count, sprite_rasterizer& rasterizer);
+
+	//forgets the visible cells, the next render draws every cell in the frustum in its first phase
+	void reset();
+
+	uint32_t cell_count() const;
+
+	//of the last render: cells overlapping the frustum, those of them hidden at the end of the frame,
+	//and the particles drawn in the two phases
+	uint32_t frustum_cells() const;
+	uint32_t occluded_cells() const;
+	size_t first_phase_count() const;
+	size_t second_phase_count() const;
+
+private:
+	//the box of a cell in screen space
+	struct cell_screen {
+		pixel_rect rect;
+		float nearest_depth;
+		bool in_frustum;
+		//false if a corner lies behind the eye, the rect and depth are meaningless then
+		bool projected;
+	};
+
+	uint32_t grid_dim[3];
+	float cell_size[3];
+	uint32_t cells;
+
+	thread_pool& pool;
+	depth_pyramid pyramid;
+
+	std::vector<uint32_t> particle_cells;
+	std::vector<cell_screen> screen;
+	std::vector<uint8_t> visible;
+	//cells whose particles are gathered into draw_list
+	std::vector<uint8_t> selected;
+	std::vector<uint32_t> draw_list;
+
+	//the bounds of all particles, the outermost cells reach out to them, as cell_of clamps the particles into the grid
+	float3 low;
+	float3 high;
+
+	uint32_t last_frustum_cells;
+	uint32_t last_occluded_cells;
+	size_t first_phase;
+	size_t second_phase;
+
+	void assign_cells(const float3* positions, size_t count);
+	void project_cells(const float4x4& mvp, uint32_t width, uint32_t height);
+	//the ids of the particles in selected cells, in ascending order
+	void gather(size_t count);
+};
@@ -0,0 +1,52 @@
+#include "pass_statistics.h"
+
+#include <stdexcept>
+
+const char* pass_name(pass_type pass){
+	static const char* names[PASS_TYPE_COUNT] = {"create_grid", "sort", "create_table", "density", "forces"};
+	return pass < PASS_TYPE_COUNT ? names[pass] : "unknown";
+}
+
+double step_statistics::step_seconds() const{
+	double seconds = 0.0;
+
+	for(double pass : pass_seconds) {
+		seconds += pass;
+	}
+	return seconds;
+}
+
+statistics_ring::statistics_ring(size_t capacity) :
+	entries(capacity),
+	next(0),
+	count(0)
+{
+	if(capacity == 0) {
+		throw std::runtime_error("statistics_ring needs a capacity of at least one entry");
+	}
+}
+
+void statistics_ring::push(const step_statistics& stats){
+	entries[next] = stats;
+	next = (next + 1) % entries.size();
+	count = count < entries.size() ? count + 1 : count;
+}
+
+size_t statistics_ring::size() const{
+	return count;
+}
+
+size_t statistics_ring::capacity() const{
+	return entries.size();
+}
+
+const step_statistics& statistics_ring::operator[](size_t idx) const{
+	if(idx >= count) {
+		throw std::runtime_error("statistics_ring index out of range");
+	}
+	return entries[(next + entries.size() - count + idx) % entries.size()];
+}
+
+const step_statistics& statistics_ring::latest() const{
+	return (*this)[count - 1];
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//collects timings and counters for every pass of cpu_engine
+//without it the timers and counters below expand to nothing and the engine carries no statistics members at all
+//#define ENABLE_PASS_STATISTICS
+
+enum pass_type {
+	PASS_CREATE_GRID,
+	PASS_SORT,
+	PASS_CREATE_TABLE,
+	PASS_DENSITY,
+	PASS_FORCES,
+	PASS_TYPE_COUNT,
+};
+
+const char* pass_name(pass_type pass);
+
+struct step_statistics {
+	uint64_t step;
+	double pass_seconds[PASS_TYPE_COUNT];
+
+	//cells holding at least one particle
+	uint32_t occupied_cells;
+
+	//other particles within the smoothing radius, counted by the density pass
+	double mean_neighbors;
+	uint32_t max_neighbors;
+
+	//particle pairs closer than two particle radii, which apply_forces pushes apart
+	uint64_t collisions_resolved;
+	//particles that left the box and were reflected and clamped back
+	uint64_t boundary_clamps;
+
+	//the CPU sort has no swap count like the bitonic network in sort.hlsl,
+	//so this counts the pairs that were out of order with their predecessor before sorting
+	uint64_t sort_swaps;
+
+	double step_seconds() const;
+};
+
+//keeps the statistics of the last capacity() steps, the oldest entry gets overwritten first
+class statistics_ring {
+public:
+	explicit statistics_ring(size_t capacity);
+
+	void push(const step_statistics& stats);
+
+	size_t size() const;
+	size_t capacity() const;
+
+	//0 is the oldest entry, size() - 1 the latest
+	const step_statistics& operator[](size_t idx) const;
+	const step_statistics& latest() const;
+
+private:
+	std::vector<step_statistics> entries;
+	size_t next;
+	size_t count;
+};
+
+//counters of one worker during one step, padded to a cache line so the workers never write to the same one.
+//the padding only holds in an aligned_array, a std::vector doesn't align them in C++14
+struct alignas(64) pass_counters {
+	uint64_t occupied_cells;
+	uint64_t neighbors;
+	uint32_t max_neighbors;
+	uint64_t collisions_resolved;
+	uint64_t boundary_clamps;
+	uint64_t sort_swaps;
+
+	void add_neighbors(uint32_t count){
+		neighbors += count;
+		max_neighbors = count > max_neighbors ? count : max_neighbors;
+	}
+};
+
+//adds the time between construction and destruction to the given value
+class scoped_pass_timer {
+public:
+	explicit scoped_pass_timer(double& seconds) :
+		seconds(seconds),
+		start(std::chrono::steady_clock::now())
+	{}
+
+	~scoped_pass_timer(){
+		seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+private:
+	double& seconds;
+	std::chrono::steady_clock::time_point start;
+};
+
+//PASS_WORKER marks a worker index that only the counters use, so it isn't an unused parameter without them
+#ifdef ENABLE_PASS_STATISTICS
+#define PASS_TIMER(seconds) scoped_pass_timer pass_timer(seconds)
+#define PASS_COUNTER(statement) statement
+#define PASS_WORKER(worker)
+#else
+#define PASS_TIMER(seconds)
+#define PASS_COUNTER(statement)
+#define PASS_WORKER(worker) (void)(worker)
+#endif
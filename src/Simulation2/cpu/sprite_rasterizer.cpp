@@ -0,0 +1,215 @@
+#include "sprite_rasterizer.h"
+#include "src/Simulation2/frame_constants.h"
+#include "src/Utility/parallel_primitives.h"
+#include "src/Utility/pixel_math.h"
+#include "src/Utility/tracer.h"
+
+#include <algorithm>
+#include <cmath>
+
+constexpr uint32_t sprite_rasterizer::TILE_SIZE;
+constexpr float sprite_rasterizer::SPRITE_RADIUS;
+constexpr uint32_t sprite_rasterizer::BACKGROUND;
+
+sprite_rasterizer::sprite_rasterizer(uint32_t width, uint32_t height, thread_pool& pool) :
+	target_width(width),
+	target_height(height),
+	pool(pool),
+	binner(width, height, TILE_SIZE, pool),
+	mvp(identity_matrix()),
+	color_target(width * height, BACKGROUND),
+	depth_target(width * height, 1.f),
+	visible_sprites(0)
+{
+	float boundary[3] = {
+		frame_constants::SIMULATION_BOX_BOUNDARY[0],
+		frame_constants::SIMULATION_BOX_BOUNDARY[1],
+		frame_constants::SIMULATION_BOX_BOUNDARY[2],
+	};
+	mvp = simulation2_mvp(boundary, static_cast<float>(width) / height);
+}
+
+float4x4 sprite_rasterizer::simulation2_mvp(const float boundary[3], float aspect_ratio){
+	float scale = boundary[0] / frame_constants::SIMULATION_BOX_BOUNDARY[0];
+
+	float3 eye = make_float3(frame_constants::EYE[0], frame_constants::EYE[1], frame_constants::EYE[2]) * scale;
+	float3 point_of_interest = make_float3(frame_constants::POI[0], frame_constants::POI[1], frame_constants::POI[2]) * scale;
+
+	float4x4 world = translation(-boundary[0] * 0.5f, -boundary[1] * 0.5f, -boundary[2] * 0.5f);
+	float4x4 view = look_at_lh(eye, point_of_interest, make_float3(0.f, 1.f, 0.f));
+	float4x4 projection = perspective_fov_lh(1.5708f, aspect_ratio, 0.1f, 100.f * scale);
+
+	return world * (view * projection);
+}
+
+void sprite_rasterizer::set_mvp(const float4x4& mvp){
+	this->mvp = mvp;
+}
+
+const float4x4& sprite_rasterizer::get_mvp() const{
+	return mvp;
+}
+
+void sprite_rasterizer::render(const float3* positions, size_t count){
+	rasterize(positions, nullptr, nullptr, count, true);
+}
+
+void sprite_rasterizer::render(const float3* positions, const uint32_t* indices, size_t count){
+	rasterize(positions, indices, nullptr, count, true);
+}
+
+void sprite_rasterizer::draw(const float3* positions, const uint32_t* indices, size_t count){
+	rasterize(positions, indices, nullptr, count, false);
+}
+
+void sprite_rasterizer::render(const float4* points, const float* radii, size_t count){
+	rasterize(points, nullptr, radii, count, true);
+}
+
+uint32_t sprite_rasterizer::width() const{
+	return target_width;
+}
+
+uint32_t sprite_rasterizer::height() const{
+	return target_height;
+}
+
+const std::vector<uint32_t>& sprite_rasterizer::color() const{
+	return color_target;
+}
+
+const std::vector<float>& sprite_rasterizer::depth() const{
+	return depth_target;
+}
+
+size_t sprite_rasterizer::visible_count() const{
+	return visible_sprites;
+}
+
+uint64_t sprite_rasterizer::fragment_count() const{
+	uint64_t total = 0;
+	for(uint64_t fragments : tile_fragments) {
+		total += fragments;
+	}
+	return total;
+}
+
+template<typename point>
+void sprite_rasterizer::rasterize(const point* positions, const uint32_t* indices, const float* radii, size_t count, bool clear){
+	TRACE_SCOPE("sprite_rasterizer");
+
+	if(clear) {
+		visible_sprites = 0;
+		tile_fragments.assign(binner.tile_count(), 0);
+	}
+
+	setup(positions, indices, radii, count);
+	binner.bin(bounds.data(), count);
+	shade(clear);
+}
+
+//VSMain and GSMain, followed by the clipping and the viewport transform
+template<typename point>
+void sprite_rasterizer::setup(const point* positions, const uint32_t* indices, const float* radii, size_t count){
+	TRACE_SCOPE("setup");
+
+	sprites.resize(count);
+	bounds.resize(count);
+
+	visible_sprites += parallel_primitives::transform_reduce<size_t>(pool, count, [&](size_t i) -> size_t {
+		const point& p = positions[indices ? indices[i] : i];
+		float4 clip = transform_point(make_float3(p.x, p.y, p.z), mvp);
+		sprite& s = sprites[i];
+		pixel_rect& r = bounds[i];
+
+		r.first_x = r.end_x = r.first_y = r.end_y = 0;
+
+		//all four corners share z and w, so the quad is clipped against the depth range as a whole
+		if(!(clip.w > 0.f) || !(clip.z >= 0.f && clip.z <= clip.w)) {
+			return 0;
+		}
+
+		float radius = radii ? radii[i] : SPRITE_RADIUS;
+		float half_width = radius / clip.w * 0.5f * target_width;
+		float half_height = radius / clip.w * 0.5f * target_height;
+
+		s.center_x = (clip.x / clip.w + 1.f) * 0.5f * target_width;
+		s.center_y = (1.f - clip.y / clip.w) * 0.5f * target_height;
+		s.offset_scale_x = 2.f * clip.w / target_width;
+		s.offset_scale_y = 2.f * clip.w / target_height;
+		s.depth = clip.z / clip.w;
+		s.radius = radius;
+
+		r.first_x = pixel_bound(s.center_x - half_width, target_width);
+		r.end_x = pixel_bound(s.center_x + half_width, target_width);
+		r.first_y = pixel_bound(s.center_y - half_height, target_height);
+		r.end_y = pixel_bound(s.center_y + half_height, target_height);
+
+		return r.first_x < r.end_x && r.first_y < r.end_y ? 1 : 0;
+	});
+}
+
+void sprite_rasterizer::shade(bool clear){
+	TRACE_SCOPE("shade");
+
+	pool.run(binner.tile_count(), [this, clear](size_t tile, unsigned) {
+		shade_tile(static_cast<uint32_t>(tile), clear);
+	});
+}
+
+//PSMain for every sprite of the tile, in the order they are drawn
+void sprite_rasterizer::shade_tile(uint32_t tile, bool clear){
+	pixel_rect t = binner.tile_rect(tile);
+
+	if(clear) {
+		for(int32_t y = t.first_y; y < t.end_y; y++) {
+			std::fill(color_target.begin() + y * target_width + t.first_x, color_target.begin() + y * target_width + t.end_x, BACKGROUND);
+			std::fill(depth_target.begin() + y * target_width + t.first_x, depth_target.begin() + y * target_width + t.end_x, 1.f);
+		}
+	}
+
+	uint64_t fragments = 0;
+
+	for(const uint32_t* i = binner.begin(tile); i != binner.end(tile); i++) {
+		const sprite& s = sprites[*i];
+		const pixel_rect& r = bounds[*i];
+		const float r2 = s.radius * s.radius;
+
+		int32_t first_x = std::max(r.first_x, t.first_x);
+		int32_t end_x = std::min(r.end_x, t.end_x);
+		int32_t first_y = std::max(r.first_y, t.first_y);
+		int32_t end_y = std::min(r.end_y, t.end_y);
+
+		for(int32_t y = first_y; y < end_y; y++) {
+			float offset_y = (y + 0.5f - s.center_y) * s.offset_scale_y;
+			float offset_y2 = offset_y * offset_y;
+
+			uint32_t* color = color_target.data() + y * target_width;
+			float* depth = depth_target.data() + y * target_width;
+
+			for(int32_t x = first_x; x < end_x; x++) {
+				float offset_x = (x + 0.5f - s.center_x) * s.offset_scale_x;
+				float d2 = offset_x * offset_x + offset_y2;
+
+				//discarded, the pixel isn't on the projected sphere
+				if(d2 > r2) {
+					continue;
+				}
+				fragments++;
+
+				if(!(s.depth <= depth[x])) {
+					continue;
+				}
+
+				//pow(dot(normalize(view_space_offset), (0, 0, -1)), 4), the view space offset has length rad
+				float cos2 = (r2 - d2) / r2;
+				float highlight = cos2 * cos2;
+
+				depth[x] = s.depth;
+				color[x] = pack_color(make_float3(0.4f + highlight, 0.3f + highlight, 0.2f + highlight));
+			}
+		}
+	}
+
+	tile_fragments[tile] += fragments;
+}
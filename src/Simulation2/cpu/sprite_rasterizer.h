@@ -0,0 +1,97 @@
+#pragma once
+
+#include "src/Utility/float3.h"
+#include "src/Utility/float4x4.h"
+#include "src/Utility/thread_pool.h"
+#include "src/Utility/tile_binner.h"
+
+#include <cstdint>
+#include <vector>
+
+//headless CPU version of the Simulation2 render pass (shader/graphics/triangles.hlsl)
+//
+//every particle becomes a quad of SPRITE_RADIUS around its clip space position, as in GSMain.
+//a pixel is drawn if its offset from the center lies within the radius, with the view space depth and shading of PSMain.
+//the quad has the depth of its center, the depth test is LESS_EQUAL and the targets are cleared like in rendering::populate_command_list.
+//
+//	setup:	the particles are transformed and culled against the depth range and the screen
+//	bin:	the sprites are sorted into per tile lists, in the order they are drawn (see tile_binner)
+//	shade:	the tiles are shaded in parallel, each one draws its list in order into its own part of the targets
+//
+//drawing in particle order per pixel is what the GPU guarantees as well, so overlapping sprites at the same depth resolve the same way.
+//the targets don't depend on the number of threads.
+class sprite_rasterizer {
+public:
+	//pixels per side of a screen tile
+	static constexpr uint32_t TILE_SIZE = 32;
+	//the radius VSMain assigns to every particle, in clip space units
+	static constexpr float SPRITE_RADIUS = 0.1f;
+	//the clear color of rendering::populate_command_list, as R8G8B8A8
+	static constexpr uint32_t BACKGROUND = 0xFF1A1A1A;
+
+	sprite_rasterizer(uint32_t width, uint32_t height, thread_pool& pool);
+
+	//the matrix rendering::load_assets builds, for a simulation box of the given size
+	//the box of frame_constants gives exactly that matrix, larger boxes move the camera and the far plane back by the same factor
+	static float4x4 simulation2_mvp(const float boundary[3], float aspect_ratio);
+
+	void set_mvp(const float4x4& mvp);
+	const float4x4& get_mvp() const;
+
+	//clears the targets and draws the particles
+	void render(const float3* positions, size_t count);
+	//clears the targets and draws the particles positions[indices[i]], in the order of the list
+	void render(const float3* positions, const uint32_t* indices, size_t count);
+	//draws the particles positions[indices[i]] over the current targets, like a second draw call into the same frame
+	void draw(const float3* positions, const uint32_t* indices, size_t count);
+	//clears the targets and draws points of their own clip space radius each, like the splats of particle_lod, w is not used
+	void render(const float4* points, const float* radii, size_t count);
+
+	uint32_t width() const;
+	uint32_t height() const;
+
+	//R8G8B8A8 pixels, red in the lowest byte, rows from top to bottom
+	const std::vector<uint32_t>& color() const;
+	const std::vector<float>& depth() const;
+
+	//particles drawn into at least one tile and pixels that passed the radius test, since the last render
+	size_t visible_count() const;
+	uint64_t fragment_count() const;
+
+private:
+	//a particle after setup, in pixel coordinates
+	struct sprite {
+		float center_x;
+		float center_y;
+		//clip space offset per pixel, the sign doesn't matter for the shading
+		float offset_scale_x;
+		float offset_scale_y;
+		float depth;
+		float radius;
+	};
+
+	uint32_t target_width;
+	uint32_t target_height;
+
+	thread_pool& pool;
+	tile_binner binner;
+	float4x4 mvp;
+
+	std::vector<sprite> sprites;
+	//the pixels whose centers lie on the quad of each sprite, empty for culled particles
+	std::vector<pixel_rect> bounds;
+	std::vector<uint64_t> tile_fragments;
+
+	std::vector<uint32_t> color_target;
+	std::vector<float> depth_target;
+
+	size_t visible_sprites;
+
+	//positions[indices[i]], or positions[i] without indices, with radii[i] or SPRITE_RADIUS without radii
+	template<typename point>
+	void rasterize(const point* positions, const uint32_t* indices, const float* radii, size_t count, bool clear);
+	template<typename point>
+	void setup(const point* positions, const uint32_t* indices, const float* radii, size_t count);
+	void shade(bool clear);
+	void shade_tile(uint32_t tile, bool clear);
+};
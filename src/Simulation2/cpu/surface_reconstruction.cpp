@@ -0,0 +1,576 @@
+#include "surface_reconstruction.h"
+#include "src/Simulation2/sph_kernels.h"
+#include "src/Utility/parallel_primitives.h"
+#include "src/Utility/tracer.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+	constexpr size_t PARTICLE_GRAIN = 4096;
+	constexpr size_t BRICK_GRAIN = 4;
+
+	constexpr int BRICK_SIZE = surface_reconstruction::BRICK_SIZE;
+	constexpr int BRICK_SAMPLES = surface_reconstruction::BRICK_SAMPLES;
+	constexpr int SAMPLES_PER_BRICK = BRICK_SAMPLES * BRICK_SAMPLES * BRICK_SAMPLES;
+	constexpr int EDGES_PER_BRICK = 3 * BRICK_SIZE * BRICK_SIZE * BRICK_SIZE;
+
+	//brick coordinates are stored biased by 2^20 in 21 bits each, z in the highest bits
+	constexpr int32_t KEY_BIAS = 1 << 20;
+
+	uint64_t brick_key(int32_t x, int32_t y, int32_t z){
+		return static_cast<uint64_t>(z + KEY_BIAS) << 42 | static_cast<uint64_t>(y + KEY_BIAS) << 21 | static_cast<uint64_t>(x + KEY_BIAS);
+	}
+
+	int32_t key_coordinate(uint64_t key, int axis){
+		return static_cast<int32_t>(key >> (21 * axis) & 0x1FFFFF) - KEY_BIAS;
+	}
+
+	int32_t floor_div(int32_t a, int32_t b){
+		return a >= 0 ? a / b : -((-a + b - 1) / b);
+	}
+
+	int sample_index(int x, int y, int z){
+		return (z * BRICK_SAMPLES + y) * BRICK_SAMPLES + x;
+	}
+
+	int edge_index(int axis, int x, int y, int z){
+		return ((axis * BRICK_SIZE + z) * BRICK_SIZE + y) * BRICK_SIZE + x;
+	}
+
+	//corner c of a cube sits at (c & 1, (c >> 1) & 1, (c >> 2) & 1)
+	//edge e runs along axis e / 4 from EDGE_CORNERS[e][0] to EDGE_CORNERS[e][1]
+	const int EDGE_CORNERS[12][2] = {
+		{0, 1}, {2, 3}, {4, 5}, {6, 7},
+		{0, 2}, {1, 3}, {4, 6}, {5, 7},
+		{0, 4}, {1, 5}, {2, 6}, {3, 7},
+	};
+
+	//the corners of every face, counter clockwise seen from outside the cube
+	const int FACE_CORNERS[6][4] = {
+		{0, 4, 6, 2}, {1, 3, 7, 5},
+		{0, 1, 5, 4}, {2, 6, 7, 3},
+		{0, 2, 3, 1}, {4, 5, 7, 6},
+	};
+
+	int edge_between(int a, int b){
+		for(int e = 0; e < 12; e++) {
+			if((EDGE_CORNERS[e][0] == a && EDGE_CORNERS[e][1] == b) || (EDGE_CORNERS[e][0] == b && EDGE_CORNERS[e][1] == a)) {
+				return e;
+			}
+		}
+		return -1;
+	}
+
+	//the triangles of one corner configuration, as edges of the cube
+	struct cube_case {
+		int triangle_count;
+		uint8_t edges[12 * 3];
+	};
+
+	//derives the triangulation of all 256 corner configurations instead of listing them in a table
+	//
+	//walking around a face counter clockwise, the crossed edges alternate between leaving and entering the inside corners.
+	//the surface crosses the face from every leaving edge to the entering edge before it, which separates the inside corners
+	//on faces with four crossings. every crossed edge is left on one of its faces and entered on the other,
+	//so the segments form closed loops around the inside corners, which are triangulated as fans.
+	std::vector<cube_case> triangulate_cases(){
+		std::vector<cube_case> cases(256);
+
+		for(int c = 0; c < 256; c++) {
+			auto inside = [c](int corner) { return (c >> corner & 1) != 0; };
+
+			int next[12];
+			std::fill(next, next + 12, -1);
+
+			for(int f = 0; f < 6; f++) {
+				int crossings[4];
+				bool leaving[4];
+				int count = 0;
+
+				for(int k = 0; k < 4; k++) {
+					int a = FACE_CORNERS[f][k];
+					int b = FACE_CORNERS[f][(k + 1) % 4];
+
+					if(inside(a) != inside(b)) {
+						crossings[count] = edge_between(a, b);
+						leaving[count] = inside(a);
+						count++;
+					}
+				}
+
+				for(int k = 0; k < count; k++) {
+					if(leaving[k]) {
+						next[crossings[k]] = crossings[(k + count - 1) % count];
+					}
+				}
+			}
+
+			cube_case& result = cases[c];
+			result.triangle_count = 0;
+
+			bool visited[12] = {};
+			for(int e = 0; e < 12; e++) {
+				if(next[e] < 0 || visited[e]) {
+					continue;
+				}
+
+				int loop[12];
+				int length = 0;
+				for(int v = e; !visited[v]; v = next[v]) {
+					visited[v] = true;
+					loop[length++] = v;
+				}
+
+				//the loops run clockwise seen from outside the fluid
+				for(int i = 1; i + 1 < length; i++) {
+					uint8_t* triangle = result.edges + 3 * result.triangle_count++;
+
+					triangle[0] = static_cast<uint8_t>(loop[0]);
+					triangle[1] = static_cast<uint8_t>(loop[i + 1]);
+					triangle[2] = static_cast<uint8_t>(loop[i]);
+				}
+			}
+		}
+
+		return cases;
+	}
+
+	const std::vector<cube_case>& cube_cases(){
+		static const std::vector<cube_case> cases = triangulate_cases();
+		return cases;
+	}
+}
+
+constexpr int surface_reconstruction::BRICK_SIZE;
+constexpr int surface_reconstruction::BRICK_SAMPLES;
+constexpr uint32_t surface_reconstruction::NO_VERTEX;
+
+surface_reconstruction::surface_reconstruction(const surface_parameters& params, thread_pool& pool) :
+	params(params),
+	pool(pool)
+{
+	cube_cases();
+}
+
+const surface_mesh& surface_reconstruction::extract(const float3* positions, size_t count){
+	TRACE_SCOPE("surface_reconstruction");
+
+	bin(positions, count);
+	sort_pairs();
+	find_bricks();
+	splat(positions);
+	place_vertices();
+	triangulate();
+	gather();
+
+	return result;
+}
+
+const surface_mesh& surface_reconstruction::mesh() const{
+	return result;
+}
+
+const surface_parameters& surface_reconstruction::parameters() const{
+	return params;
+}
+
+size_t surface_reconstruction::brick_count() const{
+	return bricks.size();
+}
+
+size_t surface_reconstruction::surface_brick_count() const{
+	return surface_bricks.size();
+}
+
+//pairs every particle with the bricks whose samples lie in the voxels its kernel overlaps
+void surface_reconstruction::bin(const float3* positions, size_t count){
+	TRACE_SCOPE("bin");
+
+	//the bricks [first, last] along every axis
+	auto brick_range = [&](size_t i, int32_t first[3], int32_t last[3]) {
+		const float p[3] = {positions[i].x, positions[i].y, positions[i].z};
+
+		for(int axis = 0; axis < 3; axis++) {
+			//rounded outwards, so a sample on the face between two bricks pairs the particle with both
+			int32_t low = static_cast<int32_t>(std::floor((p[axis] - params.radius) / params.voxel_size));
+			int32_t high = static_cast<int32_t>(std::ceil((p[axis] + params.radius) / params.voxel_size));
+
+			first[axis] = floor_div(low + BRICK_SIZE - 1, BRICK_SIZE) - 1;
+			last[axis] = floor_div(high, BRICK_SIZE);
+		}
+	};
+
+	parallel_primitives::expand(pool, count,
+		[&](size_t i) -> size_t {
+			int32_t first[3];
+			int32_t last[3];
+			brick_range(i, first, last);
+
+			return static_cast<size_t>(last[0] - first[0] + 1) * (last[1] - first[1] + 1) * (last[2] - first[2] + 1);
+		},
+		[this](size_t total) {
+			pairs.resize(total);
+			pairs_scratch.resize(total);
+		},
+		[&](size_t i, size_t position) {
+			int32_t first[3];
+			int32_t last[3];
+			brick_range(i, first, last);
+
+			for(int32_t z = first[2]; z <= last[2]; z++) {
+				for(int32_t y = first[1]; y <= last[1]; y++) {
+					for(int32_t x = first[0]; x <= last[0]; x++) {
+						pairs[position++] = {brick_key(x, y, z), static_cast<uint32_t>(i)};
+					}
+				}
+			}
+		});
+}
+
+//sorts one chunk of the pairs per thread and merges the chunks pairwise, as cpu_engine::sort does
+void surface_reconstruction::sort_pairs(){
+	TRACE_SCOPE("sort");
+
+	auto less = [](const brick_particle& a, const brick_particle& b) {
+		return a.brick < b.brick || (a.brick == b.brick && a.particle < b.particle);
+	};
+
+	size_t n = pairs.size();
+	size_t num_chunks = std::max<size_t>(1, std::min<size_t>(pool.size(), n / PARTICLE_GRAIN));
+
+	std::vector<size_t> bounds(num_chunks + 1);
+	for(size_t i = 0; i <= num_chunks; i++) {
+		bounds[i] = n * i / num_chunks;
+	}
+
+	pool.run(num_chunks, [&](size_t chunk, unsigned) {
+		std::sort(pairs.begin() + bounds[chunk], pairs.begin() + bounds[chunk + 1], less);
+	});
+
+	while(bounds.size() > 2) {
+		pool.run(bounds.size() / 2, [&](size_t merge, unsigned) {
+			size_t first = bounds[2 * merge];
+			size_t middle = bounds[2 * merge + 1];
+
+			if(2 * merge + 2 >= bounds.size()) {
+				std::copy(pairs.begin() + first, pairs.begin() + middle, pairs_scratch.begin() + first);
+				return;
+			}
+
+			size_t last = bounds[2 * merge + 2];
+			std::merge(pairs.begin() + first, pairs.begin() + middle, pairs.begin() + middle, pairs.begin() + last, pairs_scratch.begin() + first, less);
+		});
+
+		std::vector<size_t> merged_bounds;
+		for(size_t i = 0; i < bounds.size(); i += 2) {
+			merged_bounds.push_back(bounds[i]);
+		}
+		if(merged_bounds.back() != n) {
+			merged_bounds.push_back(n);
+		}
+
+		bounds.swap(merged_bounds);
+		pairs.swap(pairs_scratch);
+	}
+}
+
+//every run of equal keys in the sorted pairs is one brick
+void surface_reconstruction::find_bricks(){
+	TRACE_SCOPE("find_bricks");
+
+	size_t n = pairs.size();
+
+	parallel_primitives::compact_scatter(pool, n,
+		[this](size_t i) { return i == 0 || pairs[i].brick != pairs[i - 1].brick; },
+		[this](size_t total) {
+			bricks.resize(total);
+			brick_keys.resize(total);
+		},
+		[this, n](size_t i, size_t b) {
+			size_t run_end = i + 1;
+			while(run_end < n && pairs[run_end].brick == pairs[i].brick) {
+				run_end++;
+			}
+
+			brick& out = bricks[b];
+			for(int axis = 0; axis < 3; axis++) {
+				out.coord[axis] = key_coordinate(pairs[i].brick, axis);
+			}
+			out.first_particle = static_cast<uint32_t>(i);
+			out.particle_end = static_cast<uint32_t>(run_end);
+			out.surface_slot = NO_VERTEX;
+
+			brick_keys[b] = pairs[i].brick;
+		});
+}
+
+//sums the kernels of the particles of every brick into its samples, in the order of the particle indices
+void surface_reconstruction::splat(const float3* positions){
+	TRACE_SCOPE("splat");
+
+	samples.resize(bricks.size() * SAMPLES_PER_BRICK);
+
+	kernel<poly6_kernel> w(params.radius);
+	float r2_max = params.radius * params.radius;
+	float voxel = params.voxel_size;
+
+	pool.parallel_for(bricks.size(), BRICK_GRAIN, [&](size_t begin, size_t end, unsigned) {
+		for(size_t b = begin; b < end; b++) {
+			float* density = samples.data() + b * SAMPLES_PER_BRICK;
+			std::fill(density, density + SAMPLES_PER_BRICK, 0.f);
+
+			int32_t origin[3];
+			for(int axis = 0; axis < 3; axis++) {
+				origin[axis] = bricks[b].coord[axis] * BRICK_SIZE;
+			}
+
+			for(uint32_t i = bricks[b].first_particle; i < bricks[b].particle_end; i++) {
+				float3 p = positions[pairs[i].particle];
+				const float coordinates[3] = {p.x, p.y, p.z};
+				int first[3];
+				int last[3];
+
+				for(int axis = 0; axis < 3; axis++) {
+					int32_t low = static_cast<int32_t>(std::floor((coordinates[axis] - params.radius) / voxel)) - origin[axis];
+					int32_t high = static_cast<int32_t>(std::ceil((coordinates[axis] + params.radius) / voxel)) - origin[axis];
+
+					first[axis] = std::max(0, low);
+					last[axis] = std::min(BRICK_SIZE, high);
+				}
+
+				for(int z = first[2]; z <= last[2]; z++) {
+					float dz = (origin[2] + z) * voxel - p.z;
+
+					for(int y = first[1]; y <= last[1]; y++) {
+						float dy = (origin[1] + y) * voxel - p.y;
+						float dyz2 = dy * dy + dz * dz;
+						float* row = density + sample_index(0, y, z);
+
+						//adding 0 outside the support leaves the sums unchanged
+						for(int x = first[0]; x <= last[0]; x++) {
+							float dx = (origin[0] + x) * voxel - p.x;
+							float r2 = dx * dx + dyz2;
+							float value = w.value(r2);
+
+							row[x] += r2 < r2_max ? value : 0.f;
+						}
+					}
+				}
+			}
+		}
+	});
+
+	//bricks completely inside or outside the fluid are done here
+	surface_bricks.clear();
+	for(size_t b = 0; b < bricks.size(); b++) {
+		const float* density = samples.data() + b * SAMPLES_PER_BRICK;
+		bool first_inside = density[0] >= params.iso_density;
+
+		for(int s = 1; s < SAMPLES_PER_BRICK; s++) {
+			if((density[s] >= params.iso_density) != first_inside) {
+				bricks[b].surface_slot = static_cast<uint32_t>(surface_bricks.size());
+				surface_bricks.push_back(static_cast<uint32_t>(b));
+				break;
+			}
+		}
+	}
+}
+
+//places a vertex on every crossed edge a surface brick owns
+void surface_reconstruction::place_vertices(){
+	TRACE_SCOPE("place_vertices");
+
+	parts.resize(surface_bricks.size());
+	edge_vertices.resize(surface_bricks.size() * EDGES_PER_BRICK);
+
+	float voxel = params.voxel_size;
+	float iso = params.iso_density;
+
+	pool.parallel_for(surface_bricks.size(), BRICK_GRAIN, [&](size_t begin, size_t end, unsigned) {
+		for(size_t slot = begin; slot < end; slot++) {
+			const brick& b = bricks[surface_bricks[slot]];
+			const float* density = samples.data() + surface_bricks[slot] * SAMPLES_PER_BRICK;
+			uint32_t* vertex_of_edge = edge_vertices.data() + slot * EDGES_PER_BRICK;
+
+			//the samples of the 27 bricks around this one, a brick no particle reaches has a density of 0 everywhere
+			const float* around[27];
+			for(int n = 0; n < 27; n++) {
+				uint32_t idx = find_brick(brick_key(b.coord[0] + n % 3 - 1, b.coord[1] + n / 3 % 3 - 1, b.coord[2] + n / 9 - 1));
+				around[n] = idx == NO_VERTEX ? nullptr : samples.data() + idx * SAMPLES_PER_BRICK;
+			}
+
+			//coordinates in [-1, BRICK_SIZE + 1]
+			auto density_at = [&](int x, int y, int z) {
+				int dx = x < 0 ? -1 : x > BRICK_SIZE ? 1 : 0;
+				int dy = y < 0 ? -1 : y > BRICK_SIZE ? 1 : 0;
+				int dz = z < 0 ? -1 : z > BRICK_SIZE ? 1 : 0;
+
+				const float* neighbor = around[(dz + 1) * 9 + (dy + 1) * 3 + dx + 1];
+				return neighbor ? neighbor[sample_index(x - dx * BRICK_SIZE, y - dy * BRICK_SIZE, z - dz * BRICK_SIZE)] : 0.f;
+			};
+
+			//central differences, the scale doesn't matter for the normals
+			auto gradient_at = [&](int x, int y, int z) {
+				return make_float3(
+					density_at(x + 1, y, z) - density_at(x - 1, y, z),
+					density_at(x, y + 1, z) - density_at(x, y - 1, z),
+					density_at(x, y, z + 1) - density_at(x, y, z - 1));
+			};
+
+			brick_part& part = parts[slot];
+			part.brick = surface_bricks[slot];
+			part.positions.clear();
+			part.normals.clear();
+			part.indices.clear();
+
+			for(int axis = 0; axis < 3; axis++) {
+				int step[3] = {0, 0, 0};
+				step[axis] = 1;
+
+				for(int z = 0; z < BRICK_SIZE; z++) {
+					for(int y = 0; y < BRICK_SIZE; y++) {
+						for(int x = 0; x < BRICK_SIZE; x++) {
+							uint32_t& vertex = vertex_of_edge[edge_index(axis, x, y, z)];
+
+							float a = density[sample_index(x, y, z)];
+							float c = density[sample_index(x + step[0], y + step[1], z + step[2])];
+
+							if((a >= iso) == (c >= iso)) {
+								vertex = NO_VERTEX;
+								continue;
+							}
+
+							float t = (iso - a) / (c - a);
+							float3 p = make_float3(
+								(b.coord[0] * BRICK_SIZE + x + t * step[0]) * voxel,
+								(b.coord[1] * BRICK_SIZE + y + t * step[1]) * voxel,
+								(b.coord[2] * BRICK_SIZE + z + t * step[2]) * voxel);
+
+							//the density falls towards the outside, a vanishing gradient falls back to the direction of the edge
+							float3 g = gradient_at(x, y, z) * (1.f - t) + gradient_at(x + step[0], y + step[1], z + step[2]) * t;
+							float3 normal;
+							if(dot(g, g) > 0.f) {
+								normal = -normalize(g);
+							} else {
+								normal = make_float3(static_cast<float>(step[0]), static_cast<float>(step[1]), static_cast<float>(step[2])) * (a > c ? 1.f : -1.f);
+							}
+
+							vertex = static_cast<uint32_t>(part.positions.size());
+							part.positions.push_back(p);
+							part.normals.push_back(normal);
+						}
+					}
+				}
+			}
+		}
+	});
+
+	uint32_t vertices = 0;
+	for(brick_part& part : parts) {
+		part.first_vertex = vertices;
+		vertices += static_cast<uint32_t>(part.positions.size());
+	}
+}
+
+//triangulates every cube of the surface bricks with the vertices of the bricks owning the edges
+void surface_reconstruction::triangulate(){
+	TRACE_SCOPE("triangulate");
+
+	const std::vector<cube_case>& cases = cube_cases();
+	float iso = params.iso_density;
+
+	pool.parallel_for(surface_bricks.size(), BRICK_GRAIN, [&](size_t begin, size_t end, unsigned) {
+		for(size_t slot = begin; slot < end; slot++) {
+			const brick& b = bricks[surface_bricks[slot]];
+			const float* density = samples.data() + surface_bricks[slot] * SAMPLES_PER_BRICK;
+			brick_part& part = parts[slot];
+
+			//surface slots of this brick and the ones above it, neighbor[dx | dy << 1 | dz << 2]
+			uint32_t neighbor[8];
+			for(int n = 0; n < 8; n++) {
+				uint32_t idx = find_brick(brick_key(b.coord[0] + (n & 1), b.coord[1] + (n >> 1 & 1), b.coord[2] + (n >> 2 & 1)));
+				neighbor[n] = idx == NO_VERTEX ? NO_VERTEX : bricks[idx].surface_slot;
+			}
+
+			auto vertex_at = [&](int axis, int x, int y, int z) {
+				int n = (x == BRICK_SIZE) | (y == BRICK_SIZE) << 1 | (z == BRICK_SIZE) << 2;
+				uint32_t owner = neighbor[n];
+
+				if(owner == NO_VERTEX) {
+					return NO_VERTEX;
+				}
+
+				uint32_t local = edge_vertices[owner * EDGES_PER_BRICK + edge_index(axis, x % BRICK_SIZE, y % BRICK_SIZE, z % BRICK_SIZE)];
+				return local == NO_VERTEX ? NO_VERTEX : parts[owner].first_vertex + local;
+			};
+
+			for(int z = 0; z < BRICK_SIZE; z++) {
+				for(int y = 0; y < BRICK_SIZE; y++) {
+					for(int x = 0; x < BRICK_SIZE; x++) {
+						int configuration = 0;
+						for(int corner = 0; corner < 8; corner++) {
+							float d = density[sample_index(x + (corner & 1), y + (corner >> 1 & 1), z + (corner >> 2 & 1))];
+							configuration |= (d >= iso) << corner;
+						}
+
+						const cube_case& c = cases[configuration];
+
+						for(int t = 0; t < c.triangle_count; t++) {
+							uint32_t triangle[3];
+
+							for(int k = 0; k < 3; k++) {
+								int e = c.edges[3 * t + k];
+								int corner = EDGE_CORNERS[e][0];
+
+								triangle[k] = vertex_at(e / 4, x + (corner & 1), y + (corner >> 1 & 1), z + (corner >> 2 & 1));
+							}
+
+							//can't happen, the owner of a crossed edge sees the same samples and is a surface brick as well
+							if(triangle[0] == NO_VERTEX || triangle[1] == NO_VERTEX || triangle[2] == NO_VERTEX) {
+								continue;
+							}
+
+							part.indices.insert(part.indices.end(), triangle, triangle + 3);
+						}
+					}
+				}
+			}
+		}
+	});
+
+	uint32_t indices = 0;
+	for(brick_part& part : parts) {
+		part.first_index = indices;
+		indices += static_cast<uint32_t>(part.indices.size());
+	}
+}
+
+//copies the parts of all surface bricks into the mesh
+void surface_reconstruction::gather(){
+	TRACE_SCOPE("gather");
+
+	size_t vertices = parts.empty() ? 0 : parts.back().first_vertex + parts.back().positions.size();
+	size_t indices = parts.empty() ? 0 : parts.back().first_index + parts.back().indices.size();
+
+	result.positions.resize(vertices);
+	result.normals.resize(vertices);
+	result.indices.resize(indices);
+
+	pool.run(parts.size(), [this](size_t slot, unsigned) {
+		const brick_part& part = parts[slot];
+
+		std::copy(part.positions.begin(), part.positions.end(), result.positions.begin() + part.first_vertex);
+		std::copy(part.normals.begin(), part.normals.end(), result.normals.begin() + part.first_vertex);
+		std::copy(part.indices.begin(), part.indices.end(), result.indices.begin() + part.first_index);
+	});
+}
+
+uint32_t surface_reconstruction::find_brick(uint64_t key) const{
+	auto it = std::lower_bound(brick_keys.begin(), brick_keys.end(), key);
+
+	if(it == brick_keys.end() || *it != key) {
+		return NO_VERTEX;
+	}
+	return static_cast<uint32_t>(it - brick_keys.begin());
+}
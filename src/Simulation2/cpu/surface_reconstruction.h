@@ -0,0 +1,114 @@
+#pragma once
+
+#include "src/Utility/float3.h"
+#include "src/Utility/thread_pool.h"
+
+#include <cstdint>
+#include <vector>
+
+struct surface_parameters {
+	//edge length of a voxel of the sampling grid
+	float voxel_size;
+	//support of the poly6 kernel that is splatted for every particle
+	float radius;
+	//the surface is where the splatted density crosses this value
+	float iso_density;
+};
+
+//an indexed triangle list, three indices per triangle, counter clockwise when seen from outside the fluid
+//the normals point out of the fluid
+struct surface_mesh {
+	std::vector<float3> positions;
+	std::vector<float3> normals;
+	std::vector<uint32_t> indices;
+};
+
+//extracts a closed triangle mesh around the particles with marching cubes
+//
+//the sampling grid is sparse: it is made of bricks of BRICK_SIZE^3 voxels, and only bricks that some particle reaches exist.
+//	bin:		every particle is paired with the bricks its kernel reaches, the pairs are sorted by (brick, particle)
+//	splat:		every brick sums the kernels of its particles into its (BRICK_SIZE + 1)^3 samples.
+//				the samples on a face between two bricks are computed by both of them from the same particles in the same order,
+//				so they are bitwise identical.
+//	vertices:	only bricks with samples on both sides of iso_density go on. each one places a vertex on every crossed edge it owns,
+//				the edges on its upper faces belong to the bricks above.
+//				the normals are the central differences of the samples, interpolated along the edge.
+//	triangles:	every cube is triangulated, the vertex of an edge is looked up in the brick owning it,
+//				so vertices are shared between neighboring cubes and bricks and the mesh has no cracks.
+//
+//every stage runs in parallel over particles or bricks, the output doesn't depend on the number of threads.
+//the cube triangulations are derived from the face crossings, and on ambiguous faces the inside corners are always separated.
+//both cubes sharing a face make the same choice, which keeps the mesh closed.
+class surface_reconstruction {
+public:
+	//voxels per brick along each axis
+	static constexpr int BRICK_SIZE = 8;
+	static constexpr int BRICK_SAMPLES = BRICK_SIZE + 1;
+	static constexpr uint32_t NO_VERTEX = 0xFFFFFFFF;
+
+	surface_reconstruction(const surface_parameters& params, thread_pool& pool);
+
+	//rebuilds the mesh from the given particles, the returned mesh is valid until the next call
+	const surface_mesh& extract(const float3* positions, size_t count);
+
+	const surface_mesh& mesh() const;
+	const surface_parameters& parameters() const;
+
+	//bricks reached by a particle in the last extraction
+	size_t brick_count() const;
+	//bricks the surface passes through
+	size_t surface_brick_count() const;
+
+private:
+	struct brick_particle {
+		uint64_t brick;
+		uint32_t particle;
+	};
+
+	struct brick {
+		int32_t coord[3];
+		uint32_t first_particle;
+		uint32_t particle_end;
+		//index into surface_bricks, or NO_VERTEX
+		uint32_t surface_slot;
+	};
+
+	//the mesh part of one surface brick, before it is copied into the mesh
+	struct brick_part {
+		uint32_t brick;
+		uint32_t first_vertex;
+		uint32_t first_index;
+
+		std::vector<float3> positions;
+		std::vector<float3> normals;
+		std::vector<uint32_t> indices;
+	};
+
+	surface_parameters params;
+	thread_pool& pool;
+
+	std::vector<brick_particle> pairs;
+	std::vector<brick_particle> pairs_scratch;
+
+	std::vector<brick> bricks;
+	std::vector<uint64_t> brick_keys;
+	std::vector<float> samples;
+
+	std::vector<uint32_t> surface_bricks;
+	std::vector<brick_part> parts;
+	//per surface brick, the local vertex index of its 3 * BRICK_SIZE^3 owned edges
+	std::vector<uint32_t> edge_vertices;
+
+	surface_mesh result;
+
+	void bin(const float3* positions, size_t count);
+	void sort_pairs();
+	void find_bricks();
+	void splat(const float3* positions);
+	void place_vertices();
+	void triangulate();
+	void gather();
+
+	//index of the brick with the given key, or NO_VERTEX if no particle reaches it
+	uint32_t find_brick(uint64_t key) const;
+};
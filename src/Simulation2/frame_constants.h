@@ -24,6 +24,13 @@ namespace frame_constants {
 	static constexpr float EYE[3] = {0.f, -2.f, -10.f};
 	static constexpr float POI[3] = {0.f, -5.f, 0.f};
 
-	static constexpr unsigned int GRID_SIZE[3] = {SIMULATION_BOX_BOUNDARY[0] / KERNEL_RADIUS + 1, SIMULATION_BOX_BOUNDARY[1] / KERNEL_RADIUS + 1, SIMULATION_BOX_BOUNDARY[2] / KERNEL_RADIUS + 1};
+	//every how many compute steps the particle positions are recorded, if RECORD_TRAJECTORY is defined in Simulation2.cpp
+	static constexpr unsigned int TRAJECTORY_INTERVAL = 10;
+
+	static constexpr unsigned int GRID_SIZE[3] = {
+		static_cast<unsigned int>(SIMULATION_BOX_BOUNDARY[0] / KERNEL_RADIUS + 1),
+		static_cast<unsigned int>(SIMULATION_BOX_BOUNDARY[1] / KERNEL_RADIUS + 1),
+		static_cast<unsigned int>(SIMULATION_BOX_BOUNDARY[2] / KERNEL_RADIUS + 1)
+	};
 	static constexpr unsigned int GRID_SIZE_FLAT = GRID_SIZE[0] * GRID_SIZE[1] * GRID_SIZE[2];
 }
@@ -27,15 +27,34 @@ struct SimulationConstants{
 	uint3 grid_size;
 };
 
-RWStructuredBuffer<uint> lookup_buffer : register(u2);
+//a cell is empty unless its generation is the one of the current step
+struct CellEntry {
+	uint generation;
+	uint start;
+};
+
+struct TableConstants {
+	uint generation;
+};
+
+RWStructuredBuffer<CellEntry> lookup_buffer : register(u2);
 StructuredBuffer<Pair> grid_buffer : register(t2);
 ConstantBuffer<SimulationConstants> constants : register(b2);
+ConstantBuffer<TableConstants> table_constants : register(b5);
 
 //this shader calculates the index at which a given cell first appears in the sorted array
+//a pair starts a cell if its predecessor belongs to another one, so every entry has a single writer.
+//the entries of the last step are left behind with an older generation, so the table doesn't need to be cleared
 [numthreads(THREAD_COUNT, 1, 1)]
 void CSMain(uint3 dispatch_thread_id : SV_DispatchThreadID){
 	uint id = dispatch_thread_id.x;
 	uint cell_id = grid_buffer[id].cell_id;
 
-	InterlockedMin(lookup_buffer[cell_id], id);
+	if(id == 0 || grid_buffer[id - 1].cell_id != cell_id) {
+		CellEntry entry;
+		entry.generation = table_constants.generation;
+		entry.start = id;
+
+		lookup_buffer[cell_id] = entry;
+	}
 }
@@ -0,0 +1,252 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+//smoothing kernels as policy types
+//
+//every kernel has a compact support of h and provides
+//	static constexpr float normalization(float h)				the factor that makes the kernel integrate to 1
+//	static float value(float r2, float h, float norm)			W(r), for r2 = r * r < h * h
+//	static float gradient(float r2, float h, float norm)		dW/dr, pointing away from the center for positive values
+//where norm is the result of normalization(h).
+//normalization is constexpr, so constants like computation::SimulationConstants can be computed at compile time.
+//
+//kernel<Policy> and tabulated_kernel<Policy> bind a policy to a radius and are what the particle loops take as template argument,
+//so each kernel choice gets its own inlined loop.
+
+namespace sph_kernels {
+	constexpr float PI = 3.14159265358979f;
+
+	constexpr float power(float x, int n){
+		float result = 1.f;
+
+		for(int i = 0; i < n; i++) {
+			result *= x;
+		}
+		return result;
+	}
+}
+
+//W(r) = 315 / (64 pi h^9) * (h^2 - r^2)^3
+//the density kernel of Mueller et al. 2003, used by density_evaluation.hlsl
+struct poly6_kernel {
+	static constexpr float normalization(float h){
+		return 315.f / (64.f * sph_kernels::PI * sph_kernels::power(h, 9));
+	}
+
+	static float value(float r2, float h, float norm){
+		float d = h * h - r2;
+		return norm * d * d * d;
+	}
+
+	static float gradient(float r2, float h, float norm){
+		float d = h * h - r2;
+		return -6.f * norm * std::sqrt(r2) * d * d;
+	}
+};
+
+//W(r) = 15 / (pi h^6) * (h - r)^3
+//its gradient doesn't vanish at the center, which keeps particles from clumping, used for the pressure in apply_forces.hlsl
+struct spiky_kernel {
+	static constexpr float normalization(float h){
+		return 15.f / (sph_kernels::PI * sph_kernels::power(h, 6));
+	}
+
+	//dW/dr = gradient_factor * (h - r)^2, the pressure_kernel_constant of the shaders
+	static constexpr float gradient_factor(float h){
+		return -3.f * normalization(h);
+	}
+
+	static float value(float r2, float h, float norm){
+		float d = h - std::sqrt(r2);
+		return norm * d * d * d;
+	}
+
+	static float gradient(float r2, float h, float norm){
+		float d = h - std::sqrt(r2);
+		return -3.f * norm * d * d;
+	}
+};
+
+//W(r) = 15 / (2 pi h^3) * (-r^3 / (2 h^3) + r^2 / h^2 + h / (2 r) - 1)
+//the viscosity kernel of Mueller et al. 2003, its laplacian 45 / (pi h^6) * (h - r) is positive everywhere
+struct viscosity_kernel {
+	static constexpr float normalization(float h){
+		return 15.f / (2.f * sph_kernels::PI * sph_kernels::power(h, 3));
+	}
+
+	static float value(float r2, float h, float norm){
+		float r = std::sqrt(r2);
+		float h2 = h * h;
+
+		return norm * (-(r2 * r) / (2.f * h2 * h) + r2 / h2 + h / (2.f * r) - 1.f);
+	}
+
+	static float gradient(float r2, float h, float norm){
+		float r = std::sqrt(r2);
+		float h2 = h * h;
+
+		return norm * (-(3.f * r2) / (2.f * h2 * h) + 2.f * r / h2 - h / (2.f * r2));
+	}
+
+	static float laplacian(float r2, float h, float norm){
+		return norm * 6.f / (h * h * h) * (h - std::sqrt(r2));
+	}
+};
+
+//W(q) = 21 / (2 pi h^3) * (1 - q)^4 * (1 + 4q), q = r / h
+//Wendland C2 in 3D, doesn't suffer from the pairing instability of the spline kernels
+struct wendland_c2_kernel {
+	static constexpr float normalization(float h){
+		return 21.f / (2.f * sph_kernels::PI * sph_kernels::power(h, 3));
+	}
+
+	static float value(float r2, float h, float norm){
+		float q = std::sqrt(r2) / h;
+		float d = 1.f - q;
+
+		return norm * d * d * d * d * (1.f + 4.f * q);
+	}
+
+	static float gradient(float r2, float h, float norm){
+		float q = std::sqrt(r2) / h;
+		float d = 1.f - q;
+
+		return norm * -20.f * q * d * d * d / h;
+	}
+};
+
+//W(q) = 8 / (pi h^3) * (6q^3 - 6q^2 + 1) for q <= 1/2, 8 / (pi h^3) * 2(1 - q)^3 otherwise, q = r / h
+//the cubic B-spline (M4) with its support scaled to h
+struct cubic_spline_kernel {
+	static constexpr float normalization(float h){
+		return 8.f / (sph_kernels::PI * sph_kernels::power(h, 3));
+	}
+
+	static float value(float r2, float h, float norm){
+		float q = std::sqrt(r2) / h;
+
+		if(q <= 0.5f) {
+			return norm * (6.f * q * q * q - 6.f * q * q + 1.f);
+		}
+
+		float d = 1.f - q;
+		return norm * 2.f * d * d * d;
+	}
+
+	static float gradient(float r2, float h, float norm){
+		float q = std::sqrt(r2) / h;
+
+		if(q <= 0.5f) {
+			return norm * (18.f * q * q - 12.f * q) / h;
+		}
+
+		float d = 1.f - q;
+		return norm * -6.f * d * d / h;
+	}
+};
+
+//evaluates a kernel policy analytically
+template<class Policy>
+class kernel {
+public:
+	typedef Policy policy;
+
+	explicit kernel(float h) :
+		h(h),
+		norm(Policy::normalization(h))
+	{}
+
+	float radius() const{
+		return h;
+	}
+
+	float normalization() const{
+		return norm;
+	}
+
+	float value(float r2) const{
+		return Policy::value(r2, h, norm);
+	}
+
+	float gradient(float r2) const{
+		return Policy::gradient(r2, h, norm);
+	}
+
+	float laplacian(float r2) const{
+		return Policy::laplacian(r2, h, norm);
+	}
+
+private:
+	float h;
+	float norm;
+};
+
+//evaluates a kernel policy from tables sampled uniformly in r^2, so no sqrt or division is needed per pair
+//values in between samples are interpolated linearly, the error shrinks with the square of SAMPLES
+template<class Policy, size_t SAMPLES = 1024>
+class tabulated_kernel {
+public:
+	typedef Policy policy;
+
+	explicit tabulated_kernel(float h) :
+		h(h),
+		norm(Policy::normalization(h)),
+		scale(SAMPLES / (h * h)),
+		values(SAMPLES + 2),
+		gradients(SAMPLES + 2)
+	{
+		for(size_t i = 0; i <= SAMPLES; i++) {
+			//some kernels are singular at the center (the viscosity kernel, the gradients of spiky and viscosity),
+			//the first sample takes the value a quarter step away from it
+			float r2 = i == 0 ? 0.25f / scale : static_cast<float>(i) / scale;
+
+			values[i] = Policy::value(r2, h, norm);
+			gradients[i] = Policy::gradient(r2, h, norm);
+		}
+
+		//padding, so interpolating at r2 = h^2 doesn't read past the end
+		values[SAMPLES + 1] = values[SAMPLES];
+		gradients[SAMPLES + 1] = gradients[SAMPLES];
+	}
+
+	float radius() const{
+		return h;
+	}
+
+	float normalization() const{
+		return norm;
+	}
+
+	float value(float r2) const{
+		return lookup(values, r2);
+	}
+
+	float gradient(float r2) const{
+		return lookup(gradients, r2);
+	}
+
+private:
+	float h;
+	float norm;
+	float scale;
+
+	std::vector<float> values;
+	std::vector<float> gradients;
+
+	float lookup(const std::vector<float>& table, float r2) const{
+		float x = r2 * scale;
+
+		//checked before the conversion, which is undefined for values out of range
+		if(!(x < static_cast<float>(SAMPLES))) {
+			return table[SAMPLES];
+		}
+
+		size_t idx = static_cast<size_t>(x);
+
+		float t = x - static_cast<float>(idx);
+		return table[idx] + t * (table[idx + 1] - table[idx]);
+	}
+};
@@ -0,0 +1,366 @@
+#include "trajectory_writer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+	const char FILE_MAGIC[4] = {'L', 'Q', 'T', 'R'};
+
+	template<class T>
+	void write_raw(std::ofstream& file, const T& value){
+		file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	template<class T>
+	bool read_raw(std::ifstream& file, T& value){
+		return static_cast<bool>(file.read(reinterpret_cast<char*>(&value), sizeof(T)));
+	}
+}
+
+constexpr uint32_t trajectory_writer::FILE_VERSION;
+constexpr uint32_t trajectory_writer::QUANTIZATION_LEVELS;
+
+double trajectory_writer::statistics::compression_ratio() const{
+	return compressed_bytes > 0 ? static_cast<double>(raw_bytes) / compressed_bytes : 0.0;
+}
+
+double trajectory_writer::statistics::throughput_mb_per_second() const{
+	return encode_seconds > 0.0 ? raw_bytes / (encode_seconds * 1024.0 * 1024.0) : 0.0;
+}
+
+trajectory_writer::trajectory_writer(const std::string& path, uint32_t particle_count, const float domain_min[3], const float domain_max[3]) :
+	trajectory_writer(path, particle_count, domain_min, domain_max, settings())
+{}
+
+trajectory_writer::trajectory_writer(const std::string& path, uint32_t particle_count, const float domain_min[3], const float domain_max[3], settings config) :
+	particle_count(particle_count),
+	config(config),
+	file(path, std::ios::binary | std::ios::trunc),
+	head(0),
+	count(0),
+	flush_requested(false),
+	shut_down(false),
+	zero_run(0),
+	frames_submitted(0),
+	frames_written(0),
+	frames_dropped(0),
+	compressed_bytes(0),
+	encode_nanoseconds(0)
+{
+	if(!file) {
+		throw std::runtime_error("trajectory_writer: could not open " + path);
+	}
+
+	this->config.queue_capacity = std::max(1u, config.queue_capacity);
+	this->config.frames_per_chunk = std::max(1u, config.frames_per_chunk);
+
+	for(int i = 0; i < 3; i++) {
+		float extent = domain_max[i] - domain_min[i];
+
+		this->domain_min[i] = domain_min[i];
+		domain_scale[i] = extent > 0.f ? QUANTIZATION_LEVELS / extent : 0.f;
+	}
+
+	slots.resize(this->config.queue_capacity);
+	for(slot& s : slots) {
+		s.positions.resize(static_cast<size_t>(particle_count) * 3);
+	}
+
+	previous_frame.resize(static_cast<size_t>(particle_count) * 3);
+	current_frame.resize(static_cast<size_t>(particle_count) * 3);
+	chunk_steps.reserve(this->config.frames_per_chunk);
+	//a settled fluid needs about a byte per coordinate, the worst case is three bytes
+	chunk_payload.reserve(static_cast<size_t>(particle_count) * 3 * this->config.frames_per_chunk);
+
+	file.write(FILE_MAGIC, sizeof(FILE_MAGIC));
+	write_raw(file, FILE_VERSION);
+	write_raw(file, particle_count);
+	file.write(reinterpret_cast<const char*>(domain_min), sizeof(float) * 3);
+	file.write(reinterpret_cast<const char*>(domain_max), sizeof(float) * 3);
+	write_raw(file, this->config.frames_per_chunk);
+
+	thread = std::thread(&trajectory_writer::writer_loop, this);
+}
+
+trajectory_writer::~trajectory_writer(){
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		shut_down = true;
+	}
+	work_available.notify_one();
+	thread.join();
+}
+
+bool trajectory_writer::submit(uint64_t step, const float* positions){
+	frames_submitted.fetch_add(1, std::memory_order_relaxed);
+
+	uint32_t idx;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if(count == slots.size()) {
+			frames_dropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		idx = (head + count) % slots.size();
+	}
+
+	//the slot is not yet visible to the writer thread, so it can be filled outside of the lock
+	slots[idx].step = step;
+	memcpy(slots[idx].positions.data(), positions, slots[idx].positions.size() * sizeof(float));
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		count++;
+	}
+	work_available.notify_one();
+
+	return true;
+}
+
+void trajectory_writer::flush(){
+	std::unique_lock<std::mutex> lock(mutex);
+
+	flush_requested = true;
+	work_available.notify_one();
+	work_done.wait(lock, [this]() { return !flush_requested; });
+}
+
+trajectory_writer::statistics trajectory_writer::stats() const{
+	statistics result;
+
+	result.frames_submitted = frames_submitted.load(std::memory_order_relaxed);
+	result.frames_written = frames_written.load(std::memory_order_relaxed);
+	result.frames_dropped = frames_dropped.load(std::memory_order_relaxed);
+	result.raw_bytes = result.frames_written * particle_count * sizeof(float) * 3;
+	result.compressed_bytes = compressed_bytes.load(std::memory_order_relaxed);
+	result.encode_seconds = encode_nanoseconds.load(std::memory_order_relaxed) * 1e-9;
+
+	return result;
+}
+
+void trajectory_writer::writer_loop(){
+	std::unique_lock<std::mutex> lock(mutex);
+
+	while(true) {
+		work_available.wait(lock, [this]() { return count > 0 || flush_requested || shut_down; });
+
+		if(count > 0) {
+			const slot& frame = slots[head];
+			lock.unlock();
+
+			encode_frame(frame);
+
+			lock.lock();
+			head = (head + 1) % slots.size();
+			count--;
+			continue;
+		}
+
+		//the queue is drained at this point
+		lock.unlock();
+		auto start = std::chrono::steady_clock::now();
+		write_chunk();
+		file.flush();
+		encode_nanoseconds.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(), std::memory_order_relaxed);
+		lock.lock();
+
+		if(flush_requested) {
+			flush_requested = false;
+			work_done.notify_all();
+		}
+
+		if(shut_down) {
+			break;
+		}
+	}
+}
+
+void trajectory_writer::encode_frame(const slot& frame){
+	auto start = std::chrono::steady_clock::now();
+
+	//every chunk starts with a key frame, which is encoded against zero
+	if(chunk_steps.empty()) {
+		std::fill(previous_frame.begin(), previous_frame.end(), static_cast<uint16_t>(0));
+	}
+
+	const float* pos = frame.positions.data();
+	size_t num_values = current_frame.size();
+
+	for(size_t i = 0; i < num_values; i++) {
+		float q = std::round((pos[i] - domain_min[i % 3]) * domain_scale[i % 3]);
+		current_frame[i] = static_cast<uint16_t>(std::min(static_cast<float>(QUANTIZATION_LEVELS), std::max(0.f, q)));
+	}
+
+	for(size_t i = 0; i < num_values; i++) {
+		int32_t delta = static_cast<int32_t>(current_frame[i]) - static_cast<int32_t>(previous_frame[i]);
+		put_value((static_cast<uint32_t>(delta) << 1) ^ static_cast<uint32_t>(delta >> 31));
+	}
+
+	current_frame.swap(previous_frame);
+	chunk_steps.push_back(frame.step);
+
+	if(chunk_steps.size() == config.frames_per_chunk) {
+		write_chunk();
+	}
+
+	frames_written.fetch_add(1, std::memory_order_relaxed);
+	encode_nanoseconds.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(), std::memory_order_relaxed);
+}
+
+void trajectory_writer::write_chunk(){
+	if(chunk_steps.empty()) {
+		return;
+	}
+
+	end_zero_run();
+
+	uint32_t frame_count = static_cast<uint32_t>(chunk_steps.size());
+	uint32_t payload_bytes = static_cast<uint32_t>(chunk_payload.size());
+
+	write_raw(file, frame_count);
+	write_raw(file, payload_bytes);
+	file.write(reinterpret_cast<const char*>(chunk_steps.data()), chunk_steps.size() * sizeof(uint64_t));
+	file.write(reinterpret_cast<const char*>(chunk_payload.data()), chunk_payload.size());
+
+	compressed_bytes.fetch_add(sizeof(frame_count) + sizeof(payload_bytes) + chunk_steps.size() * sizeof(uint64_t) + payload_bytes, std::memory_order_relaxed);
+
+	chunk_steps.clear();
+	chunk_payload.clear();
+}
+
+void trajectory_writer::put_value(uint32_t zigzag_value){
+	if(zigzag_value == 0) {
+		zero_run++;
+		return;
+	}
+
+	end_zero_run();
+	put_varint(zigzag_value);
+}
+
+void trajectory_writer::put_varint(uint32_t value){
+	while(value >= 0x80) {
+		chunk_payload.push_back(static_cast<uint8_t>(value | 0x80));
+		value >>= 7;
+	}
+	chunk_payload.push_back(static_cast<uint8_t>(value));
+}
+
+void trajectory_writer::end_zero_run(){
+	if(zero_run > 0) {
+		chunk_payload.push_back(0);
+		put_varint(zero_run);
+		zero_run = 0;
+	}
+}
+
+
+trajectory_reader::trajectory_reader(const std::string& path) :
+	file(path, std::ios::binary),
+	payload_pos(0),
+	frame_in_chunk(0),
+	zero_run(0)
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t frames_per_chunk;
+	float domain_max[3];
+
+	if(!file.read(magic, sizeof(magic)) || memcmp(magic, FILE_MAGIC, sizeof(magic)) != 0) {
+		throw std::runtime_error("trajectory_reader: " + path + " is not a trajectory file");
+	}
+
+	read_raw(file, version);
+	read_raw(file, num_particles);
+	file.read(reinterpret_cast<char*>(domain_min), sizeof(domain_min));
+	file.read(reinterpret_cast<char*>(domain_max), sizeof(domain_max));
+	read_raw(file, frames_per_chunk);
+
+	if(!file || version != trajectory_writer::FILE_VERSION) {
+		throw std::runtime_error("trajectory_reader: unsupported header in " + path);
+	}
+
+	for(int i = 0; i < 3; i++) {
+		domain_scale[i] = (domain_max[i] - domain_min[i]) / trajectory_writer::QUANTIZATION_LEVELS;
+	}
+
+	frame.resize(static_cast<size_t>(num_particles) * 3);
+}
+
+uint32_t trajectory_reader::particle_count() const{
+	return num_particles;
+}
+
+bool trajectory_reader::next(uint64_t& step, float* positions){
+	if(frame_in_chunk == chunk_steps.size()) {
+		if(!read_chunk()) {
+			return false;
+		}
+		std::fill(frame.begin(), frame.end(), static_cast<uint16_t>(0));
+	}
+
+	for(size_t i = 0; i < frame.size(); i++) {
+		uint32_t zz = get_value();
+		int32_t delta = static_cast<int32_t>(zz >> 1) ^ -static_cast<int32_t>(zz & 1);
+
+		frame[i] = static_cast<uint16_t>(frame[i] + delta);
+		positions[i] = domain_min[i % 3] + frame[i] * domain_scale[i % 3];
+	}
+
+	step = chunk_steps[frame_in_chunk++];
+	return true;
+}
+
+bool trajectory_reader::read_chunk(){
+	uint32_t frame_count;
+	uint32_t payload_bytes;
+
+	if(!read_raw(file, frame_count) || !read_raw(file, payload_bytes) || frame_count == 0) {
+		return false;
+	}
+
+	chunk_steps.resize(frame_count);
+	chunk_payload.resize(payload_bytes);
+
+	file.read(reinterpret_cast<char*>(chunk_steps.data()), frame_count * sizeof(uint64_t));
+	file.read(reinterpret_cast<char*>(chunk_payload.data()), payload_bytes);
+
+	payload_pos = 0;
+	frame_in_chunk = 0;
+	zero_run = 0;
+
+	return static_cast<bool>(file);
+}
+
+uint32_t trajectory_reader::get_value(){
+	if(zero_run > 0) {
+		zero_run--;
+		return 0;
+	}
+
+	if(chunk_payload.at(payload_pos) == 0) {
+		payload_pos++;
+		zero_run = get_varint() - 1;
+		return 0;
+	}
+
+	return get_varint();
+}
+
+uint32_t trajectory_reader::get_varint(){
+	uint32_t value = 0;
+	uint32_t shift = 0;
+	uint8_t byte;
+
+	do {
+		byte = chunk_payload.at(payload_pos++);
+		value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+		shift += 7;
+	} while(byte & 0x80);
+
+	return value;
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//records particle positions to disk without stalling the simulation thread
+//
+//submitted frames are copied into a fixed pool of slots and handed to a background thread through a bounded queue.
+//the writer quantizes every coordinate to 16 bit against the domain bounds,
+//encodes it as the difference to the same particle in the previous frame and compresses the resulting stream chunk by chunk.
+//
+//file layout (little endian):
+//	header:	"LQTR" | uint32 version | uint32 particle_count | float domain_min[3] | float domain_max[3] | uint32 frames_per_chunk
+//	chunk:	uint32 frame_count | uint32 payload_bytes | uint64 step[frame_count] | payload
+//
+//the first frame of every chunk is encoded against zero, so each chunk can be decoded on its own.
+//the payload is a sequence of zigzag encoded deltas stored as LEB128 varints,
+//a 0x00 byte followed by a varint n stands for n consecutive zero deltas (a varint of a non zero value never starts with 0x00)
+class trajectory_writer {
+public:
+	struct settings {
+		//how many frames can wait for the writer thread, before new frames get dropped
+		uint32_t queue_capacity = 8;
+		uint32_t frames_per_chunk = 16;
+	};
+
+	struct statistics {
+		uint64_t frames_submitted;
+		uint64_t frames_written;
+		uint64_t frames_dropped;
+
+		uint64_t raw_bytes;					//bytes the frames would occupy as plain float3 arrays
+		uint64_t compressed_bytes;	//bytes written to the file (without the header)
+		double encode_seconds;			//time the writer thread spent quantizing, encoding and writing
+
+		double compression_ratio() const;
+		//raw megabytes per second the writer thread can process
+		double throughput_mb_per_second() const;
+	};
+
+	static constexpr uint32_t FILE_VERSION = 1;
+	static constexpr uint32_t QUANTIZATION_LEVELS = 0xFFFF;
+
+	trajectory_writer(const std::string& path, uint32_t particle_count, const float domain_min[3], const float domain_max[3], settings config);
+	trajectory_writer(const std::string& path, uint32_t particle_count, const float domain_min[3], const float domain_max[3]);
+	~trajectory_writer();
+
+	trajectory_writer(const trajectory_writer&) = delete;
+	trajectory_writer& operator=(const trajectory_writer&) = delete;
+
+	//copies particle_count float3 positions into the queue, must only be called from one thread
+	//returns false, if all slots are occupied; the frame is dropped in that case instead of waiting for the disk
+	bool submit(uint64_t step, const float* positions);
+
+	//blocks until every queued frame is on disk and the current chunk is flushed
+	void flush();
+
+	statistics stats() const;
+
+private:
+	struct slot {
+		uint64_t step;
+		std::vector<float> positions;
+	};
+
+	uint32_t particle_count;
+	float domain_min[3];
+	float domain_scale[3];
+	settings config;
+
+	std::ofstream file;
+
+	//ring of preallocated frames: [head, head + count) are waiting for the writer thread
+	std::vector<slot> slots;
+	uint32_t head;
+	uint32_t count;
+	bool flush_requested;
+	bool shut_down;
+
+	mutable std::mutex mutex;
+	std::condition_variable work_available;
+	std::condition_variable work_done;
+
+	//only touched by the writer thread
+	std::vector<uint16_t> previous_frame;
+	std::vector<uint16_t> current_frame;
+	std::vector<uint64_t> chunk_steps;
+	std::vector<uint8_t> chunk_payload;
+	uint32_t zero_run;
+
+	std::atomic<uint64_t> frames_submitted;
+	std::atomic<uint64_t> frames_written;
+	std::atomic<uint64_t> frames_dropped;
+	std::atomic<uint64_t> compressed_bytes;
+	std::atomic<uint64_t> encode_nanoseconds;
+
+	std::thread thread;
+
+	void writer_loop();
+	void encode_frame(const slot& frame);
+	void write_chunk();
+
+	void put_value(uint32_t zigzag_value);
+	void put_varint(uint32_t value);
+	void end_zero_run();
+};
+
+//decodes files written by trajectory_writer
+class trajectory_reader {
+public:
+	explicit trajectory_reader(const std::string& path);
+
+	uint32_t particle_count() const;
+
+	//reads the next frame into positions (particle_count float3 values)
+	//returns false at the end of the file
+	bool next(uint64_t& step, float* positions);
+
+private:
+	std::ifstream file;
+
+	uint32_t num_particles;
+	float domain_min[3];
+	float domain_scale[3];
+
+	std::vector<uint64_t> chunk_steps;
+	std::vector<uint8_t> chunk_payload;
+	size_t payload_pos;
+	uint32_t frame_in_chunk;
+	uint32_t zero_run;
+
+	std::vector<uint16_t> frame;
+
+	bool read_chunk();
+	uint32_t get_value();
+	uint32_t get_varint();
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+//a fixed number of default constructed elements, the first one at an ALIGNMENT aligned address
+//
+//for the types padded to a cache line with alignas(64) that every thread or slot has one of, so no two of them share a line.
+//C++14 has no aligned operator new, in a std::vector they only get the alignment of the heap.
+//the memory is over allocated and aligned by hand like the blocks of step_arena.
+template<typename T, size_t ALIGNMENT = 64>
+class aligned_array {
+public:
+	static_assert(ALIGNMENT % alignof(T) == 0, "the alignment has to be a multiple of the one of the type");
+
+	explicit aligned_array(size_t count) :
+		memory(::operator new(count * sizeof(T) + ALIGNMENT - 1)),
+		elements(reinterpret_cast<T*>((reinterpret_cast<uintptr_t>(memory) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT)),
+		element_count(0)
+	{
+		try {
+			for(; element_count < count; element_count++) {
+				new(elements + element_count) T();
+			}
+		} catch(...) {
+			destroy();
+			throw;
+		}
+	}
+
+	~aligned_array(){
+		destroy();
+	}
+
+	aligned_array(const aligned_array&) = delete;
+	aligned_array& operator=(const aligned_array&) = delete;
+
+	size_t size() const{
+		return element_count;
+	}
+
+	T& operator[](size_t idx){
+		return elements[idx];
+	}
+
+	const T& operator[](size_t idx) const{
+		return elements[idx];
+	}
+
+	T* begin(){
+		return elements;
+	}
+
+	T* end(){
+		return elements + element_count;
+	}
+
+	const T* begin() const{
+		return elements;
+	}
+
+	const T* end() const{
+		return elements + element_count;
+	}
+
+private:
+	void* memory;
+	T* elements;
+	size_t element_count;
+
+	void destroy(){
+		while(element_count > 0) {
+			elements[--element_count].~T();
+		}
+		::operator delete(memory);
+	}
+};
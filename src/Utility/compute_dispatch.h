@@ -0,0 +1,228 @@
+#pragma once
+
+#include "thread_pool.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+//a small execution layer for running line-for-line C++ ports of HLSL compute shaders on the CPU
+//
+//dispatch() runs the thread groups of a Dispatch(x, y, z) on a thread_pool, one group per task.
+//the threads of a group run one after another on the same worker, so a kernel sees the same ids as on the GPU,
+//but the order in which threads and groups run is as unspecified as there.
+
+struct uint3 {
+	uint32_t x;
+	uint32_t y;
+	uint32_t z;
+};
+
+inline uint3 make_uint3(uint32_t x, uint32_t y, uint32_t z){
+	uint3 result = {x, y, z};
+	return result;
+}
+
+//the system values a compute shader can ask for
+struct thread_ids {
+	uint3 dispatch_thread_id;	//SV_DispatchThreadID
+	uint3 group_id;				//SV_GroupID
+	uint3 group_thread_id;		//SV_GroupThreadID
+	uint32_t group_index;		//SV_GroupIndex
+};
+
+class compute_dispatcher {
+public:
+	explicit compute_dispatcher(thread_pool& pool) :
+		pool(pool)
+	{}
+
+	//calls kernel(ids) for every thread of groups.x * groups.y * groups.z groups, numthreads are the [numthreads] of the shader
+	template<class K>
+	void dispatch(uint3 numthreads, uint3 groups, K&& kernel){
+		dispatch_with_barriers(numthreads, groups, [&](const thread_ids& ids, uint32_t) {
+			kernel(ids);
+			return false;
+		});
+	}
+
+	//for shaders with group barriers (GroupMemoryBarrierWithGroupSync, AllMemoryBarrier, ...)
+	//
+	//the shader is split at its barriers into phases and kernel(ids, phase) runs one phase of one thread.
+	//it returns true if the thread reached a barrier and wants to continue with the next phase.
+	//every thread of a group finishes phase n before any thread starts phase n + 1, which is what the barrier guarantees.
+	//the group ends once no thread asks for another phase.
+	//
+	//locals that live across a barrier have to be derived from phase or kept in arrays indexed by group_index,
+	//the same way groupshared memory would be used.
+	template<class K>
+	void dispatch_with_barriers(uint3 numthreads, uint3 groups, K&& kernel){
+		uint32_t threads_per_group = numthreads.x * numthreads.y * numthreads.z;
+		size_t group_count = static_cast<size_t>(groups.x) * groups.y * groups.z;
+
+		if(threads_per_group == 0 || group_count == 0) {
+			return;
+		}
+
+		pool.run(group_count, [&](size_t group, unsigned) {
+			thread_ids ids;
+			ids.group_id.x = static_cast<uint32_t>(group % groups.x);
+			ids.group_id.y = static_cast<uint32_t>(group / groups.x % groups.y);
+			ids.group_id.z = static_cast<uint32_t>(group / groups.x / groups.y);
+
+			bool next_phase = true;
+
+			for(uint32_t phase = 0; next_phase; phase++) {
+				next_phase = false;
+
+				for(uint32_t idx = 0; idx < threads_per_group; idx++) {
+					ids.group_index = idx;
+					ids.group_thread_id.x = idx % numthreads.x;
+					ids.group_thread_id.y = idx / numthreads.x % numthreads.y;
+					ids.group_thread_id.z = idx / numthreads.x / numthreads.y;
+
+					ids.dispatch_thread_id.x = ids.group_id.x * numthreads.x + ids.group_thread_id.x;
+					ids.dispatch_thread_id.y = ids.group_id.y * numthreads.y + ids.group_thread_id.y;
+					ids.dispatch_thread_id.z = ids.group_id.z * numthreads.z + ids.group_thread_id.z;
+
+					if(kernel(static_cast<const thread_ids&>(ids), phase)) {
+						next_phase = true;
+					}
+				}
+			}
+		});
+	}
+
+private:
+	thread_pool& pool;
+};
+
+//float to int conversion with the D3D rules: NaN becomes 0 and values out of range saturate,
+//where a plain cast in C++ would be undefined
+inline int hlsl_float_to_int(float value){
+	if(value != value) {
+		return 0;
+	}
+	if(value >= 2147483647.f) {
+		return 2147483647;
+	}
+	if(value <= -2147483648.f) {
+		return -2147483647 - 1;
+	}
+	return static_cast<int>(value);
+}
+
+//a uint buffer for the Interlocked* functions
+class interlocked_buffer {
+public:
+	explicit interlocked_buffer(size_t size) :
+		values(new std::atomic<uint32_t>[size]),
+		count(size)
+	{
+		fill(0);
+	}
+
+	size_t size() const{
+		return count;
+	}
+
+	//like copying a reset buffer over it, must not run concurrently with a dispatch
+	void fill(uint32_t value){
+		for(size_t i = 0; i < count; i++) {
+			values[i].store(value, std::memory_order_relaxed);
+		}
+	}
+
+	std::atomic<uint32_t>& operator[](size_t idx){
+		return values[idx];
+	}
+
+	uint32_t load(size_t idx) const{
+		return values[idx].load(std::memory_order_relaxed);
+	}
+
+private:
+	std::unique_ptr<std::atomic<uint32_t>[]> values;
+	size_t count;
+};
+
+//InterlockedMin, returns the original value like the optional out parameter
+inline uint32_t interlocked_min(std::atomic<uint32_t>& dest, uint32_t value){
+	uint32_t original = dest.load(std::memory_order_relaxed);
+
+	while(value < original && !dest.compare_exchange_weak(original, value, std::memory_order_relaxed)) {}
+	return original;
+}
+
+//InterlockedMax
+inline uint32_t interlocked_max(std::atomic<uint32_t>& dest, uint32_t value){
+	uint32_t original = dest.load(std::memory_order_relaxed);
+
+	while(value > original && !dest.compare_exchange_weak(original, value, std::memory_order_relaxed)) {}
+	return original;
+}
+
+//InterlockedAdd
+inline uint32_t interlocked_add(std::atomic<uint32_t>& dest, uint32_t value){
+	return dest.fetch_add(value, std::memory_order_relaxed);
+}
+
+//AppendStructuredBuffer<T>
+//
+//Append() reserves a slot with an atomic counter, so the order of the elements is as unspecified as on the GPU.
+//appending to a full buffer is undefined on the GPU, here the element is dropped and counted.
+template<class T>
+class append_buffer {
+public:
+	explicit append_buffer(size_t capacity) :
+		elements(capacity),
+		counter(0),
+		overflow(0)
+	{}
+
+	//named like the HLSL method, so ports read the same as the shader
+	void Append(const T& value){
+		size_t idx = counter.fetch_add(1, std::memory_order_relaxed);
+
+		if(idx < elements.size()) {
+			elements[idx] = value;
+		} else {
+			overflow.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	//like resetting the UAV counter, must not run concurrently with a dispatch
+	void reset(){
+		counter.store(0, std::memory_order_relaxed);
+		overflow.store(0, std::memory_order_relaxed);
+	}
+
+	//number of stored elements, valid once the dispatch has returned
+	size_t size() const{
+		size_t appended = counter.load(std::memory_order_relaxed);
+		return appended < elements.size() ? appended : elements.size();
+	}
+
+	size_t capacity() const{
+		return elements.size();
+	}
+
+	size_t dropped() const{
+		return overflow.load(std::memory_order_relaxed);
+	}
+
+	const T* data() const{
+		return elements.data();
+	}
+
+	const T& operator[](size_t idx) const{
+		return elements[idx];
+	}
+
+private:
+	std::vector<T> elements;
+	std::atomic<size_t> counter;
+	std::atomic<size_t> overflow;
+};
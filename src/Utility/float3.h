@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cmath>
+
+//a minimal stand in for the HLSL float3 type, so shader code can be ported to the CPU engines almost unchanged
+//the layout matches the float[3] elements of the vertex buffers
+struct float3 {
+	float x;
+	float y;
+	float z;
+};
+
+inline float3 make_float3(float x, float y, float z){
+	float3 result = {x, y, z};
+	return result;
+}
+
+inline float3 operator+(float3 a, float3 b){ return make_float3(a.x + b.x, a.y + b.y, a.z + b.z); }
+inline float3 operator-(float3 a, float3 b){ return make_float3(a.x - b.x, a.y - b.y, a.z - b.z); }
+inline float3 operator-(float3 a){ return make_float3(-a.x, -a.y, -a.z); }
+inline float3 operator*(float3 a, float s){ return make_float3(a.x * s, a.y * s, a.z * s); }
+inline float3 operator*(float s, float3 a){ return make_float3(a.x * s, a.y * s, a.z * s); }
+//component wise, as in HLSL
+inline float3 operator*(float3 a, float3 b){ return make_float3(a.x * b.x, a.y * b.y, a.z * b.z); }
+inline float3 operator/(float3 a, float s){ return make_float3(a.x / s, a.y / s, a.z / s); }
+
+inline float3& operator+=(float3& a, float3 b){ a = a + b; return a; }
+inline float3& operator-=(float3& a, float3 b){ a = a - b; return a; }
+inline float3& operator*=(float3& a, float s){ a = a * s; return a; }
+
+inline float dot(float3 a, float3 b){ return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline float length(float3 a){ return std::sqrt(dot(a, a)); }
+
+//like in HLSL, normalizing a zero vector yields NaNs
+inline float3 normalize(float3 a){ return a / length(a); }
+
+inline float3 cross(float3 a, float3 b){
+	return make_float3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+
+inline float3 reflect(float3 i, float3 n){ return i - 2.f * dot(n, i) * n; }
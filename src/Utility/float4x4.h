@@ -0,0 +1,121 @@
+#pragma once
+
+#include "float3.h"
+
+#include <cmath>
+
+//a minimal stand in for XMMATRIX and the DirectXMath functions the renderers build their matrices with, so the CPU renderers don't need Windows
+//like XMMATRIX, points are row vectors multiplied from the left: clip = float4(p, 1) * world * view * projection.
+//the shaders receive the XMMATRIX untransposed and read it column major, so mul(m, v) in HLSL computes the same product.
+struct float4 {
+	float x;
+	float y;
+	float z;
+	float w;
+};
+
+struct float4x4 {
+	float m[4][4];
+};
+
+inline float4 make_float4(float x, float y, float z, float w){
+	float4 result = {x, y, z, w};
+	return result;
+}
+
+inline float4x4 identity_matrix(){
+	float4x4 result = {{
+		{1.f, 0.f, 0.f, 0.f},
+		{0.f, 1.f, 0.f, 0.f},
+		{0.f, 0.f, 1.f, 0.f},
+		{0.f, 0.f, 0.f, 1.f},
+	}};
+	return result;
+}
+
+//XMMatrixMultiply, a is applied first
+inline float4x4 operator*(const float4x4& a, const float4x4& b){
+	float4x4 result;
+
+	for(int r = 0; r < 4; r++) {
+		for(int c = 0; c < 4; c++) {
+			result.m[r][c] = a.m[r][0] * b.m[0][c] + a.m[r][1] * b.m[1][c] + a.m[r][2] * b.m[2][c] + a.m[r][3] * b.m[3][c];
+		}
+	}
+	return result;
+}
+
+//float4(p, 1) * m
+inline float4 transform_point(float3 p, const float4x4& m){
+	return make_float4(
+		p.x * m.m[0][0] + p.y * m.m[1][0] + p.z * m.m[2][0] + m.m[3][0],
+		p.x * m.m[0][1] + p.y * m.m[1][1] + p.z * m.m[2][1] + m.m[3][1],
+		p.x * m.m[0][2] + p.y * m.m[1][2] + p.z * m.m[2][2] + m.m[3][2],
+		p.x * m.m[0][3] + p.y * m.m[1][3] + p.z * m.m[2][3] + m.m[3][3]);
+}
+
+//XMMatrixTranslation
+inline float4x4 translation(float x, float y, float z){
+	float4x4 result = identity_matrix();
+
+	result.m[3][0] = x;
+	result.m[3][1] = y;
+	result.m[3][2] = z;
+	return result;
+}
+
+//XMMatrixLookAtLH
+inline float4x4 look_at_lh(float3 eye, float3 focus, float3 up){
+	float3 z_axis = normalize(focus - eye);
+	float3 x_axis = normalize(cross(up, z_axis));
+	float3 y_axis = cross(z_axis, x_axis);
+
+	float4x4 result = {{
+		{x_axis.x, y_axis.x, z_axis.x, 0.f},
+		{x_axis.y, y_axis.y, z_axis.y, 0.f},
+		{x_axis.z, y_axis.z, z_axis.z, 0.f},
+		{-dot(x_axis, eye), -dot(y_axis, eye), -dot(z_axis, eye), 1.f},
+	}};
+	return result;
+}
+
+//XMMatrixPerspectiveFovLH, depth goes from 0 at near_z to 1 at far_z
+inline float4x4 perspective_fov_lh(float fov_y, float aspect_ratio, float near_z, float far_z){
+	float height = std::cos(fov_y * 0.5f) / std::sin(fov_y * 0.5f);
+	float width = height / aspect_ratio;
+	float range = far_z / (far_z - near_z);
+
+	float4x4 result = {{
+		{width, 0.f, 0.f, 0.f},
+		{0.f, height, 0.f, 0.f},
+		{0.f, 0.f, range, 1.f},
+		{0.f, 0.f, -range * near_z, 0.f},
+	}};
+	return result;
+}
+
+//float4(v, 0) * m, for directions
+inline float3 transform_vector(float3 v, const float4x4& m){
+	return make_float3(
+		v.x * m.m[0][0] + v.y * m.m[1][0] + v.z * m.m[2][0],
+		v.x * m.m[0][1] + v.y * m.m[1][1] + v.z * m.m[2][1],
+		v.x * m.m[0][2] + v.y * m.m[1][2] + v.z * m.m[2][2]);
+}
+
+//XMMatrixInverse for matrices made of a rotation followed by a translation, like the ones look_at_lh builds
+inline float4x4 rigid_inverse(const float4x4& m){
+	float3 row[3] = {
+		make_float3(m.m[0][0], m.m[0][1], m.m[0][2]),
+		make_float3(m.m[1][0], m.m[1][1], m.m[1][2]),
+		make_float3(m.m[2][0], m.m[2][1], m.m[2][2]),
+	};
+	float3 t = make_float3(m.m[3][0], m.m[3][1], m.m[3][2]);
+
+	float4x4 result = {{
+		{row[0].x, row[1].x, row[2].x, 0.f},
+		{row[0].y, row[1].y, row[2].y, 0.f},
+		{row[0].z, row[1].z, row[2].z, 0.f},
+		{-dot(t, row[0]), -dot(t, row[1]), -dot(t, row[2]), 1.f},
+	}};
+	return result;
+}
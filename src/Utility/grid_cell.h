@@ -0,0 +1,18 @@
+#pragma once
+
+#include "float3.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+//the flat index of the cell of a grid starting at the origin that p falls into, x fastest, then y, then z.
+//positions outside of the grid count to the nearest cell. cpu_engine sorts its particles by it,
+//and the helpers of the renderers that group particles by the cells of the simulation use the same one
+inline uint32_t clamped_cell(float3 p, const uint32_t grid_dim[3], const float cell_size[3]){
+	int x = std::min(std::max(static_cast<int>(std::floor(p.x / cell_size[0])), 0), static_cast<int>(grid_dim[0]) - 1);
+	int y = std::min(std::max(static_cast<int>(std::floor(p.y / cell_size[1])), 0), static_cast<int>(grid_dim[1]) - 1);
+	int z = std::min(std::max(static_cast<int>(std::floor(p.z / cell_size[2])), 0), static_cast<int>(grid_dim[2]) - 1);
+
+	return (z * grid_dim[1] + y) * grid_dim[0] + x;
+}
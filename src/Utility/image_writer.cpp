@@ -0,0 +1,34 @@
+#include "image_writer.h"
+
+#include <cstdio>
+#include <stdexcept>
+#include <vector>
+
+void write_ppm(const std::string& path, uint32_t width, uint32_t height, const uint32_t* pixels){
+	FILE* file = fopen(path.c_str(), "wb");
+
+	if(!file) {
+		throw std::runtime_error("can't open " + path);
+	}
+
+	fprintf(file, "P6\n%u %u\n255\n", width, height);
+
+	std::vector<unsigned char> row(width * 3);
+	bool ok = true;
+
+	for(uint32_t y = 0; y < height && ok; y++) {
+		for(uint32_t x = 0; x < width; x++) {
+			uint32_t pixel = pixels[y * width + x];
+
+			row[3 * x] = static_cast<unsigned char>(pixel & 0xFF);
+			row[3 * x + 1] = static_cast<unsigned char>(pixel >> 8 & 0xFF);
+			row[3 * x + 2] = static_cast<unsigned char>(pixel >> 16 & 0xFF);
+		}
+
+		ok = fwrite(row.data(), 1, row.size(), file) == row.size();
+	}
+
+	if(fclose(file) != 0 || !ok) {
+		throw std::runtime_error("can't write " + path);
+	}
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+//writes an image of R8G8B8A8 pixels, packed as in DXGI_FORMAT_R8G8B8A8_UNORM (red in the lowest byte), rows from top to bottom,
+//as binary PPM. alpha is dropped. throws std::runtime_error if the file can't be written.
+void write_ppm(const std::string& path, uint32_t width, uint32_t height, const uint32_t* pixels);
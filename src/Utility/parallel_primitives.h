@@ -0,0 +1,388 @@
+#pragma once
+
+#include "step_arena.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PARALLEL_PRIMITIVES_SSE2
+#endif
+
+//building blocks of the CPU passes that turn per element values, flags or keys into positions and sums
+//
+//	inclusive_scan, exclusive_scan:		prefix sums under any associative operation
+//	transform_reduce:					the sum of a value computed per index
+//	compact, compact_indices:			the elements or indices that pass a test, in their original order
+//	compact_scatter:					the output position of every index that passes a test, for outputs the other two don't cover
+//	expand:								the first output position of every index that writes any number of outputs
+//	histogram:							the number of elements per bin
+//	counting_sort:						the output position of every element within its bins, stable
+//	segmented_reduce:					one sum per run of elements, the runs given by their offsets
+//
+//the scans, the reduction, the compaction and the segmented reduction cut the input into at most MAX_BLOCKS blocks, depending only on its size,
+//and combine the block results in block order. so their results don't depend on the number of threads,
+//even for operations like float addition that are only associative up to rounding.
+//the scans and the compaction read their input twice, once to total every block and once to write the results,
+//and keep the block totals on the stack. the scans of uint32_t sums run four lanes at a time with SSE2,
+//the totals of integer sums are plain loops the compiler vectorizes.
+namespace parallel_primitives {
+	constexpr size_t MAX_BLOCKS = 256;
+	//elements below which a block is not split any further
+	constexpr size_t BLOCK_GRAIN = 16 * 1024;
+	//bins per task when the histograms of the chunks are summed or scanned
+	constexpr size_t BIN_GRAIN = 4096;
+	//elements per chunk of counting_sort at least, as every chunk has a count per bin that is scanned
+	constexpr size_t SORT_GRAIN = 1024;
+
+	namespace detail {
+		inline size_t block_count(size_t count){
+			return std::max<size_t>(1, std::min(MAX_BLOCKS, (count + BLOCK_GRAIN - 1) / BLOCK_GRAIN));
+		}
+
+		inline size_t block_begin(size_t count, size_t blocks, size_t block){
+			return count * block / blocks;
+		}
+
+		//scans count elements starting from carry and returns the total, out may be in
+		template<bool INCLUSIVE, typename T, class Op>
+		T serial_scan(const T* in, T* out, size_t count, T carry, Op op){
+			for(size_t i = 0; i < count; i++) {
+				T next = op(carry, in[i]);
+				out[i] = INCLUSIVE ? next : carry;
+				carry = next;
+			}
+			return carry;
+		}
+
+		template<bool INCLUSIVE, typename T, class Op>
+		struct block_scan {
+			static T run(const T* in, T* out, size_t count, T carry, Op op){
+				return serial_scan<INCLUSIVE>(in, out, count, carry, op);
+			}
+		};
+
+#ifdef PARALLEL_PRIMITIVES_SSE2
+		//two shifted adds scan the four lanes of a register, then the total of the lanes before is added to all of them
+		template<bool INCLUSIVE>
+		struct block_scan<INCLUSIVE, uint32_t, std::plus<uint32_t>> {
+			static uint32_t run(const uint32_t* in, uint32_t* out, size_t count, uint32_t carry, std::plus<uint32_t> op){
+				__m128i running = _mm_set1_epi32(static_cast<int>(carry));
+				size_t i = 0;
+
+				for(; i + 4 <= count; i += 4) {
+					__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+					__m128i scanned = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+					scanned = _mm_add_epi32(scanned, _mm_slli_si128(scanned, 8));
+					scanned = _mm_add_epi32(scanned, running);
+
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), INCLUSIVE ? scanned : _mm_sub_epi32(scanned, x));
+					running = _mm_shuffle_epi32(scanned, _MM_SHUFFLE(3, 3, 3, 3));
+				}
+
+				carry = static_cast<uint32_t>(_mm_cvtsi128_si32(running));
+				return serial_scan<INCLUSIVE>(in + i, out + i, count - i, carry, op);
+			}
+		};
+#endif
+
+		template<bool INCLUSIVE, typename T, class Op>
+		T scan(thread_pool& pool, const T* in, T* out, size_t count, Op op, T identity){
+			size_t blocks = block_count(count);
+
+			if(blocks == 1) {
+				return block_scan<INCLUSIVE, T, Op>::run(in, out, count, identity, op);
+			}
+
+			T carries[MAX_BLOCKS];
+
+			pool.run(blocks, [&](size_t block, unsigned) {
+				T sum = identity;
+				for(size_t i = block_begin(count, blocks, block); i < block_begin(count, blocks, block + 1); i++) {
+					sum = op(sum, in[i]);
+				}
+				carries[block] = sum;
+			});
+
+			T total = identity;
+			for(size_t block = 0; block < blocks; block++) {
+				T sum = carries[block];
+				carries[block] = total;
+				total = op(total, sum);
+			}
+
+			pool.run(blocks, [&](size_t block, unsigned) {
+				size_t begin = block_begin(count, blocks, block);
+				size_t end = block_begin(count, blocks, block + 1);
+
+				block_scan<INCLUSIVE, T, Op>::run(in + begin, out + begin, end - begin, carries[block], op);
+			});
+
+			return total;
+		}
+
+		//prepare(total) is called once the number of outputs is known, before write(i, position) is called for every i with outputs
+		template<class CountOf, class Prepare, class Write>
+		size_t expand(thread_pool& pool, size_t count, CountOf& count_of, Prepare&& prepare, Write&& write){
+			size_t blocks = block_count(count);
+			size_t offsets[MAX_BLOCKS];
+
+			pool.run(blocks, [&](size_t block, unsigned) {
+				size_t outputs = 0;
+				for(size_t i = block_begin(count, blocks, block); i < block_begin(count, blocks, block + 1); i++) {
+					outputs += count_of(i);
+				}
+				offsets[block] = outputs;
+			});
+
+			size_t total = 0;
+			for(size_t block = 0; block < blocks; block++) {
+				size_t outputs = offsets[block];
+				offsets[block] = total;
+				total += outputs;
+			}
+
+			prepare(total);
+
+			pool.run(blocks, [&](size_t block, unsigned) {
+				size_t position = offsets[block];
+				for(size_t i = block_begin(count, blocks, block); i < block_begin(count, blocks, block + 1); i++) {
+					size_t outputs = count_of(i);
+					if(outputs > 0) {
+						write(i, position);
+						position += outputs;
+					}
+				}
+			});
+
+			return total;
+		}
+
+		template<class Keep, class Prepare, class Write>
+		size_t compact(thread_pool& pool, size_t count, Keep& keep, Prepare&& prepare, Write&& write){
+			auto count_of = [&](size_t i) -> size_t { return keep(i) ? 1 : 0; };
+
+			return expand(pool, count, count_of, prepare, write);
+		}
+
+		//chunk c counts its elements per bin into partials[c * bin_count + bin], for_each_bin(i, add) calls add(bin) for every bin of i
+		template<class ForEachBin>
+		void count_chunks(thread_pool& pool, size_t count, size_t chunks, ForEachBin& for_each_bin, uint32_t* partials, size_t bin_count){
+			pool.run(chunks, [&](size_t chunk, unsigned) {
+				uint32_t* partial = partials + chunk * bin_count;
+				std::fill(partial, partial + bin_count, 0);
+
+				for(size_t i = block_begin(count, chunks, chunk); i < block_begin(count, chunks, chunk + 1); i++) {
+					for_each_bin(i, [partial](size_t bin) { partial[bin]++; });
+				}
+			});
+		}
+	}
+
+	//out[i] = identity op in[0] op ... op in[i], out may be in
+	template<typename T, class Op = std::plus<T>>
+	T inclusive_scan(thread_pool& pool, const T* in, T* out, size_t count, Op op = Op(), T identity = T()){
+		return detail::scan<true>(pool, in, out, count, op, identity);
+	}
+
+	//out[i] = identity op in[0] op ... op in[i - 1], out may be in, returns the total of all elements
+	template<typename T, class Op = std::plus<T>>
+	T exclusive_scan(thread_pool& pool, const T* in, T* out, size_t count, Op op = Op(), T identity = T()){
+		return detail::scan<false>(pool, in, out, count, op, identity);
+	}
+
+	//identity op fn(0) op ... op fn(count - 1), fn is called once per index
+	template<typename T, class Fn, class Op = std::plus<T>>
+	T transform_reduce(thread_pool& pool, size_t count, Fn&& fn, Op op = Op(), T identity = T()){
+		size_t blocks = detail::block_count(count);
+		T sums[MAX_BLOCKS];
+
+		pool.run(blocks, [&](size_t block, unsigned) {
+			T sum = identity;
+			for(size_t i = detail::block_begin(count, blocks, block); i < detail::block_begin(count, blocks, block + 1); i++) {
+				sum = op(sum, fn(i));
+			}
+			sums[block] = sum;
+		});
+
+		T total = identity;
+		for(size_t block = 0; block < blocks; block++) {
+			total = op(total, sums[block]);
+		}
+		return total;
+	}
+
+	//writes every in[i] with keep(in[i]) to out in their order and returns how many there were, out needs room for all of them
+	//keep is called twice per element and has to give the same answer both times
+	template<typename T, class Keep>
+	size_t compact(thread_pool& pool, const T* in, size_t count, Keep&& keep, T* out){
+		auto keep_index = [&](size_t i) { return keep(in[i]); };
+
+		return detail::compact(pool, count, keep_index, [](size_t) {}, [&](size_t i, size_t position) { out[position] = in[i]; });
+	}
+
+	//out becomes the indices i in [0, count) with keep(i), in ascending order
+	//keep is called twice per index and has to give the same answer both times
+	template<typename Index, class Keep>
+	void compact_indices(thread_pool& pool, size_t count, Keep&& keep, std::vector<Index>& out){
+		detail::compact(pool, count, keep, [&](size_t total) { out.resize(total); }, [&](size_t i, size_t position) { out[position] = static_cast<Index>(i); });
+	}
+
+	//calls write(i, position) for every i in [0, count) with keep(i), where position is the number of such indices before i, and returns their number
+	//prepare(total) is called before the first write. the writes of a block run in index order on one thread
+	//keep is called twice per index and has to give the same answer both times
+	template<class Keep, class Prepare, class Write>
+	size_t compact_scatter(thread_pool& pool, size_t count, Keep&& keep, Prepare&& prepare, Write&& write){
+		return detail::compact(pool, count, keep, prepare, write);
+	}
+
+	//calls write(i, position) for every i in [0, count) with count_of(i) > 0, where i owns the outputs [position, position + count_of(i))
+	//and position is the sum of count_of over the indices before i. returns the number of outputs
+	//prepare(total) is called before the first write. the writes of a block run in index order on one thread
+	//count_of is called twice per index and has to give the same answer both times
+	template<class CountOf, class Prepare, class Write>
+	size_t expand(thread_pool& pool, size_t count, CountOf&& count_of, Prepare&& prepare, Write&& write){
+		return detail::expand(pool, count, count_of, prepare, write);
+	}
+
+	//bins[b] becomes the number of i in [0, count) with bin_of(i) == b, bin_of has to return values below bin_count
+	//every thread counts into a histogram of its own from scratch, so no counter is shared, and the histograms are summed bin by bin
+	template<class BinOf>
+	void histogram(thread_pool& pool, size_t count, BinOf&& bin_of, uint32_t* bins, size_t bin_count, step_arena& scratch){
+		size_t chunks = std::max<size_t>(1, std::min<size_t>(pool.size(), (count + BLOCK_GRAIN - 1) / BLOCK_GRAIN));
+
+		if(chunks == 1) {
+			std::fill(bins, bins + bin_count, 0);
+			for(size_t i = 0; i < count; i++) {
+				bins[bin_of(i)]++;
+			}
+			return;
+		}
+
+		step_arena::scope scope(scratch);
+		uint32_t* partials = scratch.allocate<uint32_t>(chunks * bin_count);
+
+		auto for_each_bin = [&](size_t i, auto&& add) { add(bin_of(i)); };
+		detail::count_chunks(pool, count, chunks, for_each_bin, partials, bin_count);
+
+		pool.parallel_for(bin_count, BIN_GRAIN, [&](size_t begin, size_t end, unsigned) {
+			for(size_t b = begin; b < end; b++) {
+				uint32_t sum = 0;
+				for(size_t chunk = 0; chunk < chunks; chunk++) {
+					sum += partials[chunk * bin_count + b];
+				}
+				bins[b] = sum;
+			}
+		});
+	}
+
+	//sorts the indices [0, count) into bin_count bins and keeps every chunk's offsets, which histogram sums away
+	//
+	//	count:		chunk c counts its elements per bin, as histogram does
+	//	offsets:	an exclusive scan in (bin, chunk) order turns every count into the position the chunk writes its next element of that bin to.
+	//				it runs on ranges of bins: every range sums its counts, the sums are scanned in range order,
+	//				and every range then scans its own bins starting from its offset
+	//	scatter:	every chunk calls scatter(i, position) for its elements in index order
+	//
+	//so the elements of a bin keep their index order, independent of the number of threads.
+	//for_each_bin(i, add) calls add(bin) for every bin below bin_count that i goes to, none, one or several, the same ones in the same order both times.
+	//on_bin(bin, start, size, worker) is called once for every bin, whose elements get [start, start + size).
+	//prepare(total) is called with the number of (element, bin) pairs before the first scatter, which has to be below 2^32. returns that number
+	template<class ForEachBin, class OnBin, class Prepare, class Scatter>
+	size_t counting_sort(thread_pool& pool, size_t count, size_t bin_count, ForEachBin&& for_each_bin, OnBin&& on_bin, Prepare&& prepare, Scatter&& scatter, step_arena& scratch){
+		size_t chunks = std::max<size_t>(1, std::min<size_t>(pool.size(), count / SORT_GRAIN));
+		size_t ranges = std::max<size_t>(1, std::min<size_t>(pool.size(), bin_count / BIN_GRAIN));
+
+		step_arena::scope scope(scratch);
+		uint32_t* counts = scratch.allocate<uint32_t>(chunks * bin_count);
+		uint32_t* range_offsets = scratch.allocate<uint32_t>(ranges);
+
+		detail::count_chunks(pool, count, chunks, for_each_bin, counts, bin_count);
+
+		pool.run(ranges, [&](size_t range, unsigned) {
+			uint32_t sum = 0;
+			for(size_t bin = detail::block_begin(bin_count, ranges, range); bin < detail::block_begin(bin_count, ranges, range + 1); bin++) {
+				for(size_t chunk = 0; chunk < chunks; chunk++) {
+					sum += counts[chunk * bin_count + bin];
+				}
+			}
+			range_offsets[range] = sum;
+		});
+
+		uint32_t total = 0;
+		for(size_t range = 0; range < ranges; range++) {
+			uint32_t sum = range_offsets[range];
+			range_offsets[range] = total;
+			total += sum;
+		}
+
+		pool.run(ranges, [&](size_t range, unsigned worker) {
+			uint32_t offset = range_offsets[range];
+
+			for(size_t bin = detail::block_begin(bin_count, ranges, range); bin < detail::block_begin(bin_count, ranges, range + 1); bin++) {
+				uint32_t start = offset;
+
+				for(size_t chunk = 0; chunk < chunks; chunk++) {
+					uint32_t& chunk_count = counts[chunk * bin_count + bin];
+					uint32_t n = chunk_count;
+
+					chunk_count = offset;
+					offset += n;
+				}
+
+				on_bin(bin, start, offset - start, worker);
+			}
+		});
+
+		prepare(total);
+
+		pool.run(chunks, [&](size_t chunk, unsigned) {
+			uint32_t* positions = counts + chunk * bin_count;
+
+			for(size_t i = detail::block_begin(count, chunks, chunk); i < detail::block_begin(count, chunks, chunk + 1); i++) {
+				for_each_bin(i, [&](size_t bin) { scatter(i, positions[bin]++); });
+			}
+		});
+
+		return total;
+	}
+
+	//out[s] = identity op values[offsets[s]] op ... op values[offsets[s + 1] - 1] for every s in [0, segments), offsets has segments + 1 entries
+	//the blocks cut the values, and every block reduces the segments that start in it, each in index order
+	template<typename T, typename Offset, class Op = std::plus<T>>
+	void segmented_reduce(thread_pool& pool, const T* values, const Offset* offsets, size_t segments, T* out, Op op = Op(), T identity = T()){
+		if(segments == 0) {
+			return;
+		}
+
+		size_t first_value = offsets[0];
+		size_t count = offsets[segments] - first_value;
+		size_t blocks = detail::block_count(count);
+
+		//the first segment starting at or after the given value
+		auto segment_at = [&](size_t block) {
+			if(block == blocks) {
+				return segments;
+			}
+			Offset value = static_cast<Offset>(first_value + detail::block_begin(count, blocks, block));
+			return static_cast<size_t>(std::lower_bound(offsets, offsets + segments, value) - offsets);
+		};
+
+		pool.run(blocks, [&](size_t block, unsigned) {
+			size_t end = segment_at(block + 1);
+
+			for(size_t s = block == 0 ? 0 : segment_at(block); s < end; s++) {
+				T sum = identity;
+				for(size_t i = offsets[s]; i < offsets[s + 1]; i++) {
+					sum = op(sum, values[i]);
+				}
+				out[s] = sum;
+			}
+		});
+	}
+}
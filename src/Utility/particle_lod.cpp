@@ -0,0 +1,188 @@
+#include "particle_lod.h"
+#include "grid_cell.h"
+#include "parallel_primitives.h"
+#include "tracer.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+	constexpr size_t PARTICLE_GRAIN = 4096;
+	constexpr size_t CELL_GRAIN = 1024;
+	//merged cells hold many particles each
+	constexpr size_t MERGE_GRAIN = 64;
+
+	float3 position_of(const float3& p){
+		return p;
+	}
+
+	float3 position_of(const float4& p){
+		return make_float3(p.x, p.y, p.z);
+	}
+
+	float density_of(const float3&){
+		return 1.f;
+	}
+
+	float density_of(const float4& p){
+		return p.w;
+	}
+
+	//how much clip x or y changes per unit the position moves, at most
+	float clip_scale(const float4x4& mvp, int axis){
+		return length(make_float3(mvp.m[0][axis], mvp.m[1][axis], mvp.m[2][axis]));
+	}
+}
+
+particle_lod::particle_lod(const uint32_t grid_dim[3], const float cell_size[3], thread_pool& pool) :
+	grid_dim{grid_dim[0], grid_dim[1], grid_dim[2]},
+	cell_size{cell_size[0], cell_size[1], cell_size[2]},
+	cells(grid_dim[0] * grid_dim[1] * grid_dim[2]),
+	pool(pool),
+	cell_offsets(cells + 1, 0),
+	merged(cells, 0),
+	last_merged_cells(0),
+	last_merged_particles(0)
+{}
+
+void particle_lod::build(const float4* points, size_t count, const lod_settings& settings){
+	build_points(points, count, settings);
+}
+
+void particle_lod::build(const float3* positions, size_t count, const lod_settings& settings){
+	build_points(positions, count, settings);
+}
+
+const std::vector<float4>& particle_lod::points() const{
+	return output_points;
+}
+
+const std::vector<float>& particle_lod::radii() const{
+	return output_radii;
+}
+
+uint32_t particle_lod::cell_count() const{
+	return cells;
+}
+
+uint32_t particle_lod::merged_cells() const{
+	return last_merged_cells;
+}
+
+size_t particle_lod::merged_particles() const{
+	return last_merged_particles;
+}
+
+template<typename point>
+void particle_lod::build_points(const point* points, size_t count, const lod_settings& settings){
+	TRACE_SCOPE("particle_lod");
+
+	assign_cells(points, count);
+	choose_cells(settings);
+	pass_through(points, count, settings);
+	merge_cells(points, settings);
+}
+
+//the cell of every particle as cpu_engine::cell_of computes it, then the particles sorted by cell, in the order of their ids within a cell
+template<typename point>
+void particle_lod::assign_cells(const point* points, size_t count){
+	TRACE_SCOPE("assign_cells");
+
+	particle_cells.resize(count);
+	sorted.resize(count);
+
+	pool.parallel_for(count, PARTICLE_GRAIN, [&](size_t begin, size_t end, unsigned) {
+		for(size_t i = begin; i < end; i++) {
+			particle_cells[i] = clamped_cell(position_of(points[i]), grid_dim, cell_size);
+		}
+	});
+
+	parallel_primitives::counting_sort(pool, count, cells,
+		[this](size_t i, auto&& add) { add(particle_cells[i]); },
+		[this](size_t c, uint32_t start, uint32_t, unsigned) { cell_offsets[c] = start; },
+		[this](size_t total) { cell_offsets[cells] = static_cast<uint32_t>(total); },
+		[this](size_t i, uint32_t position) { sorted[position] = static_cast<uint32_t>(i); },
+		scratch);
+}
+
+void particle_lod::choose_cells(const lod_settings& settings){
+	TRACE_SCOPE("choose_cells");
+
+	const float longest_edge = std::max(cell_size[0], std::max(cell_size[1], cell_size[2]));
+	//the pixels the edge covers at w = 1
+	const float edge_pixels = longest_edge * 0.5f * std::max(clip_scale(settings.mvp, 0) * settings.width, clip_scale(settings.mvp, 1) * settings.height);
+
+	pool.parallel_for(cells, CELL_GRAIN, [&](size_t begin, size_t end, unsigned) {
+		for(size_t c = begin; c < end; c++) {
+			float3 center = make_float3(
+				(c % grid_dim[0] + 0.5f) * cell_size[0],
+				(c / grid_dim[0] % grid_dim[1] + 0.5f) * cell_size[1],
+				(c / (grid_dim[0] * grid_dim[1]) + 0.5f) * cell_size[2]);
+
+			float4 clip = transform_point(center, settings.mvp);
+
+			//a single particle gains nothing, and cells around the eye are left to the clipping of the renderer
+			merged[c] = cell_offsets[c + 1] - cell_offsets[c] > 1 && clip.w > 0.f && edge_pixels <= settings.max_cell_pixels * clip.w;
+		}
+	});
+}
+
+//the particles of the cells that are not merged, in the order of their ids
+template<typename point>
+void particle_lod::pass_through(const point* points, size_t count, const lod_settings& settings){
+	TRACE_SCOPE("pass_through");
+
+	parallel_primitives::compact_scatter(pool, count,
+		[this](size_t i) { return !merged[particle_cells[i]]; },
+		[&](size_t total) {
+			output_points.resize(total);
+			output_radii.assign(total, settings.radius);
+		},
+		[&](size_t i, size_t position) {
+			float3 p = position_of(points[i]);
+			output_points[position] = make_float4(p.x, p.y, p.z, density_of(points[i]));
+		});
+}
+
+//one splat per merged cell, appended in the order of the cells
+template<typename point>
+void particle_lod::merge_cells(const point* points, const lod_settings& settings){
+	TRACE_SCOPE("merge_cells");
+
+	parallel_primitives::compact_indices(pool, cells, [this](size_t c) { return merged[c] != 0; }, merged_list);
+	last_merged_cells = static_cast<uint32_t>(merged_list.size());
+	last_merged_particles = parallel_primitives::transform_reduce<size_t>(pool, merged_list.size(),
+		[this](size_t k) -> size_t { return cell_offsets[merged_list[k] + 1] - cell_offsets[merged_list[k]]; });
+
+	const size_t first = output_points.size();
+	output_points.resize(first + merged_list.size());
+	output_radii.resize(first + merged_list.size());
+
+	const float scale = std::max(clip_scale(settings.mvp, 0), clip_scale(settings.mvp, 1));
+
+	pool.parallel_for(merged_list.size(), MERGE_GRAIN, [&](size_t begin, size_t end, unsigned) {
+		for(size_t k = begin; k < end; k++) {
+			const uint32_t* first_particle = sorted.data() + cell_offsets[merged_list[k]];
+			const uint32_t* end_particle = sorted.data() + cell_offsets[merged_list[k] + 1];
+			const float n = static_cast<float>(end_particle - first_particle);
+
+			float3 sum = make_float3(0.f, 0.f, 0.f);
+			float density = 0.f;
+			for(const uint32_t* i = first_particle; i != end_particle; i++) {
+				sum += position_of(points[*i]);
+				density += density_of(points[*i]);
+			}
+
+			float3 mean = sum / n;
+
+			float farthest = 0.f;
+			for(const uint32_t* i = first_particle; i != end_particle; i++) {
+				float3 d = position_of(points[*i]) - mean;
+				farthest = std::max(farthest, dot(d, d));
+			}
+
+			output_points[first + k] = make_float4(mean.x, mean.y, mean.z, density / n);
+			output_radii[first + k] = settings.radius + std::sqrt(farthest) * scale;
+		}
+	});
+}
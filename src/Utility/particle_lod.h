@@ -0,0 +1,84 @@
+#pragma once
+
+#include "float3.h"
+#include "float4x4.h"
+#include "step_arena.h"
+#include "thread_pool.h"
+
+#include <cstdint>
+#include <vector>
+
+//how the particles are seen, and how small a cell has to get before its particles are merged
+struct lod_settings {
+	float4x4 mvp;
+	uint32_t width;
+	uint32_t height;
+	//the clip space radius of a single particle, the one the renderer gives every quad
+	float radius;
+	//a cell whose longest edge projects to at most this many pixels becomes a single splat
+	float max_cell_pixels;
+};
+
+//level of detail for particles far from the camera: the particles of a grid cell that covers only a few pixels
+//are merged into one larger splat, instead of expanding every one of them into a quad that hits the same pixels.
+//
+//	assign:		the particles are sorted into the cells of the grid by a stable counting sort
+//	choose:		every cell is projected through its center, the ones below max_cell_pixels are merged
+//	merge:		a merged cell becomes one splat at the mean position of its particles, with their mean density (w),
+//				and a radius that reaches the particle farthest from the mean plus the radius of a single particle
+//
+//the particles of the other cells are passed on unchanged in the order of their ids, followed by the splats in the order of the cells,
+//so the output doesn't depend on the number of threads.
+//both CPU renderers draw the result with a radius per point, sprite_rasterizer for Simulation2 and splat_renderer for Simulation1.
+class particle_lod {
+public:
+	//the grid starts at the origin, particles outside of it count to the nearest cell
+	particle_lod(const uint32_t grid_dim[3], const float cell_size[3], thread_pool& pool);
+
+	//w is the density that is averaged, for Simulation1 the particle count of a lattice point
+	void build(const float4* points, size_t count, const lod_settings& settings);
+	//the same for positions only, the splats get a density of 1
+	void build(const float3* positions, size_t count, const lod_settings& settings);
+
+	//particles and splats of the last build, with their clip space radii
+	const std::vector<float4>& points() const;
+	const std::vector<float>& radii() const;
+
+	uint32_t cell_count() const;
+	uint32_t merged_cells() const;
+	//input particles that went into the splats
+	size_t merged_particles() const;
+
+private:
+	uint32_t grid_dim[3];
+	float cell_size[3];
+	uint32_t cells;
+
+	thread_pool& pool;
+
+	std::vector<uint32_t> particle_cells;
+	//the particles sorted by cell, cell c owns [cell_offsets[c], cell_offsets[c + 1])
+	std::vector<uint32_t> cell_offsets;
+	std::vector<uint32_t> sorted;
+	//the per chunk counts of the sort
+	step_arena scratch;
+
+	std::vector<uint8_t> merged;
+	std::vector<uint32_t> merged_list;
+
+	std::vector<float4> output_points;
+	std::vector<float> output_radii;
+
+	uint32_t last_merged_cells;
+	size_t last_merged_particles;
+
+	template<typename point>
+	void build_points(const point* points, size_t count, const lod_settings& settings);
+	template<typename point>
+	void assign_cells(const point* points, size_t count);
+	void choose_cells(const lod_settings& settings);
+	template<typename point>
+	void pass_through(const point* points, size_t count, const lod_settings& settings);
+	template<typename point>
+	void merge_cells(const point* points, const lod_settings& settings);
+};
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "float3.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+//conversions the CPU renderers share between the quads they draw and the pixels of their targets
+
+//float to DXGI_FORMAT_R8G8B8A8_UNORM, NaNs become 0
+inline uint32_t to_unorm(float c){
+	return c > 0.f ? static_cast<uint32_t>(std::min(c, 1.f) * 255.f + 0.5f) : 0;
+}
+
+inline uint32_t pack_color(float3 c){
+	return to_unorm(c.x) | to_unorm(c.y) << 8 | to_unorm(c.z) << 16 | 0xFF000000;
+}
+
+//the first pixel at or after the edge of a quad, for the bounds of a pixel_rect
+inline int32_t pixel_bound(float edge, uint32_t size){
+	//a pixel is covered if its center lies on the quad, clamped before the conversion
+	return static_cast<int32_t>(std::ceil(std::min(std::max(edge - 0.5f, 0.f), static_cast<float>(size))));
+}
@@ -0,0 +1,178 @@
+#pragma once
+
+#include "aligned_array.h"
+
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+
+//hands the latest state of one producer to any number of consumers, without locks and without ever blocking the producer
+//
+//the ring holds consumers + 2 slots. the producer fills a slot that is neither the latest one nor held by a consumer,
+//then publishes it by storing its index as the latest. every consumer holds at most one slot, so such a slot always exists.
+//a consumer pins the latest slot with a reference count and checks that it is still the latest afterwards,
+//if the producer published in between it lets go and tries again.
+//with a single consumer this is a triple buffer.
+//
+//consumers always see complete snapshots, but only the newest one: snapshots published while a consumer is busy are skipped.
+template<typename T>
+class snapshot_ring {
+public:
+	//a pinned snapshot, the slot is released when the view is destroyed or released
+	class view {
+	public:
+		view() :
+			ring(nullptr),
+			idx(0)
+		{}
+
+		view(view&& other) :
+			ring(other.ring),
+			idx(other.idx)
+		{
+			other.ring = nullptr;
+		}
+
+		view& operator=(view&& other){
+			if(this != &other) {
+				release();
+				ring = other.ring;
+				idx = other.idx;
+				other.ring = nullptr;
+			}
+			return *this;
+		}
+
+		view(const view&) = delete;
+		view& operator=(const view&) = delete;
+
+		~view(){
+			release();
+		}
+
+		bool empty() const{
+			return ring == nullptr;
+		}
+
+		//which publish made the snapshot, counted from 1
+		uint64_t sequence() const{
+			return ring->slots[idx].sequence;
+		}
+
+		const T& operator*() const{
+			return ring->slots[idx].value;
+		}
+
+		const T* operator->() const{
+			return &ring->slots[idx].value;
+		}
+
+		void release(){
+			if(ring) {
+				ring->slots[idx].readers.fetch_sub(1, std::memory_order_release);
+				ring = nullptr;
+			}
+		}
+
+	private:
+		friend class snapshot_ring;
+
+		const snapshot_ring* ring;
+		uint32_t idx;
+
+		view(const snapshot_ring* ring, uint32_t idx) :
+			ring(ring),
+			idx(idx)
+		{}
+	};
+
+	//consumers is the number of threads that may hold a view at the same time
+	explicit snapshot_ring(uint32_t consumers, const T& initial = T()) :
+		slots(consumers + 2),
+		latest(NOTHING_PUBLISHED),
+		writing(NOTHING_PUBLISHED),
+		publishes(0)
+	{
+		for(slot& s : slots) {
+			s.value = initial;
+			s.readers.store(0, std::memory_order_relaxed);
+			s.sequence = 0;
+		}
+	}
+
+	snapshot_ring(const snapshot_ring&) = delete;
+	snapshot_ring& operator=(const snapshot_ring&) = delete;
+
+	//producer: the slot to fill, the same one until the next publish.
+	//it holds an older snapshot, so state that is only updated in parts can be kept.
+	T& write_slot(){
+		if(writing == NOTHING_PUBLISHED) {
+			writing = find_free_slot();
+		}
+		return slots[writing].value;
+	}
+
+	//producer: makes the filled slot the latest snapshot
+	void publish(){
+		write_slot();
+
+		slots[writing].sequence = ++publishes;
+		latest.store(writing, std::memory_order_seq_cst);
+		writing = NOTHING_PUBLISHED;
+	}
+
+	//consumers: pins the latest snapshot, the view is empty before the first publish.
+	//a consumer has to release its last view before acquiring the next one.
+	view acquire() const{
+		for(;;) {
+			uint32_t idx = latest.load(std::memory_order_seq_cst);
+			if(idx == NOTHING_PUBLISHED) {
+				return view();
+			}
+
+			slots[idx].readers.fetch_add(1, std::memory_order_seq_cst);
+
+			//the producer skips slots with readers, but it may have picked this one before it was pinned
+			if(latest.load(std::memory_order_seq_cst) == idx) {
+				return view(this, idx);
+			}
+			slots[idx].readers.fetch_sub(1, std::memory_order_release);
+		}
+	}
+
+	//producer: number of snapshots published so far
+	uint64_t published() const{
+		return publishes;
+	}
+
+private:
+	static constexpr uint32_t NOTHING_PUBLISHED = 0xFFFFFFFF;
+
+	//the reference count shares no cache line with the ones of other slots, as long as the slots are in an aligned_array
+	struct alignas(64) slot {
+		mutable std::atomic<uint32_t> readers;
+		uint64_t sequence;
+		T value;
+	};
+
+	aligned_array<slot> slots;
+	std::atomic<uint32_t> latest;
+
+	//only touched by the producer
+	uint32_t writing;
+	uint64_t publishes;
+
+	uint32_t find_free_slot() const{
+		uint32_t current = latest.load(std::memory_order_relaxed);
+
+		for(uint32_t i = 0; i < slots.size(); i++) {
+			if(i != current && slots[i].readers.load(std::memory_order_seq_cst) == 0) {
+				return i;
+			}
+		}
+		throw std::runtime_error("snapshot_ring: every slot is held, more consumers than the ring was made for");
+	}
+};
+
+template<typename T>
+constexpr uint32_t snapshot_ring<T>::NOTHING_PUBLISHED;
@@ -0,0 +1,121 @@
+#include "step_arena.h"
+
+#include <algorithm>
+#include <new>
+
+constexpr size_t step_arena::ALIGNMENT;
+constexpr size_t step_arena::MIN_BLOCK_SIZE;
+
+namespace {
+	size_t round_up(size_t bytes, size_t alignment){
+		return (bytes + alignment - 1) / alignment * alignment;
+	}
+}
+
+step_arena::scope::scope(step_arena& arena) :
+	arena(arena),
+	start(arena.mark())
+{}
+
+step_arena::scope::~scope(){
+	arena.rewind(start);
+}
+
+step_arena::step_arena(size_t initial_capacity) :
+	current(0),
+	offset(0),
+	used_bytes(0),
+	high_water_bytes(0),
+	allocation_count(0)
+{
+	if(initial_capacity > 0) {
+		add_block(initial_capacity);
+	}
+}
+
+step_arena::~step_arena(){
+	release_blocks();
+}
+
+void step_arena::reset(){
+	if(blocks.size() > 1) {
+		release_blocks();
+		add_block(high_water_bytes);
+	}
+
+	current = 0;
+	offset = 0;
+	used_bytes = 0;
+}
+
+step_arena::marker step_arena::mark() const{
+	return {current, offset, used_bytes};
+}
+
+void step_arena::rewind(const marker& m){
+	current = m.block;
+	offset = m.offset;
+	used_bytes = m.used;
+}
+
+size_t step_arena::used() const{
+	return used_bytes;
+}
+
+size_t step_arena::capacity() const{
+	size_t total = 0;
+	for(const block& b : blocks) {
+		total += b.size;
+	}
+	return total;
+}
+
+size_t step_arena::high_water() const{
+	return high_water_bytes;
+}
+
+uint64_t step_arena::block_allocations() const{
+	return allocation_count;
+}
+
+//the tail of a block that is too small for an allocation stays unused until the next reset
+void* step_arena::allocate_bytes(size_t bytes){
+	bytes = round_up(std::max<size_t>(bytes, 1), ALIGNMENT);
+
+	while(current < blocks.size() && offset + bytes > blocks[current].size) {
+		current++;
+		offset = 0;
+	}
+	if(current == blocks.size()) {
+		add_block(bytes);
+	}
+
+	void* p = blocks[current].begin + offset;
+
+	offset += bytes;
+	used_bytes += bytes;
+	high_water_bytes = std::max(high_water_bytes, used_bytes);
+
+	return p;
+}
+
+//blocks at least double the capacity, so a growing step chains only a few of them
+void step_arena::add_block(size_t min_size){
+	size_t size = round_up(std::max(std::max(min_size, capacity()), MIN_BLOCK_SIZE), ALIGNMENT);
+
+	//C++14 has no aligned operator new, the block is over allocated and aligned by hand
+	void* memory = ::operator new(size + ALIGNMENT - 1);
+	uintptr_t aligned = round_up(reinterpret_cast<uintptr_t>(memory), ALIGNMENT);
+
+	blocks.push_back({memory, reinterpret_cast<char*>(aligned), size});
+	current = blocks.size() - 1;
+	offset = 0;
+	allocation_count++;
+}
+
+void step_arena::release_blocks(){
+	for(const block& b : blocks) {
+		::operator delete(b.memory);
+	}
+	blocks.clear();
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+//bump allocator for the scratch memory a simulation step needs only until it ends
+//
+//allocate hands out the next ALIGNMENT aligned bytes of the current block, which is wide enough for AVX-512 loads
+//and keeps two allocations off the same cache line. nothing is freed on its own, reset releases everything at once.
+//when a block is full the arena chains another one, and the next reset replaces the chain with a single block of the high water mark,
+//so once a step has run with its largest sizes the arena never goes to the heap again.
+//
+//the memory is uninitialized and no destructors run, so only trivially destructible types can be allocated.
+//an arena is not thread safe, a pass allocates what its workers need before it hands the work to the pool.
+class step_arena {
+public:
+	static constexpr size_t ALIGNMENT = 64;
+	static constexpr size_t MIN_BLOCK_SIZE = 4096;
+
+	//the position of the arena at a point in time, rewind hands back everything allocated after it
+	struct marker {
+		size_t block;
+		size_t offset;
+		size_t used;
+	};
+
+	//rewinds the arena to where it was when the scope was opened
+	class scope {
+	public:
+		explicit scope(step_arena& arena);
+		~scope();
+
+		scope(const scope&) = delete;
+		scope& operator=(const scope&) = delete;
+
+	private:
+		step_arena& arena;
+		marker start;
+	};
+
+	explicit step_arena(size_t initial_capacity = 0);
+	~step_arena();
+
+	step_arena(const step_arena&) = delete;
+	step_arena& operator=(const step_arena&) = delete;
+
+	template<typename T>
+	T* allocate(size_t count){
+		static_assert(std::is_trivially_destructible<T>::value, "the arena doesn't run destructors");
+		static_assert(alignof(T) <= ALIGNMENT, "the arena doesn't align beyond ALIGNMENT");
+
+		return static_cast<T*>(allocate_bytes(count * sizeof(T)));
+	}
+
+	//hands back all allocations, merging the blocks if more than one was needed
+	void reset();
+
+	marker mark() const;
+	void rewind(const marker& m);
+
+	//bytes allocated since the last reset, rounded up to ALIGNMENT
+	size_t used() const;
+	//bytes of all blocks
+	size_t capacity() const;
+	//the most bytes that were in use at once, since construction
+	size_t high_water() const;
+	//blocks taken from the heap, since construction
+	uint64_t block_allocations() const;
+
+private:
+	struct block {
+		void* memory;
+		char* begin;
+		size_t size;
+	};
+
+	std::vector<block> blocks;
+	size_t current;
+	size_t offset;
+
+	size_t used_bytes;
+	size_t high_water_bytes;
+	uint64_t allocation_count;
+
+	void* allocate_bytes(size_t bytes);
+	void add_block(size_t min_size);
+	void release_blocks();
+};
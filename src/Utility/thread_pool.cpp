@@ -0,0 +1,110 @@
+#include "thread_pool.h"
+#include "tracer.h"
+
+#include <string>
+
+thread_pool::thread_pool(unsigned num_threads) :
+	job_function(nullptr),
+	job_context(nullptr),
+	job_tasks(0),
+	next_task(0),
+	generation(0),
+	pending_workers(0),
+	stop(false)
+{
+	if(num_threads == 0) {
+		num_threads = std::thread::hardware_concurrency();
+	}
+
+	//the calling thread is worker 0
+	for(unsigned i = 1; i < num_threads; i++) {
+		workers.emplace_back(&thread_pool::worker_loop, this, i);
+	}
+}
+
+thread_pool::~thread_pool(){
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+	}
+	wake.notify_all();
+
+	for(std::thread& worker : workers) {
+		worker.join();
+	}
+}
+
+unsigned thread_pool::size() const{
+	return static_cast<unsigned>(workers.size()) + 1;
+}
+
+void thread_pool::dispatch(size_t num_tasks, task_function fn, void* ctx){
+	if(num_tasks == 0) {
+		return;
+	}
+
+	//not worth waking anybody up
+	if(workers.empty() || num_tasks == 1) {
+		for(size_t i = 0; i < num_tasks; i++) {
+			fn(ctx, i, 0);
+		}
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		job_function = fn;
+		job_context = ctx;
+		job_tasks = num_tasks;
+		next_task.store(0, std::memory_order_relaxed);
+		pending_workers = static_cast<unsigned>(workers.size());
+		generation++;
+	}
+	wake.notify_all();
+
+	work(0);
+
+	TRACE_SCOPE("wait for workers");
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [this]() { return pending_workers == 0; });
+}
+
+void thread_pool::worker_loop(unsigned worker){
+	unsigned long long seen_generation = 0;
+
+	tracer::instance().set_thread_name("worker " + std::to_string(worker));
+
+	while(true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&]() { return stop || generation != seen_generation; });
+
+			if(stop) {
+				return;
+			}
+			seen_generation = generation;
+		}
+
+		{
+			TRACE_SCOPE("tasks");
+			work(worker);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			if(--pending_workers == 0) {
+				done.notify_one();
+			}
+		}
+	}
+}
+
+void thread_pool::work(unsigned worker){
+	size_t task;
+
+	while((task = next_task.fetch_add(1, std::memory_order_relaxed)) < job_tasks) {
+		job_function(job_context, task, worker);
+	}
+}
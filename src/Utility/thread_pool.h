@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+//a fixed set of worker threads for the CPU engines
+//
+//work is submitted as a number of independent tasks, which the workers (and the calling thread) claim one after another.
+//run() returns once every task has finished. tasks must not throw and must not call run() on the same pool again.
+class thread_pool {
+public:
+	//num_threads includes the calling thread, 0 picks the number of hardware threads
+	explicit thread_pool(unsigned num_threads = 0);
+	~thread_pool();
+
+	thread_pool(const thread_pool&) = delete;
+	thread_pool& operator=(const thread_pool&) = delete;
+
+	//number of threads taking part in run(), worker indices passed to the tasks are in [0, size())
+	unsigned size() const;
+
+	//calls fn(task_idx, worker_idx) for every task_idx in [0, num_tasks)
+	template<class F>
+	void run(size_t num_tasks, F&& fn){
+		typedef typename std::remove_reference<F>::type function_type;
+		dispatch(num_tasks, [](void* ctx, size_t task, unsigned worker) { (*static_cast<function_type*>(ctx))(task, worker); }, &fn);
+	}
+
+	//splits [0, count) into blocks of grain elements and calls fn(begin, end, worker_idx) for each of them
+	template<class F>
+	void parallel_for(size_t count, size_t grain, F&& fn){
+		grain = grain > 0 ? grain : 1;
+
+		run((count + grain - 1) / grain, [&](size_t block, unsigned worker) {
+			size_t begin = block * grain;
+			size_t end = begin + grain < count ? begin + grain : count;
+			fn(begin, end, worker);
+		});
+	}
+
+private:
+	typedef void (*task_function)(void*, size_t, unsigned);
+
+	std::vector<std::thread> workers;
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+
+	//the job currently being processed, guarded by mutex except for next_task
+	task_function job_function;
+	void* job_context;
+	size_t job_tasks;
+	std::atomic<size_t> next_task;
+
+	unsigned long long generation;
+	unsigned pending_workers;
+	bool stop;
+
+	void dispatch(size_t num_tasks, task_function fn, void* ctx);
+	void worker_loop(unsigned worker);
+	void work(unsigned worker);
+};
@@ -0,0 +1,83 @@
+#include "tile_binner.h"
+#include "parallel_primitives.h"
+#include "tracer.h"
+
+#include <algorithm>
+
+namespace {
+	bool is_empty(const pixel_rect& r){
+		return r.first_x >= r.end_x || r.first_y >= r.end_y;
+	}
+}
+
+tile_binner::tile_binner(uint32_t width, uint32_t height, uint32_t tile_size, thread_pool& pool) :
+	width(width),
+	height(height),
+	size(tile_size),
+	columns((width + tile_size - 1) / tile_size),
+	rows((height + tile_size - 1) / tile_size),
+	pool(pool),
+	tile_offsets(columns * rows + 1, 0)
+{}
+
+void tile_binner::bin(const pixel_rect* rects, size_t count){
+	TRACE_SCOPE("bin");
+
+	size_t tiles = columns * rows;
+
+	auto for_each_tile = [this, rects](size_t i, auto&& add) {
+		const pixel_rect& r = rects[i];
+		if(is_empty(r)) {
+			return;
+		}
+
+		for(int32_t ty = r.first_y / static_cast<int32_t>(size); ty <= (r.end_y - 1) / static_cast<int32_t>(size); ty++) {
+			for(int32_t tx = r.first_x / static_cast<int32_t>(size); tx <= (r.end_x - 1) / static_cast<int32_t>(size); tx++) {
+				add(ty * columns + tx);
+			}
+		}
+	};
+
+	parallel_primitives::counting_sort(pool, count, tiles, for_each_tile,
+		[this](size_t t, uint32_t start, uint32_t, unsigned) { tile_offsets[t] = start; },
+		[this, tiles](size_t total) {
+			tile_offsets[tiles] = static_cast<uint32_t>(total);
+			tile_lists.resize(total);
+		},
+		[this](size_t i, uint32_t position) { tile_lists[position] = static_cast<uint32_t>(i); },
+		scratch);
+}
+
+uint32_t tile_binner::tile_size() const{
+	return size;
+}
+
+uint32_t tile_binner::tiles_x() const{
+	return columns;
+}
+
+uint32_t tile_binner::tiles_y() const{
+	return rows;
+}
+
+uint32_t tile_binner::tile_count() const{
+	return columns * rows;
+}
+
+pixel_rect tile_binner::tile_rect(uint32_t tile) const{
+	pixel_rect r;
+
+	r.first_x = static_cast<int32_t>(tile % columns * size);
+	r.first_y = static_cast<int32_t>(tile / columns * size);
+	r.end_x = static_cast<int32_t>(std::min(tile % columns * size + size, width));
+	r.end_y = static_cast<int32_t>(std::min(tile / columns * size + size, height));
+	return r;
+}
+
+const uint32_t* tile_binner::begin(uint32_t tile) const{
+	return tile_lists.data() + tile_offsets[tile];
+}
+
+const uint32_t* tile_binner::end(uint32_t tile) const{
+	return tile_lists.data() + tile_offsets[tile + 1];
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "step_arena.h"
+#include "thread_pool.h"
+
+#include <cstdint>
+#include <vector>
+
+//pixels [first_x, end_x) x [first_y, end_y), empty if first >= end along either axis
+struct pixel_rect {
+	int32_t first_x;
+	int32_t end_x;
+	int32_t first_y;
+	int32_t end_y;
+};
+
+//sorts screen space primitives into lists per square tile, for renderers that shade the tiles in parallel
+//
+//the tiles are the bins of parallel_primitives::counting_sort, a primitive goes to every tile its rect overlaps.
+//so the list of every tile is ordered by primitive index, independent of the number of threads.
+class tile_binner {
+public:
+	tile_binner(uint32_t width, uint32_t height, uint32_t tile_size, thread_pool& pool);
+
+	//rects[i] are the pixels primitive i covers, they are clamped to the screen by the caller
+	void bin(const pixel_rect* rects, size_t count);
+
+	uint32_t tile_size() const;
+	uint32_t tiles_x() const;
+	uint32_t tiles_y() const;
+	uint32_t tile_count() const;
+
+	//the pixels of the given tile, clamped to the screen
+	pixel_rect tile_rect(uint32_t tile) const;
+
+	//the primitives overlapping the given tile, in ascending order
+	const uint32_t* begin(uint32_t tile) const;
+	const uint32_t* end(uint32_t tile) const;
+
+private:
+	uint32_t width;
+	uint32_t height;
+	uint32_t size;
+	uint32_t columns;
+	uint32_t rows;
+
+	thread_pool& pool;
+
+	//the per chunk counts of the sort
+	step_arena scratch;
+	std::vector<uint32_t> tile_offsets;
+	std::vector<uint32_t> tile_lists;
+};
@@ -0,0 +1,99 @@
+#include "timeline.h"
+
+#include <thread>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TIMELINE_PAUSE() _mm_pause()
+#else
+#define TIMELINE_PAUSE() ((void)0)
+#endif
+
+constexpr uint32_t timeline::DEFAULT_SPIN_COUNT;
+
+timeline::timeline(uint64_t initial, uint32_t spin_count) :
+	current(initial),
+	spin_count(std::thread::hardware_concurrency() > 1 ? spin_count : 0),
+	parked(0),
+	park_count(0)
+{}
+
+uint64_t timeline::value() const{
+	return current.load(std::memory_order_acquire);
+}
+
+void timeline::signal(uint64_t target){
+	uint64_t value = current.load(std::memory_order_relaxed);
+
+	while(value < target) {
+		if(current.compare_exchange_weak(value, target, std::memory_order_seq_cst)) {
+			wake();
+			return;
+		}
+	}
+}
+
+uint64_t timeline::advance(){
+	uint64_t value = current.fetch_add(1, std::memory_order_seq_cst) + 1;
+	wake();
+	return value;
+}
+
+void timeline::wait(uint64_t target){
+	if(spin(target)) {
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(mutex);
+	parked.fetch_add(1, std::memory_order_seq_cst);
+	park_count.fetch_add(1, std::memory_order_relaxed);
+
+	reached.wait(lock, [this, target]() { return current.load(std::memory_order_seq_cst) >= target; });
+
+	parked.fetch_sub(1, std::memory_order_relaxed);
+}
+
+bool timeline::wait_for(uint64_t target, std::chrono::nanoseconds timeout){
+	auto deadline = std::chrono::steady_clock::now() + timeout;
+
+	if(spin(target)) {
+		return true;
+	}
+
+	std::unique_lock<std::mutex> lock(mutex);
+	parked.fetch_add(1, std::memory_order_seq_cst);
+	park_count.fetch_add(1, std::memory_order_relaxed);
+
+	bool passed = reached.wait_until(lock, deadline, [this, target]() { return current.load(std::memory_order_seq_cst) >= target; });
+
+	parked.fetch_sub(1, std::memory_order_relaxed);
+	return passed;
+}
+
+uint64_t timeline::parked_waits() const{
+	return park_count.load(std::memory_order_relaxed);
+}
+
+bool timeline::spin(uint64_t target) const{
+	for(uint32_t i = 0; i < spin_count; i++) {
+		if(current.load(std::memory_order_acquire) >= target) {
+			return true;
+		}
+		TIMELINE_PAUSE();
+	}
+	return current.load(std::memory_order_acquire) >= target;
+}
+
+//a waiter registers as parked before it checks the value under the lock, and the value is raised before parked is read,
+//so either the waiter sees the new value or the signal sees the waiter.
+//taking the lock before the notification makes sure the waiter is not between its check and the wait.
+void timeline::wake(){
+	if(parked.load(std::memory_order_seq_cst) == 0) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+	}
+	reached.notify_all();
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+//a counter that only ever increases and that threads can wait on, the CPU counterpart of an ID3D12Fence with its completion event
+//
+//signal raises the value, wait blocks until it reaches a target. any number of threads can wait for different targets.
+//a waiter first spins on the atomic value for spin_count reads, which catches short waits without a trip through the kernel,
+//then parks on a condition variable. on a single hardware thread it parks right away, as spinning would only keep the signaler off the core.
+//signal only takes the lock if a waiter is parked, so a signal nobody waits for is a single atomic operation.
+class timeline {
+public:
+	static constexpr uint32_t DEFAULT_SPIN_COUNT = 4096;
+
+	explicit timeline(uint64_t initial = 0, uint32_t spin_count = DEFAULT_SPIN_COUNT);
+
+	timeline(const timeline&) = delete;
+	timeline& operator=(const timeline&) = delete;
+
+	uint64_t value() const;
+
+	//raises the value to target, a smaller target leaves it as it is
+	void signal(uint64_t target);
+	//raises the value by one and returns the new value
+	uint64_t advance();
+
+	//blocks until the value is at least target
+	void wait(uint64_t target);
+	//false if the value is still below target after the timeout
+	bool wait_for(uint64_t target, std::chrono::nanoseconds timeout);
+
+	//waits that had to park, since construction
+	uint64_t parked_waits() const;
+
+private:
+	std::atomic<uint64_t> current;
+	uint32_t spin_count;
+
+	std::atomic<uint32_t> parked;
+	std::atomic<uint64_t> park_count;
+
+	std::mutex mutex;
+	std::condition_variable reached;
+
+	bool spin(uint64_t target) const;
+	void wake();
+};
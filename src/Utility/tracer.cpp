@@ -0,0 +1,163 @@
+#include "tracer.h"
+
+#include <cstdio>
+#include <stdexcept>
+
+namespace {
+	void write_escaped(FILE* file, const std::string& text){
+		for(char c : text) {
+			if(c == '"' || c == '\\') {
+				fputc('\\', file);
+				fputc(c, file);
+			} else if(static_cast<unsigned char>(c) < 0x20) {
+				fprintf(file, "\\u%04x", c);
+			} else {
+				fputc(c, file);
+			}
+		}
+	}
+}
+
+constexpr size_t tracer::DEFAULT_EVENTS_PER_THREAD;
+
+tracer& tracer::instance(){
+	static tracer instance;
+	return instance;
+}
+
+tracer::tracer() :
+	active(false),
+	events_per_thread(DEFAULT_EVENTS_PER_THREAD),
+	epoch(std::chrono::steady_clock::now())
+{}
+
+void tracer::start(size_t events_per_thread){
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		this->events_per_thread = events_per_thread;
+
+		//the threads that registered during an earlier capture start over as well, with the new size
+		for(std::unique_ptr<thread_buffer>& buffer : buffers) {
+			buffer->events.resize(events_per_thread);
+			buffer->count.store(0, std::memory_order_relaxed);
+			buffer->dropped.store(0, std::memory_order_relaxed);
+		}
+	}
+	active.store(true, std::memory_order_relaxed);
+}
+
+void tracer::stop(){
+	active.store(false, std::memory_order_relaxed);
+}
+
+namespace {
+	//set_thread_name doesn't allocate a buffer, so threads can be named before tracing starts
+	thread_local std::string local_thread_name;
+	thread_local bool local_thread_named = false;
+}
+
+tracer::thread_buffer& tracer::local_buffer(){
+	thread_local thread_buffer* buffer = nullptr;
+
+	if(!buffer) {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		std::unique_ptr<thread_buffer> new_buffer(new thread_buffer());
+		new_buffer->events.resize(events_per_thread);
+		new_buffer->count.store(0, std::memory_order_relaxed);
+		new_buffer->dropped.store(0, std::memory_order_relaxed);
+		new_buffer->thread_id = static_cast<uint32_t>(buffers.size());
+		new_buffer->owner = std::this_thread::get_id();
+		new_buffer->thread_name = local_thread_named ? local_thread_name : "thread " + std::to_string(buffers.size());
+
+		buffer = new_buffer.get();
+		buffers.push_back(std::move(new_buffer));
+	}
+
+	return *buffer;
+}
+
+void tracer::record(const char* name, char phase){
+	thread_buffer& buffer = local_buffer();
+
+	//only this thread writes count, the release store publishes the event to write_chrome_trace
+	size_t idx = buffer.count.load(std::memory_order_relaxed);
+
+	if(idx >= buffer.events.size()) {
+		buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	event& e = buffer.events[idx];
+	e.name = name;
+	e.timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+	e.phase = phase;
+
+	buffer.count.store(idx + 1, std::memory_order_release);
+}
+
+void tracer::set_thread_name(const std::string& name){
+	std::lock_guard<std::mutex> lock(mutex);
+
+	local_thread_name = name;
+	local_thread_named = true;
+
+	//rename the buffer if this thread already has one
+	for(std::unique_ptr<thread_buffer>& buffer : buffers) {
+		if(buffer->owner == std::this_thread::get_id()) {
+			buffer->thread_name = name;
+		}
+	}
+}
+
+size_t tracer::dropped_events() const{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	size_t dropped = 0;
+	for(const std::unique_ptr<thread_buffer>& buffer : buffers) {
+		dropped += buffer->dropped.load(std::memory_order_relaxed);
+	}
+	return dropped;
+}
+
+void tracer::write_chrome_trace(const std::string& path) const{
+	FILE* file = fopen(path.c_str(), "wb");
+
+	if(!file) {
+		throw std::runtime_error("could not open trace file '" + path + "'");
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+
+	bool first = true;
+	for(const std::unique_ptr<thread_buffer>& buffer : buffers) {
+		fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"", first ? "" : ",\n", buffer->thread_id);
+		write_escaped(file, buffer->thread_name);
+		fprintf(file, "\"}}");
+		first = false;
+
+		size_t count = buffer->count.load(std::memory_order_acquire);
+
+		for(size_t i = 0; i < count; i++) {
+			const event& e = buffer->events[i];
+
+			fprintf(file, ",\n{\"name\":\"");
+			write_escaped(file, e.name);
+			//timestamps are in microseconds
+			fprintf(file, "\",\"ph\":\"%c\",\"pid\":1,\"tid\":%u,\"ts\":%llu.%03u%s}",
+				e.phase, buffer->thread_id, static_cast<unsigned long long>(e.timestamp_ns / 1000), static_cast<unsigned>(e.timestamp_ns % 1000),
+				e.phase == 'i' ? ",\"s\":\"t\"" : "");
+		}
+	}
+
+	fprintf(file, "\n]}\n");
+
+	bool failed = ferror(file) != 0;
+	fclose(file);
+
+	if(failed) {
+		throw std::runtime_error("could not write trace file '" + path + "'");
+	}
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//records begin/end events of named spans per thread and writes them as Chrome trace JSON,
+//which can be opened in Perfetto (ui.perfetto.dev) or chrome://tracing
+//
+//recording is off until start() is called, until then begin() and end() only check a flag.
+//every thread writes into its own fixed size buffer without taking a lock, the mutex is only taken once per thread
+//to register its buffer and when writing the trace. events that don't fit into the buffer are dropped and counted.
+//
+//names have to outlive the tracer, string literals are the intended use.
+class tracer {
+public:
+	static constexpr size_t DEFAULT_EVENTS_PER_THREAD = 1 << 16;
+
+	static tracer& instance();
+
+	//every thread gets an empty buffer of events_per_thread events, the events and drops of an earlier capture are cleared.
+	//no thread may be recording while it runs, so it has to be called before tracing starts or after stop() once the traced work is done
+	void start(size_t events_per_thread = DEFAULT_EVENTS_PER_THREAD);
+	void stop();
+
+	bool enabled() const{
+		return active.load(std::memory_order_relaxed);
+	}
+
+	void begin(const char* name){
+		if(enabled()) {
+			record(name, 'B');
+		}
+	}
+
+	void end(const char* name){
+		if(enabled()) {
+			record(name, 'E');
+		}
+	}
+
+	//a point in time without duration, e.g. for work handed to the GPU
+	void instant(const char* name){
+		if(enabled()) {
+			record(name, 'i');
+		}
+	}
+
+	//shows up as the name of the calling thread's track, can be called before start()
+	void set_thread_name(const std::string& name);
+
+	size_t dropped_events() const;
+
+	//may be called while other threads are still recording, their latest events might just be missing
+	void write_chrome_trace(const std::string& path) const;
+
+private:
+	struct event {
+		const char* name;
+		uint64_t timestamp_ns;
+		char phase;
+	};
+
+	struct thread_buffer {
+		std::vector<event> events;
+		std::atomic<size_t> count;
+		std::atomic<size_t> dropped;
+		uint32_t thread_id;
+		std::thread::id owner;
+		std::string thread_name;
+	};
+
+	std::atomic<bool> active;
+	size_t events_per_thread;
+	std::chrono::steady_clock::time_point epoch;
+
+	mutable std::mutex mutex;
+	std::vector<std::unique_ptr<thread_buffer>> buffers;
+
+	tracer();
+
+	thread_buffer& local_buffer();
+	void record(const char* name, char phase);
+};
+
+//records a span from construction to destruction
+class trace_scope {
+public:
+	explicit trace_scope(const char* name) :
+		name(name)
+	{
+		tracer::instance().begin(name);
+	}
+
+	~trace_scope(){
+		tracer::instance().end(name);
+	}
+
+	trace_scope(const trace_scope&) = delete;
+	trace_scope& operator=(const trace_scope&) = delete;
+
+private:
+	const char* name;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name) trace_scope TRACE_CONCAT(trace_scope_, __LINE__)(name)